@@ -1,16 +1,37 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "frustum.h"
 #include "mmath.h"
 
+// derived camera state that needs rebuilding, see struct camera
+#define CAMERA_DIRTY_VIEW 1
+#define CAMERA_DIRTY_RIGHT 2
+#define CAMERA_DIRTY_PROJECTION 4
+#define CAMERA_DIRTY_VIEW_PROJECTION 8
+#define CAMERA_DIRTY_ALL 15
+
 struct camera {
     float fov;
     float speed;
 
+    // far is ignored with reverse_z, which puts it at infinity
+    float near, far;
+    int reverse_z;
+
     vec3 pos;
     float miny, maxy;
 
     vec3 front, up;
+
+    // Cached from the fields above and rebuilt on first use after they change, so asking for the
+    // matrices again in a frame is a flag check. Change the fields through the camera_*
+    // functions, or call camera_invalidate after writing them directly.
+    uint32_t dirty;
+    float aspect_ratio;
+    vec3 right;
+    mat4 view, projection, view_projection;
+    struct frustum frustum;
 };
 
 static inline void camera_init(struct camera* cam, vec3 pos, vec3 front, vec3 up) {
@@ -19,6 +40,19 @@ static inline void camera_init(struct camera* cam, vec3 pos, vec3 front, vec3 up
     cam->up = up;
     cam->speed = 1;
     cam->fov = 60;
+    cam->near = 0.1;
+    cam->far = 1000;
+    cam->reverse_z = 0;
+    cam->dirty = CAMERA_DIRTY_ALL;
+    cam->aspect_ratio = 0;
+}
+
+static inline void camera_invalidate(struct camera* cam) {
+    cam->dirty = CAMERA_DIRTY_ALL;
+}
+
+static inline void _camera_moved(struct camera* cam) {
+    cam->dirty |= CAMERA_DIRTY_VIEW | CAMERA_DIRTY_VIEW_PROJECTION;
 }
 
 static inline void camera_set_y_bounds(struct camera* cam, float min, float max) {
@@ -28,6 +62,7 @@ static inline void camera_set_y_bounds(struct camera* cam, float min, float max)
 
 static inline void camera_clamp(struct camera* cam) {
     cam->pos.y = clamp(cam->pos.y, cam->miny, cam->maxy);
+    _camera_moved(cam);
 }
 
 static inline vec3 camera_pos(struct camera* cam) {
@@ -51,7 +86,12 @@ static inline vec3 camera_down(struct camera* cam) {
 }
 
 static inline vec3 camera_right(struct camera* cam) {
-    return vec3_norm(vec3_cross(cam->front, cam->up));
+    if (cam->dirty & CAMERA_DIRTY_RIGHT) {
+        cam->right = vec3_norm(vec3_cross(cam->front, cam->up));
+        cam->dirty &= ~CAMERA_DIRTY_RIGHT;
+    }
+
+    return cam->right;
 }
 
 static inline vec3 camera_left(struct camera* cam) {
@@ -59,11 +99,69 @@ static inline vec3 camera_left(struct camera* cam) {
 }
 
 static inline mat4 camera_view(struct camera* cam) {
-    return look_at(cam->pos, vec3_add(cam->pos, cam->front), cam->up);
+    if (cam->dirty & CAMERA_DIRTY_VIEW) {
+        cam->view = look_at(cam->pos, vec3_add(cam->pos, cam->front), cam->up);
+        cam->dirty &= ~CAMERA_DIRTY_VIEW;
+    }
+
+    return cam->view;
 }
 
 static inline mat4 camera_projection(struct camera* cam, float aspect_ratio) {
-    return perspective(cam->fov, aspect_ratio, 0.1, 1000);
+    if (aspect_ratio != cam->aspect_ratio) {
+        cam->aspect_ratio = aspect_ratio;
+        cam->dirty |= CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_VIEW_PROJECTION;
+    }
+
+    if (cam->dirty & CAMERA_DIRTY_PROJECTION) {
+        cam->projection = cam->reverse_z
+                              ? perspective_reverse_z(cam->fov, aspect_ratio, cam->near)
+                              : perspective(cam->fov, aspect_ratio, cam->near, cam->far);
+        cam->dirty &= ~CAMERA_DIRTY_PROJECTION;
+    }
+
+    return cam->projection;
+}
+
+static inline void _camera_update_view_projection(struct camera* cam, float aspect_ratio) {
+    mat4 projection = camera_projection(cam, aspect_ratio);
+    mat4 view = camera_view(cam);
+
+    if (cam->dirty & CAMERA_DIRTY_VIEW_PROJECTION) {
+        cam->view_projection = mat4_mul(projection, view);
+        cam->frustum = cam->reverse_z ? frustum_from_matrix_reverse_z(cam->view_projection)
+                                      : frustum_from_matrix(cam->view_projection);
+        cam->dirty &= ~CAMERA_DIRTY_VIEW_PROJECTION;
+    }
+}
+
+static inline mat4 camera_view_projection(struct camera* cam, float aspect_ratio) {
+    _camera_update_view_projection(cam, aspect_ratio);
+    return cam->view_projection;
+}
+
+// world space view frustum
+static inline struct frustum camera_frustum(struct camera* cam, float aspect_ratio) {
+    _camera_update_view_projection(cam, aspect_ratio);
+    return cam->frustum;
+}
+
+static inline void camera_set_fov(struct camera* cam, float fov) {
+    cam->fov = fov;
+    cam->dirty |= CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_VIEW_PROJECTION;
+}
+
+static inline void camera_set_clip(struct camera* cam, float near, float far) {
+    cam->near = near;
+    cam->far = far;
+    cam->dirty |= CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_VIEW_PROJECTION;
+}
+
+// Only use with window_enable_reverse_z, the projection expects a [0, 1] depth range and a
+// greater depth test
+static inline void camera_set_reverse_z(struct camera* cam, int enabled) {
+    cam->reverse_z = enabled;
+    cam->dirty |= CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_VIEW_PROJECTION;
 }
 
 static inline void camera_move_forward(struct camera* cam, float delta) {
@@ -110,6 +208,8 @@ static inline void camera_set_front(struct camera* cam, float yaw, float pitch)
     };
 
     cam->front = vec3_norm(front);
+    cam->dirty |= CAMERA_DIRTY_RIGHT;
+    _camera_moved(cam);
 }
 
 struct fly_camera {
@@ -0,0 +1,164 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+
+#include "util.h"
+
+// Lock-free single producer, single consumer ring of fixed size packets, used to hand frames from
+// the main thread to the render thread.
+//
+// The producer fills the slot from frame_ring_acquire and publishes it, the consumer reads the
+// slot from frame_ring_peek and releases it. Neither side copies a packet, and with count slots
+// the producer is at most count frames ahead.
+//
+// A side that has nothing else to do blocks in frame_ring_acquire_wait or frame_ring_peek_wait.
+// Publishing and releasing only take the lock while the other side is blocked.
+
+// packets get cache lines of their own, the two threads write neighbouring ones
+#define FRAME_RING_ALIGN 64
+
+struct frame_ring {
+    uint8_t* packets;
+    uint32_t stride;
+    uint32_t count;
+
+    // packets published and released so far, only ever increase
+    _Atomic uint32_t written;
+    _Atomic uint32_t read;
+    _Atomic int closed;
+
+    // the side blocked in a _wait call sleeps on changed, see _frame_ring_notify
+    mtx_t lock;
+    cnd_t changed;
+    _Atomic uint32_t waiting;
+};
+
+static inline void frame_ring_init(struct frame_ring* ring, uint32_t packet_size, uint32_t count) {
+    ring->stride = (packet_size + FRAME_RING_ALIGN - 1) & ~(FRAME_RING_ALIGN - 1);
+    ring->count = count;
+    ring->packets = aligned_alloc(FRAME_RING_ALIGN, (size_t)ring->stride * count);
+    if (!ring->packets)
+        panic("frame_ring_init: failed to allocate memory");
+
+    memset(ring->packets, 0, (size_t)ring->stride * count);
+    atomic_init(&ring->written, 0);
+    atomic_init(&ring->read, 0);
+    atomic_init(&ring->closed, 0);
+    atomic_init(&ring->waiting, 0);
+
+    if (mtx_init(&ring->lock, mtx_plain) != thrd_success ||
+        cnd_init(&ring->changed) != thrd_success)
+        panic("frame_ring_init: failed to create the lock");
+}
+
+// Wakes the other side if it is blocked. The fences order the counter update before the check of
+// waiting here, and the waiter's increment before its check of the counters, so at least one of
+// the two sees the other.
+static inline void _frame_ring_notify(struct frame_ring* ring) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->waiting, memory_order_relaxed) == 0)
+        return;
+
+    mtx_lock(&ring->lock);
+    cnd_broadcast(&ring->changed);
+    mtx_unlock(&ring->lock);
+}
+
+static inline void _frame_ring_wait_begin(struct frame_ring* ring) {
+    mtx_lock(&ring->lock);
+    atomic_fetch_add_explicit(&ring->waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+static inline void _frame_ring_wait_end(struct frame_ring* ring) {
+    atomic_fetch_sub_explicit(&ring->waiting, 1, memory_order_relaxed);
+    mtx_unlock(&ring->lock);
+}
+
+// producer: the next free packet, nullptr while the consumer holds them all
+static inline void* frame_ring_acquire(struct frame_ring* ring) {
+    uint32_t written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+    uint32_t read = atomic_load_explicit(&ring->read, memory_order_acquire);
+    if (written - read == ring->count)
+        return nullptr;
+
+    return ring->packets + (size_t)(written % ring->count) * ring->stride;
+}
+
+// producer: hands the acquired packet to the consumer
+static inline void frame_ring_publish(struct frame_ring* ring) {
+    uint32_t written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+    atomic_store_explicit(&ring->written, written + 1, memory_order_release);
+    _frame_ring_notify(ring);
+}
+
+// consumer: the oldest published packet, nullptr if there is none
+static inline void* frame_ring_peek(struct frame_ring* ring) {
+    uint32_t read = atomic_load_explicit(&ring->read, memory_order_relaxed);
+    uint32_t written = atomic_load_explicit(&ring->written, memory_order_acquire);
+    if (written == read)
+        return nullptr;
+
+    return ring->packets + (size_t)(read % ring->count) * ring->stride;
+}
+
+// consumer: gives the peeked packet back to the producer
+static inline void frame_ring_release(struct frame_ring* ring) {
+    uint32_t read = atomic_load_explicit(&ring->read, memory_order_relaxed);
+    atomic_store_explicit(&ring->read, read + 1, memory_order_release);
+    _frame_ring_notify(ring);
+}
+
+// producer: no more packets will be published
+static inline void frame_ring_close(struct frame_ring* ring) {
+    atomic_store_explicit(&ring->closed, 1, memory_order_release);
+    _frame_ring_notify(ring);
+}
+
+// consumer: closed and every packet consumed
+static inline int frame_ring_done(struct frame_ring* ring) {
+    return atomic_load_explicit(&ring->closed, memory_order_acquire) && !frame_ring_peek(ring);
+}
+
+// producer: like frame_ring_acquire, but sleeps until the consumer releases a packet
+static inline void* frame_ring_acquire_wait(struct frame_ring* ring) {
+    void* packet = frame_ring_acquire(ring);
+    if (packet)
+        return packet;
+
+    _frame_ring_wait_begin(ring);
+    while (!(packet = frame_ring_acquire(ring)))
+        cnd_wait(&ring->changed, &ring->lock);
+    _frame_ring_wait_end(ring);
+
+    return packet;
+}
+
+// consumer: like frame_ring_peek, but sleeps until a packet is published or the ring is closed.
+// Can return nullptr once closed even if a last packet is left, check frame_ring_done.
+static inline void* frame_ring_peek_wait(struct frame_ring* ring) {
+    void* packet = frame_ring_peek(ring);
+    if (packet)
+        return packet;
+
+    _frame_ring_wait_begin(ring);
+    while (!(packet = frame_ring_peek(ring)) &&
+           !atomic_load_explicit(&ring->closed, memory_order_acquire))
+        cnd_wait(&ring->changed, &ring->lock);
+    _frame_ring_wait_end(ring);
+
+    return packet;
+}
+
+static inline void frame_ring_uninit(struct frame_ring* ring) {
+    cnd_destroy(&ring->changed);
+    mtx_destroy(&ring->lock);
+    free(ring->packets);
+    ring->packets = nullptr;
+}
+
+#endif
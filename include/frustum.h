@@ -0,0 +1,215 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <stdint.h>
+
+#include "mmath.h"
+
+enum frustum_plane {
+    FRUSTUM_LEFT,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    FRUSTUM_NEAR,
+    FRUSTUM_FAR,
+    FRUSTUM_PLANES,
+};
+
+// planes are stored as (normal, distance), a point p is inside when dot(normal, p) + distance >= 0
+struct frustum {
+    vec4 planes[FRUSTUM_PLANES];
+};
+
+static inline vec4 _frustum_normalize_plane(vec4 p) {
+    float len = sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+
+    // an infinite far plane degenerates into (0, 0, 0, w) which accepts everything, leave it
+    if (len < 1e-12)
+        return p;
+
+    return (vec4){p.x / len, p.y / len, p.z / len, p.w / len};
+}
+
+// Gribb-Hartmann plane extraction. For m = projection * view the planes are in world space, for
+// m = projection * view * model they are in that model's local space.
+static inline struct frustum frustum_from_matrix(mat4 m) {
+    vec4 r0 = {m.x.x, m.y.x, m.z.x, m.w.x};
+    vec4 r1 = {m.x.y, m.y.y, m.z.y, m.w.y};
+    vec4 r2 = {m.x.z, m.y.z, m.z.z, m.w.z};
+    vec4 r3 = {m.x.w, m.y.w, m.z.w, m.w.w};
+
+    struct frustum f;
+    f.planes[FRUSTUM_LEFT] = _frustum_normalize_plane(vec4_add(r3, r0));
+    f.planes[FRUSTUM_RIGHT] = _frustum_normalize_plane(vec4_sub(r3, r0));
+    f.planes[FRUSTUM_BOTTOM] = _frustum_normalize_plane(vec4_add(r3, r1));
+    f.planes[FRUSTUM_TOP] = _frustum_normalize_plane(vec4_sub(r3, r1));
+    f.planes[FRUSTUM_NEAR] = _frustum_normalize_plane(vec4_add(r3, r2));
+    f.planes[FRUSTUM_FAR] = _frustum_normalize_plane(vec4_sub(r3, r2));
+
+    return f;
+}
+
+// Same for a reverse-z projection, where clip depth runs from w at the near plane to 0 at the far
+// one. The far plane of perspective_reverse_z is at infinity and accepts everything.
+static inline struct frustum frustum_from_matrix_reverse_z(mat4 m) {
+    vec4 r2 = {m.x.z, m.y.z, m.z.z, m.w.z};
+    vec4 r3 = {m.x.w, m.y.w, m.z.w, m.w.w};
+
+    struct frustum f = frustum_from_matrix(m);
+    f.planes[FRUSTUM_NEAR] = _frustum_normalize_plane(vec4_sub(r3, r2));
+    f.planes[FRUSTUM_FAR] = _frustum_normalize_plane(r2);
+
+    return f;
+}
+
+static inline int frustum_test_sphere(const struct frustum* f, sphere s) {
+    for (int i = 0; i < FRUSTUM_PLANES; i++) {
+        vec4 p = f->planes[i];
+        if (p.x * s.center.x + p.y * s.center.y + p.z * s.center.z + p.w < -s.radius)
+            return 0;
+    }
+
+    return 1;
+}
+
+static inline int frustum_test_aabb(const struct frustum* f, aabb box) {
+    vec3 c = vec3_scale(vec3_add(box.min, box.max), 0.5);
+    vec3 e = vec3_scale(vec3_sub(box.max, box.min), 0.5);
+
+    for (int i = 0; i < FRUSTUM_PLANES; i++) {
+        vec4 p = f->planes[i];
+        float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+        float r = fabsf(p.x) * e.x + fabsf(p.y) * e.y + fabsf(p.z) * e.z;
+        if (d + r < 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+#if defined(MMATH_SSE)
+
+// tests 4 boxes against all planes at once, returns a 4 bit visibility mask
+static inline int _frustum_test_aabb4_sse(const struct frustum* f, const aabb* b) {
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+
+    __m128 minx = _mm_setr_ps(b[0].min.x, b[1].min.x, b[2].min.x, b[3].min.x);
+    __m128 miny = _mm_setr_ps(b[0].min.y, b[1].min.y, b[2].min.y, b[3].min.y);
+    __m128 minz = _mm_setr_ps(b[0].min.z, b[1].min.z, b[2].min.z, b[3].min.z);
+    __m128 maxx = _mm_setr_ps(b[0].max.x, b[1].max.x, b[2].max.x, b[3].max.x);
+    __m128 maxy = _mm_setr_ps(b[0].max.y, b[1].max.y, b[2].max.y, b[3].max.y);
+    __m128 maxz = _mm_setr_ps(b[0].max.z, b[1].max.z, b[2].max.z, b[3].max.z);
+
+    __m128 cx = _mm_mul_ps(_mm_add_ps(minx, maxx), half);
+    __m128 cy = _mm_mul_ps(_mm_add_ps(miny, maxy), half);
+    __m128 cz = _mm_mul_ps(_mm_add_ps(minz, maxz), half);
+    __m128 ex = _mm_mul_ps(_mm_sub_ps(maxx, minx), half);
+    __m128 ey = _mm_mul_ps(_mm_sub_ps(maxy, miny), half);
+    __m128 ez = _mm_mul_ps(_mm_sub_ps(maxz, minz), half);
+
+    __m128 outside = _mm_setzero_ps();
+    for (int i = 0; i < FRUSTUM_PLANES; i++) {
+        __m128 px = _mm_set1_ps(f->planes[i].x);
+        __m128 py = _mm_set1_ps(f->planes[i].y);
+        __m128 pz = _mm_set1_ps(f->planes[i].z);
+        __m128 pw = _mm_set1_ps(f->planes[i].w);
+
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                              _mm_add_ps(_mm_mul_ps(pz, cz), pw));
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, px), ex),
+                                         _mm_mul_ps(_mm_andnot_ps(sign, py), ey)),
+                              _mm_mul_ps(_mm_andnot_ps(sign, pz), ez));
+
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+    }
+
+    return ~_mm_movemask_ps(outside) & 0xF;
+}
+
+#if defined(__AVX__)
+
+static inline __m256 _frustum_gather8(const aabb* b, int offset) {
+    const float* p = (const float*)b + offset;
+    const int stride = sizeof(aabb) / sizeof(float);
+    return _mm256_setr_ps(p[0], p[stride], p[2 * stride], p[3 * stride], p[4 * stride],
+                          p[5 * stride], p[6 * stride], p[7 * stride]);
+}
+
+// 8 boxes at a time, returns an 8 bit visibility mask
+static inline int _frustum_test_aabb8_avx(const struct frustum* f, const aabb* b) {
+    __m256 half = _mm256_set1_ps(0.5f);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+
+    __m256 minx = _frustum_gather8(b, 0), maxx = _frustum_gather8(b, 3);
+    __m256 miny = _frustum_gather8(b, 1), maxy = _frustum_gather8(b, 4);
+    __m256 minz = _frustum_gather8(b, 2), maxz = _frustum_gather8(b, 5);
+
+    __m256 cx = _mm256_mul_ps(_mm256_add_ps(minx, maxx), half);
+    __m256 cy = _mm256_mul_ps(_mm256_add_ps(miny, maxy), half);
+    __m256 cz = _mm256_mul_ps(_mm256_add_ps(minz, maxz), half);
+    __m256 ex = _mm256_mul_ps(_mm256_sub_ps(maxx, minx), half);
+    __m256 ey = _mm256_mul_ps(_mm256_sub_ps(maxy, miny), half);
+    __m256 ez = _mm256_mul_ps(_mm256_sub_ps(maxz, minz), half);
+
+    __m256 outside = _mm256_setzero_ps();
+    for (int i = 0; i < FRUSTUM_PLANES; i++) {
+        __m256 px = _mm256_set1_ps(f->planes[i].x);
+        __m256 py = _mm256_set1_ps(f->planes[i].y);
+        __m256 pz = _mm256_set1_ps(f->planes[i].z);
+        __m256 pw = _mm256_set1_ps(f->planes[i].w);
+
+        __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, cx), _mm256_mul_ps(py, cy)),
+                                 _mm256_add_ps(_mm256_mul_ps(pz, cz), pw));
+        __m256 r =
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(sign, px), ex),
+                                        _mm256_mul_ps(_mm256_andnot_ps(sign, py), ey)),
+                          _mm256_mul_ps(_mm256_andnot_ps(sign, pz), ez));
+
+        __m256 below = _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ);
+        outside = _mm256_or_ps(outside, below);
+    }
+
+    return ~_mm256_movemask_ps(outside) & 0xFF;
+}
+
+#endif
+#endif
+
+// Writes 1 to visible[i] if boxes[i] intersects the frustum, 0 otherwise. Returns the number of
+// visible boxes.
+static inline uint32_t frustum_cull_aabbs(const struct frustum* f,
+                                          const aabb* boxes,
+                                          uint32_t count,
+                                          uint8_t* visible) {
+    uint32_t i = 0, drawn = 0;
+
+#if defined(MMATH_SSE) && defined(__AVX__)
+    for (; i + 8 <= count; i += 8) {
+        int mask = _frustum_test_aabb8_avx(f, &boxes[i]);
+        for (int j = 0; j < 8; j++) {
+            visible[i + j] = (mask >> j) & 1;
+            drawn += visible[i + j];
+        }
+    }
+#endif
+
+#if defined(MMATH_SSE)
+    for (; i + 4 <= count; i += 4) {
+        int mask = _frustum_test_aabb4_sse(f, &boxes[i]);
+        for (int j = 0; j < 4; j++) {
+            visible[i + j] = (mask >> j) & 1;
+            drawn += visible[i + j];
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        visible[i] = frustum_test_aabb(f, boxes[i]);
+        drawn += visible[i];
+    }
+
+    return drawn;
+}
+
+#endif
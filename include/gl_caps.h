@@ -0,0 +1,29 @@
+#ifndef GL_CAPS_H
+#define GL_CAPS_H
+
+#include <string.h>
+
+#include "gl_loader.h"
+
+// Checks for features beyond the 3.3 core context, which newer drivers or extensions provide.
+// Query once and keep the result, the extension scan is a string compare per extension.
+
+static inline int gl_has_version(GLint major, GLint minor) {
+    GLint context_major = 0, context_minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &context_major);
+    glGetIntegerv(GL_MINOR_VERSION, &context_minor);
+
+    return context_major > major || (context_major == major && context_minor >= minor);
+}
+
+static inline int gl_has_extension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return 1;
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include "gl_loader.h"
+#include "util.h"
+
+// Measures GPU time spent between gpu_timer_begin and gpu_timer_end with GL_TIME_ELAPSED queries.
+// Queries are kept in a ring and only read back once the GPU has the result. When every query is
+// still in flight the sample is skipped instead of waiting, so timing never stalls the pipeline.
+
+#define GPU_TIMER_QUERIES 4
+
+struct gpu_timer {
+    GLuint queries[GPU_TIMER_QUERIES];
+    uint32_t next;
+    uint32_t in_flight;
+    int timing;  // whether the current begin got a query
+
+    uint64_t total_ns;
+    uint32_t samples;
+    uint32_t skipped;
+};
+
+static inline void gpu_timer_init(struct gpu_timer* timer) {
+    glGenQueries(GPU_TIMER_QUERIES, timer->queries);
+    timer->next = 0;
+    timer->in_flight = 0;
+    timer->timing = 0;
+    timer->total_ns = 0;
+    timer->samples = 0;
+    timer->skipped = 0;
+}
+
+static inline void _gpu_timer_collect(struct gpu_timer* timer) {
+    while (timer->in_flight > 0) {
+        uint32_t oldest = (timer->next + GPU_TIMER_QUERIES - timer->in_flight) % GPU_TIMER_QUERIES;
+
+        GLint available = 0;
+        glGetQueryObjectiv(timer->queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(timer->queries[oldest], GL_QUERY_RESULT, &elapsed);
+        timer->total_ns += elapsed;
+        timer->samples += 1;
+        timer->in_flight -= 1;
+    }
+}
+
+static inline void gpu_timer_begin(struct gpu_timer* timer) {
+    _gpu_timer_collect(timer);
+
+    timer->timing = timer->in_flight < GPU_TIMER_QUERIES;
+    if (!timer->timing) {
+        timer->skipped += 1;
+        return;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[timer->next]);
+}
+
+static inline void gpu_timer_end(struct gpu_timer* timer) {
+    if (!timer->timing)
+        return;
+
+    timer->timing = 0;
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->next = (timer->next + 1) % GPU_TIMER_QUERIES;
+    timer->in_flight += 1;
+}
+
+// average over the samples collected since the last reset, in milliseconds
+static inline double gpu_timer_average_ms(struct gpu_timer* timer) {
+    if (timer->samples == 0)
+        return 0;
+
+    return (double)timer->total_ns / timer->samples / 1e6;
+}
+
+static inline uint32_t gpu_timer_samples(struct gpu_timer* timer) {
+    return timer->samples;
+}
+
+// begins that found every query in flight, the GPU is more than GPU_TIMER_QUERIES frames behind
+static inline uint32_t gpu_timer_skipped(struct gpu_timer* timer) {
+    return timer->skipped;
+}
+
+static inline void gpu_timer_reset(struct gpu_timer* timer) {
+    timer->total_ns = 0;
+    timer->samples = 0;
+    timer->skipped = 0;
+}
+
+static inline void gpu_timer_uninit(struct gpu_timer* timer) {
+    glDeleteQueries(GPU_TIMER_QUERIES, timer->queries);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "window.h"
 
 #include "camera.h"
+#include "gpu_timer.h"
 #include "mesh.h"
 #include "mmath.h"
 #include "model.h"
@@ -105,7 +106,7 @@ void debug_camera_mouse(float x, float y, float xdelta, float ydelta) {
 
 void debug_camera_scroll(float xdelta, float ydelta) {
     unused(xdelta);
-    DebugCamera->fov = clamp(DebugCamera->fov - ydelta, 10, 90);
+    camera_set_fov(DebugCamera, clamp(DebugCamera->fov - ydelta, 10, 90));
 }
 
 void window_register_debug_camera() {
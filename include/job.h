@@ -0,0 +1,423 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// Work-stealing job system.
+//
+// Every participating thread (the thread that called jobs_init plus the workers) owns a Chase-Lev
+// deque: the owner pushes and pops at the bottom, idle threads steal from the top. Jobs can be
+// created as children of another job; a parent only completes once all of its children have, so
+// job_wait on a parent waits for the whole tree. job_wait never blocks, it keeps executing other
+// jobs until the awaited one is done.
+//
+// Only the thread that called jobs_init and the workers may create, run or wait on jobs.
+//
+// Jobs are handed out from a per-thread ring of JOB_POOL_SIZE entries. Only finished jobs are
+// recycled, a thread whose ring is all in flight helps run jobs until one finishes. A job can be
+// waited on until it completes, after that its slot may already belong to another job.
+//
+// Before jobs_init (or with jobs_init(1) on a single core machine) job_run executes jobs inline,
+// which keeps code written against this API usable from programs that never start the workers.
+
+#define JOB_MAX_THREADS 64
+#define JOB_DEQUE_SIZE 4096
+#define JOB_POOL_SIZE 4096
+
+typedef void (*job_func)(void* arg);
+typedef void (*job_range_func)(uint32_t start, uint32_t end, void* arg);
+
+struct job_range {
+    job_range_func func;
+    void* arg;
+    uint32_t start, end;
+    uint32_t batch;
+};
+
+struct job {
+    job_func func;
+    void* arg;
+    struct job* parent;
+    atomic_uint unfinished;
+
+    struct job_range range;  // only used by job_parallel_for
+};
+
+struct job_deque {
+    _Atomic(struct job*) entries[JOB_DEQUE_SIZE];
+    atomic_long top, bottom;
+};
+
+struct job_thread {
+    struct job_deque deque;
+    struct job pool[JOB_POOL_SIZE];
+    uint32_t pool_next;
+    uint32_t seed;
+    pthread_t handle;
+};
+
+struct job_system {
+    struct job_thread* threads;
+    uint32_t thread_count;
+
+    atomic_int running;
+    atomic_uint pending;
+    atomic_uint sleeping;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+static struct job_system Jobs = {0};
+static _Thread_local uint32_t JobThreadIndex = 0;
+
+// ================ DEQUE ================
+
+static inline void job_deque_init(struct job_deque* d) {
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+}
+
+// owner only
+static inline int job_deque_push(struct job_deque* d, struct job* job) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t >= JOB_DEQUE_SIZE)
+        return 0;
+
+    atomic_store_explicit(&d->entries[b & (JOB_DEQUE_SIZE - 1)], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+
+    return 1;
+}
+
+// owner only
+static inline struct job* job_deque_pop(struct job_deque* d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return nullptr;
+    }
+
+    struct job* job = atomic_load_explicit(&d->entries[b & (JOB_DEQUE_SIZE - 1)],
+                                           memory_order_relaxed);
+    if (t == b) {
+        // last entry, race against stealers
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            job = nullptr;
+
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+// any thread
+static inline struct job* job_deque_steal(struct job_deque* d) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b)
+        return nullptr;
+
+    struct job* job = atomic_load_explicit(&d->entries[t & (JOB_DEQUE_SIZE - 1)],
+                                           memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return nullptr;
+
+    return job;
+}
+
+// ================ JOBS ================
+
+static inline struct job_thread* _job_current_thread() {
+    return &Jobs.threads[JobThreadIndex];
+}
+
+static inline int job_is_complete(struct job* job) {
+    return atomic_load_explicit(&job->unfinished, memory_order_acquire) == 0;
+}
+
+static inline void _job_finish(struct job* job) {
+    while (job) {
+        // once finished the owner may recycle the slot, so read the parent before that
+        struct job* parent = job->parent;
+        if (atomic_fetch_sub_explicit(&job->unfinished, 1, memory_order_acq_rel) != 1)
+            break;
+
+        job = parent;
+    }
+}
+
+static inline void _job_execute(struct job* job) {
+    if (job->func)
+        job->func(job->arg);
+
+    _job_finish(job);
+}
+
+static inline struct job* _job_get() {
+    struct job_thread* thread = _job_current_thread();
+
+    struct job* job = job_deque_pop(&thread->deque);
+    if (job) {
+        atomic_fetch_sub(&Jobs.pending, 1);
+        return job;
+    }
+
+    if (Jobs.thread_count < 2)
+        return nullptr;
+
+    // xorshift, only needs to spread stealers around
+    thread->seed ^= thread->seed << 13;
+    thread->seed ^= thread->seed >> 17;
+    thread->seed ^= thread->seed << 5;
+
+    for (uint32_t i = 0; i < Jobs.thread_count; i++) {
+        uint32_t victim = (thread->seed + i) % Jobs.thread_count;
+        if (victim == JobThreadIndex)
+            continue;
+
+        job = job_deque_steal(&Jobs.threads[victim].deque);
+        if (job) {
+            atomic_fetch_sub(&Jobs.pending, 1);
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+// Next finished slot of the ring, only its owner allocates from it
+static inline struct job* _job_allocate_from(struct job* pool, uint32_t* next) {
+    for (;;) {
+        for (uint32_t i = 0; i < JOB_POOL_SIZE; i++) {
+            struct job* job = &pool[(*next)++ & (JOB_POOL_SIZE - 1)];
+            if (job_is_complete(job))
+                return job;
+        }
+
+        // every job is in flight, finish some of them
+        struct job* other = Jobs.threads ? _job_get() : nullptr;
+        if (other)
+            _job_execute(other);
+        else if (!Jobs.threads || Jobs.thread_count < 2)
+            panic("job_create: more than %d nested jobs running inline", JOB_POOL_SIZE);
+        else
+            sched_yield();
+    }
+}
+
+static inline struct job* _job_allocate() {
+    // zeroed, so every slot starts out finished
+    static struct job fallback_pool[JOB_POOL_SIZE];
+    static uint32_t fallback_next = 0;
+
+    if (!Jobs.threads)
+        return _job_allocate_from(fallback_pool, &fallback_next);
+
+    struct job_thread* thread = _job_current_thread();
+    return _job_allocate_from(thread->pool, &thread->pool_next);
+}
+
+static inline struct job* job_create(job_func func, void* arg) {
+    struct job* job = _job_allocate();
+    job->func = func;
+    job->arg = arg;
+    job->parent = nullptr;
+    atomic_store_explicit(&job->unfinished, 1, memory_order_relaxed);
+
+    return job;
+}
+
+static inline struct job* job_create_child(struct job* parent, job_func func, void* arg) {
+    atomic_fetch_add(&parent->unfinished, 1);
+
+    struct job* job = job_create(func, arg);
+    job->parent = parent;
+
+    return job;
+}
+
+static inline void job_run(struct job* job) {
+    if (!Jobs.threads || Jobs.thread_count < 2) {
+        _job_execute(job);
+        return;
+    }
+
+    atomic_fetch_add(&Jobs.pending, 1);
+    if (!job_deque_push(&_job_current_thread()->deque, job)) {
+        // deque full, run it now instead of dropping it
+        atomic_fetch_sub(&Jobs.pending, 1);
+        _job_execute(job);
+        return;
+    }
+
+    if (atomic_load(&Jobs.sleeping) > 0) {
+        pthread_mutex_lock(&Jobs.lock);
+        pthread_cond_signal(&Jobs.wake);
+        pthread_mutex_unlock(&Jobs.lock);
+    }
+}
+
+static inline void job_wait(struct job* job) {
+    while (!job_is_complete(job)) {
+        struct job* next = _job_get();
+        if (next)
+            _job_execute(next);
+        else
+            sched_yield();
+    }
+}
+
+// ================ PARALLEL FOR ================
+
+static inline void _job_range_split(void* arg) {
+    struct job* job = arg;
+    struct job_range range = job->range;
+
+    while (range.end - range.start > range.batch) {
+        uint32_t mid = range.start + (range.end - range.start) / 2;
+
+        struct job* child = job_create_child(job, nullptr, nullptr);
+        child->func = _job_range_split;
+        child->arg = child;
+        child->range = range;
+        child->range.start = mid;
+        job_run(child);
+
+        range.end = mid;
+    }
+
+    range.func(range.start, range.end, range.arg);
+}
+
+// Calls func over [0, count) split into chunks of at most batch items, spread over all threads.
+// Returns once every chunk is done.
+static inline void job_parallel_for(uint32_t count,
+                                    uint32_t batch,
+                                    job_range_func func,
+                                    void* arg) {
+    if (count == 0)
+        return;
+
+    struct job* root = job_create(_job_range_split, nullptr);
+    root->arg = root;
+    root->range = (struct job_range){
+        .func = func,
+        .arg = arg,
+        .start = 0,
+        .end = count,
+        .batch = batch == 0 ? 1 : batch,
+    };
+
+    job_run(root);
+    job_wait(root);
+}
+
+// ================ WORKERS ================
+
+static inline void* _job_worker_main(void* arg) {
+    JobThreadIndex = (uint32_t)(uintptr_t)arg;
+
+    uint32_t idle = 0;
+    while (atomic_load(&Jobs.running)) {
+        struct job* job = _job_get();
+        if (job) {
+            _job_execute(job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < 64) {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&Jobs.lock);
+        atomic_fetch_add(&Jobs.sleeping, 1);
+        while (atomic_load(&Jobs.running) && atomic_load(&Jobs.pending) == 0)
+            pthread_cond_wait(&Jobs.wake, &Jobs.lock);
+        atomic_fetch_sub(&Jobs.sleeping, 1);
+        pthread_mutex_unlock(&Jobs.lock);
+
+        idle = 0;
+    }
+
+    return nullptr;
+}
+
+static inline uint32_t jobs_thread_count() {
+    return Jobs.threads ? Jobs.thread_count : 1;
+}
+
+// thread_count includes the calling thread, 0 picks one thread per online core
+static inline void jobs_init(uint32_t thread_count) {
+    if (thread_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 0 ? (uint32_t)cores : 1;
+    }
+
+    if (thread_count > JOB_MAX_THREADS)
+        thread_count = JOB_MAX_THREADS;
+
+    Jobs.threads = calloc(thread_count, sizeof(struct job_thread));
+    if (!Jobs.threads)
+        panic("jobs_init: failed to allocate memory");
+
+    Jobs.thread_count = thread_count;
+    atomic_init(&Jobs.running, 1);
+    atomic_init(&Jobs.pending, 0);
+    atomic_init(&Jobs.sleeping, 0);
+    pthread_mutex_init(&Jobs.lock, nullptr);
+    pthread_cond_init(&Jobs.wake, nullptr);
+
+    for (uint32_t i = 0; i < thread_count; i++) {
+        job_deque_init(&Jobs.threads[i].deque);
+        Jobs.threads[i].seed = 2463534242u + i * 7919;
+    }
+
+    JobThreadIndex = 0;
+
+    for (uint32_t i = 1; i < thread_count; i++) {
+        if (pthread_create(&Jobs.threads[i].handle, nullptr, _job_worker_main,
+                           (void*)(uintptr_t)i) != 0)
+            panic("jobs_init: failed to start worker thread %d", i);
+    }
+}
+
+static inline void jobs_uninit() {
+    if (!Jobs.threads)
+        return;
+
+    pthread_mutex_lock(&Jobs.lock);
+    atomic_store(&Jobs.running, 0);
+    pthread_cond_broadcast(&Jobs.wake);
+    pthread_mutex_unlock(&Jobs.lock);
+
+    for (uint32_t i = 1; i < Jobs.thread_count; i++)
+        pthread_join(Jobs.threads[i].handle, nullptr);
+
+    pthread_mutex_destroy(&Jobs.lock);
+    pthread_cond_destroy(&Jobs.wake);
+
+    free(Jobs.threads);
+    Jobs.threads = nullptr;
+    Jobs.thread_count = 0;
+}
+
+#endif
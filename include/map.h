@@ -29,6 +29,18 @@ static inline uint64_t uint_hasher(void* e) {
     return (uint64_t)e * 5381;
 }
 
+static inline int ptr_comparator(void* e1, void* e2) {
+    return (uintptr_t)e1 < (uintptr_t)e2 ? -1 : (uintptr_t)e1 > (uintptr_t)e2;
+}
+
+// For pointer keys, whose low bits are mostly alignment and whose high bits barely change between
+// allocations. The multiply spreads the address upwards and the shift brings it back down to the
+// bits the bucket index is taken from.
+static inline uint64_t ptr_hasher(void* e) {
+    uint64_t hash = ((uintptr_t)e >> 4) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
 static inline int str_comparator(void* e1, void* e2) {
     return strcmp(e1, e2);
 }
@@ -130,6 +142,9 @@ static inline struct map_entry* map_insert(struct map* map, void* key, void* ite
 }
 
 static inline struct map_entry* map_find(struct map* map, void* key) {
+    if (map->buckets.capacity == 0)
+        return nullptr;
+
     uint64_t hash = map->hash(key);
     uint32_t idx = hash % map->buckets.capacity;
     struct list* bucket = vec_item(&map->buckets, idx);
@@ -145,6 +160,9 @@ static inline struct map_entry* map_find(struct map* map, void* key) {
 }
 
 static inline int map_remove(struct map* map, void* key) {
+    if (map->buckets.capacity == 0)
+        return 0;
+
     uint64_t hash = map->hash(key);
     uint32_t idx = hash % map->buckets.capacity;
     struct list* bucket = vec_item(&map->buckets, idx);
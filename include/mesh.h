@@ -1,12 +1,15 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <float.h>
 #include <stddef.h>
 #include <string.h>
 
 #include "gl_loader.h"
+#include "mesh_optimize.h"
 #include "mmath.h"
 #include "util.h"
+#include "vector.h"
 
 struct vertex {
     vec3 pos;
@@ -14,19 +17,83 @@ struct vertex {
     vec2 tex_coords;
 };
 
+enum vertex_format {
+    VERTEX_FORMAT_FLOAT,   // struct vertex
+    VERTEX_FORMAT_PACKED,  // struct vertex_packed, drawn with shaders/packed_vs.glsl
+};
+
+// Half the size of struct vertex: positions are snorm16 relative to the mesh bounds (see struct
+// vertex_quantization), normals are octahedral encoded snorm16 and uvs are half floats.
+struct vertex_packed {
+    int16_t pos[4];  // w is padding
+    int16_t normal[2];
+    uint16_t tex_coords[2];
+};
+
+// position = offset + packed position * scale, the positionOffset and positionScale uniforms
+struct vertex_quantization {
+    vec3 offset;
+    vec3 scale;
+};
+
 struct mesh {
-    void* data;
+    void* data;  // owns vertices and indices, nullptr when they point into memory owned elsewhere
 
     struct vertex* vertices;
     uint32_t vertex_count;
 
-    uint32_t* indices;
+    uint32_t* indices;  // always 32 bit on the CPU, see index_type for the GPU copy
     uint32_t index_count;
 
+    // lods[0] is the full mesh, coarser levels are stored after it in indices, see
+    // mesh_generate_lods. 0 when the mesh has none.
+    struct mesh_lod lods[MESH_MAX_LODS];
+    uint32_t lod_count;
+
+    aabb bounds;
+    sphere bounding_sphere;
+
+    // layout on the GPU, the CPU copy always stays struct vertex
+    enum vertex_format format;
+    struct vertex_quantization quantization;
+
+    // GL_UNSIGNED_SHORT when every index fits, picked at upload
+    GLenum index_type;
+
+    // offsets into the shared buffers when the mesh lives in a mesh_buffer, 0 otherwise
+    uint32_t base_vertex, first_index;
+
+    GLuint VAO, VBO, EBO;
+
+    // per instance data for mesh_draw_instanced, created on first use
+    GLuint instance_VBO;
+    uint32_t instance_capacity;
+};
+
+// Per instance attributes, read by shaders/instanced_vs.glsl:
+// locations 3-6 hold the model matrix and 7-9 the normal matrix.
+struct mesh_instance {
+    mat4 model;
+    mat3 normal_matrix;
+};
+
+#define MESH_INSTANCE_LOCATION 3
+
+// One VAO with a VBO/EBO pair that several meshes are suballocated from, so they can be drawn with
+// base-vertex draws without rebinding anything between them.
+struct mesh_buffer {
     GLuint VAO, VBO, EBO;
+
+    enum vertex_format format;
+    struct vertex_quantization quantization;  // shared by every mesh in the buffer
+    GLenum index_type;
+
+    uint32_t vertex_capacity, index_capacity;
+    uint32_t vertex_count, index_count;
 };
 
 static inline void mesh_allocate(struct mesh* m, uint32_t vertex_count, uint32_t index_count) {
+    *m = (struct mesh){0};
     m->vertex_count = vertex_count;
     m->index_count = index_count;
     m->data = malloc(vertex_count * sizeof(struct vertex) + index_count * sizeof(uint32_t));
@@ -38,49 +105,482 @@ static inline void mesh_allocate(struct mesh* m, uint32_t vertex_count, uint32_t
     m->indices = (uint32_t*)(m->vertices + vertex_count);
 }
 
+// local space bounds, needs to be called again whenever the vertices change
+static inline void mesh_compute_bounds(struct mesh* m) {
+    if (m->vertex_count == 0) {
+        m->bounds = (aabb){0};
+        m->bounding_sphere = (sphere){0};
+        return;
+    }
+
+    aabb box = {m->vertices[0].pos, m->vertices[0].pos};
+    for (uint32_t i = 1; i < m->vertex_count; i++) {
+        vec3 p = m->vertices[i].pos;
+        box.min = (vec3){fminf(box.min.x, p.x), fminf(box.min.y, p.y), fminf(box.min.z, p.z)};
+        box.max = (vec3){fmaxf(box.max.x, p.x), fmaxf(box.max.y, p.y), fmaxf(box.max.z, p.z)};
+    }
+
+    vec3 center = vec3_scale(vec3_add(box.min, box.max), 0.5);
+    float radius2 = 0;
+    for (uint32_t i = 0; i < m->vertex_count; i++) {
+        vec3 d = vec3_sub(m->vertices[i].pos, center);
+        radius2 = fmaxf(radius2, vec3_dot(d, d));
+    }
+
+    m->bounds = box;
+    m->bounding_sphere = (sphere){center, sqrtf(radius2)};
+}
+
 static inline void mesh_copy_vertices(struct mesh* m, void* data) {
     memcpy(m->vertices, data, m->vertex_count * sizeof(struct vertex));
+    mesh_compute_bounds(m);
 }
 
 static inline void mesh_copy_indices(struct mesh* m, void* data) {
     memcpy(m->indices, data, m->index_count * sizeof(uint32_t));
 }
 
+// Reorders triangles for the post-transform vertex cache and, if overdraw is set, for less
+// overdraw, then vertices for fetch locality. Unreferenced vertices are dropped. Must be called
+// before the mesh is uploaded, bounds are not touched.
+static inline void mesh_optimize(struct mesh* m, int overdraw) {
+    if (m->index_count < 6)
+        return;
+
+    mesh_optimize_vertex_cache(m->indices, m->index_count, m->vertex_count);
+
+    if (overdraw)
+        mesh_optimize_overdraw(m->indices, m->index_count, &m->vertices[0].pos.x,
+                               sizeof(struct vertex), m->vertex_count);
+
+    m->vertex_count = mesh_optimize_vertex_fetch(m->vertices, sizeof(struct vertex),
+                                                 m->vertex_count, m->indices, m->index_count);
+}
+
+// ================ LEVELS OF DETAIL ================
+
+// indices to upload, the full mesh and all of its lods
+static inline uint32_t mesh_total_index_count(const struct mesh* m) {
+    if (m->lod_count == 0)
+        return m->index_count;
+
+    struct mesh_lod last = m->lods[m->lod_count - 1];
+    return last.first_index + last.index_count;
+}
+
+// Appends up to lod_count - 1 simplified index ranges after the mesh's indices, each aiming for
+// reduction times the triangles of the one before. Levels that barely simplify are left out.
+// Works on the current triangles, so call it after mesh_optimize and mesh_split. Returns the
+// number of levels including the full mesh.
+static inline uint32_t mesh_generate_lods(struct mesh* m, uint32_t lod_count, float reduction) {
+    if (lod_count > MESH_MAX_LODS)
+        lod_count = MESH_MAX_LODS;
+
+    if (!m->data)
+        panic("mesh_generate_lods: mesh does not own its data");
+
+    if (lod_count < 2 || m->index_count < 6) {
+        m->lods[0] = (struct mesh_lod){0, m->index_count, 0};
+        m->lod_count = 1;
+        return m->lod_count;
+    }
+
+    // every level is smaller than the full mesh
+    uint32_t capacity = m->index_count * lod_count;
+    void* data = malloc(m->vertex_count * sizeof(struct vertex) + capacity * sizeof(uint32_t));
+    if (!data)
+        panic("mesh_generate_lods: failed to allocate memory");
+
+    struct vertex* vertices = data;
+    uint32_t* indices = (uint32_t*)(vertices + m->vertex_count);
+    memcpy(vertices, m->vertices, m->vertex_count * sizeof(struct vertex));
+    memcpy(indices, m->indices, m->index_count * sizeof(uint32_t));
+
+    free(m->data);
+    m->data = data;
+    m->vertices = vertices;
+    m->indices = indices;
+
+    m->lod_count =
+        mesh_generate_lod_indices(m->lods, lod_count, indices, m->index_count, &vertices[0].pos.x,
+                                  sizeof(struct vertex), m->vertex_count, reduction);
+    return m->lod_count;
+}
+
+// The level of m to draw at depth, see mesh_lod_select
+static inline const struct mesh_lod* mesh_select_lod(const struct mesh* m,
+                                                     float depth,
+                                                     float error_scale) {
+    if (m->lod_count == 0)
+        return nullptr;
+
+    return &m->lods[mesh_lod_select(m->lods, m->lod_count, depth, error_scale)];
+}
+
+// ================ VERTEX FORMATS ================
+
+static inline uint32_t vertex_format_size(enum vertex_format format) {
+    return format == VERTEX_FORMAT_PACKED ? sizeof(struct vertex_packed) : sizeof(struct vertex);
+}
+
+static inline struct vertex_quantization vertex_quantization_from_bounds(aabb bounds) {
+    return (struct vertex_quantization){
+        .offset = vec3_scale(vec3_add(bounds.min, bounds.max), 0.5),
+        .scale = vec3_scale(vec3_sub(bounds.max, bounds.min), 0.5),
+    };
+}
+
+static inline void vertex_pack(const struct vertex* in,
+                               struct vertex_packed* out,
+                               uint32_t count,
+                               const struct vertex_quantization* q) {
+    vec3 inv = {
+        q->scale.x > 0 ? 1 / q->scale.x : 0,
+        q->scale.y > 0 ? 1 / q->scale.y : 0,
+        q->scale.z > 0 ? 1 / q->scale.z : 0,
+    };
+
+    for (uint32_t i = 0; i < count; i++) {
+        vec3 p = vec3_sub(in[i].pos, q->offset);
+        vec2 n = oct_encode(in[i].normal);
+
+        out[i] = (struct vertex_packed){
+            .pos = {float_to_snorm16(p.x * inv.x), float_to_snorm16(p.y * inv.y),
+                    float_to_snorm16(p.z * inv.z), 0},
+            .normal = {float_to_snorm16(n.x), float_to_snorm16(n.y)},
+            .tex_coords = {float_to_half(in[i].tex_coords.x), float_to_half(in[i].tex_coords.y)},
+        };
+    }
+}
+
+// Returns the vertices in the GPU layout of format, either vertices itself or a new allocation
+// that the caller frees.
+static inline void* _mesh_vertex_data(struct vertex* vertices,
+                                      uint32_t count,
+                                      enum vertex_format format,
+                                      const struct vertex_quantization* q) {
+    if (format == VERTEX_FORMAT_FLOAT)
+        return vertices;
+
+    struct vertex_packed* packed = malloc(count * sizeof(struct vertex_packed) + 1);
+    if (!packed)
+        panic("mesh: failed to allocate memory");
+
+    vertex_pack(vertices, packed, count, q);
+    return packed;
+}
+
+static inline void _mesh_vertex_attributes(enum vertex_format format) {
+    if (format == VERTEX_FORMAT_PACKED) {
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(struct vertex_packed),
+                              (void*)offsetof(struct vertex_packed, pos));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(struct vertex_packed),
+                              (void*)offsetof(struct vertex_packed, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(struct vertex_packed),
+                              (void*)offsetof(struct vertex_packed, tex_coords));
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
+                              (void*)offsetof(struct vertex, pos));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
+                              (void*)offsetof(struct vertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
+                              (void*)offsetof(struct vertex, tex_coords));
+    }
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+}
+
+// ================ INDEX FORMATS ================
+
+// 16 bit indices halve index bandwidth and are enough for any mesh up to 65535 vertices
+static inline GLenum mesh_index_type(uint32_t vertex_count) {
+    return vertex_count <= UINT16_MAX ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+static inline uint32_t mesh_index_size(GLenum index_type) {
+    return index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Returns the indices in the GPU layout of index_type, either indices itself or a new allocation
+// that the caller frees.
+static inline void* _mesh_index_data(uint32_t* indices, uint32_t count, GLenum index_type) {
+    if (index_type == GL_UNSIGNED_INT)
+        return indices;
+
+    uint16_t* narrow = malloc(count * sizeof(uint16_t) + 1);
+    if (!narrow)
+        panic("mesh: failed to allocate memory");
+
+    for (uint32_t i = 0; i < count; i++)
+        narrow[i] = indices[i];
+
+    return narrow;
+}
+
+// Splits m into meshes of at most max_vertices vertices each, so they qualify for 16 bit indices.
+// Triangles keep their order and every part gets its own bounds. The parts are pushed to out (a
+// vector of struct mesh) and own their data, m is left untouched. Returns the number of parts, 0
+// if m has no indices or already fits.
+static inline uint32_t mesh_split(struct mesh* m, uint32_t max_vertices, struct vector* out) {
+    if (m->index_count == 0 || m->vertex_count <= max_vertices || max_vertices < 3)
+        return 0;
+
+    uint32_t* part_indices = malloc(m->index_count * sizeof(uint32_t));
+    uint32_t* vertex_map = malloc(m->index_count * sizeof(uint32_t));
+    if (!part_indices || !vertex_map)
+        panic("mesh_split: failed to allocate memory");
+
+    struct vector ranges;
+    vec_init(&ranges, sizeof(struct mesh_part));
+    uint32_t parts = mesh_split_indices(part_indices, vertex_map, m->indices, m->index_count,
+                                        m->vertex_count, max_vertices, &ranges);
+
+    for (uint32_t p = 0; p < parts; p++) {
+        struct mesh_part* range = vec_item(&ranges, p);
+        struct mesh* part = vec_emplace(out);
+        mesh_allocate(part, range->vertex_count, range->index_count);
+
+        for (uint32_t i = 0; i < range->vertex_count; i++)
+            part->vertices[i] = m->vertices[vertex_map[range->first_vertex + i]];
+        mesh_copy_indices(part, &part_indices[range->first_index]);
+        mesh_compute_bounds(part);
+    }
+
+    vec_uninit(&ranges);
+    free(vertex_map);
+    free(part_indices);
+
+    return parts;
+}
+
+// Picks the GPU vertex layout, must be called before mesh_generate
+static inline void mesh_set_format(struct mesh* m, enum vertex_format format) {
+    m->format = format;
+}
+
 static inline void mesh_generate(struct mesh* m) {
+    m->base_vertex = 0;
+    m->first_index = 0;
+    m->instance_VBO = 0;
+    m->instance_capacity = 0;
+
     glGenVertexArrays(1, &m->VAO);
     glBindVertexArray(m->VAO);
 
+    m->quantization = vertex_quantization_from_bounds(m->bounds);
+    void* data = _mesh_vertex_data(m->vertices, m->vertex_count, m->format, &m->quantization);
+
     glGenBuffers(1, &m->VBO);
     glBindBuffer(GL_ARRAY_BUFFER, m->VBO);
-    glBufferData(GL_ARRAY_BUFFER, m->vertex_count * sizeof(struct vertex), m->vertices,
+    glBufferData(GL_ARRAY_BUFFER, m->vertex_count * vertex_format_size(m->format), data,
                  GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-                          (void*)offsetof(struct vertex, pos));
-    glEnableVertexAttribArray(0);
+    _mesh_vertex_attributes(m->format);
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-                          (void*)offsetof(struct vertex, normal));
-    glEnableVertexAttribArray(1);
+    if (data != m->vertices)
+        free(data);
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-                          (void*)offsetof(struct vertex, tex_coords));
-    glEnableVertexAttribArray(2);
+    m->index_type = mesh_index_type(m->vertex_count);
+
+    uint32_t index_count = mesh_total_index_count(m);
+    if (index_count > 0) {
+        void* indices = _mesh_index_data(m->indices, index_count, m->index_type);
 
-    if (m->index_count > 0) {
         glGenBuffers(1, &m->EBO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m->index_count * sizeof(uint32_t), m->indices,
-                     GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * mesh_index_size(m->index_type),
+                     indices, GL_STATIC_DRAW);
+
+        if (indices != m->indices)
+            free(indices);
+    }
+}
+
+// ================ SHARED BUFFERS ================
+
+// bounds must contain every mesh that will be added, packed positions are quantized against them.
+// Indices are relative to each mesh's base vertex, so index_type only has to cover the largest
+// mesh, see mesh_index_type.
+static inline void mesh_buffer_init(struct mesh_buffer* buf,
+                                    uint32_t vertex_capacity,
+                                    uint32_t index_capacity,
+                                    enum vertex_format format,
+                                    aabb bounds,
+                                    GLenum index_type) {
+    *buf = (struct mesh_buffer){
+        .format = format,
+        .quantization = vertex_quantization_from_bounds(bounds),
+        .index_type = index_type,
+        .vertex_capacity = vertex_capacity,
+        .index_capacity = index_capacity,
+    };
+
+    glGenVertexArrays(1, &buf->VAO);
+    glBindVertexArray(buf->VAO);
+
+    glGenBuffers(1, &buf->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, buf->VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertex_capacity * vertex_format_size(format), nullptr,
+                 GL_STATIC_DRAW);
+
+    _mesh_vertex_attributes(format);
+
+    glGenBuffers(1, &buf->EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buf->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_capacity * mesh_index_size(index_type), nullptr,
+                 GL_STATIC_DRAW);
+}
+
+// Uploads the mesh into the next free range of the buffer. The mesh then draws through the shared
+// VAO and must not be generated on its own.
+static inline void mesh_buffer_add(struct mesh_buffer* buf, struct mesh* m) {
+    uint32_t index_count = mesh_total_index_count(m);
+    if (buf->vertex_count + m->vertex_count > buf->vertex_capacity ||
+        buf->index_count + index_count > buf->index_capacity)
+        panic("mesh_buffer_add: buffer is full");
+
+    if (mesh_index_size(mesh_index_type(m->vertex_count)) > mesh_index_size(buf->index_type))
+        panic("mesh_buffer_add: mesh has too many vertices for the buffer's index type");
+
+    m->base_vertex = buf->vertex_count;
+    m->first_index = buf->index_count;
+    m->format = buf->format;
+    m->quantization = buf->quantization;
+    m->index_type = buf->index_type;
+    m->VAO = buf->VAO;
+    m->VBO = 0;
+    m->EBO = 0;
+
+    uint32_t vertex_size = vertex_format_size(buf->format);
+    void* data = _mesh_vertex_data(m->vertices, m->vertex_count, m->format, &m->quantization);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buf->VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, m->base_vertex * vertex_size, m->vertex_count * vertex_size,
+                    data);
+
+    if (data != m->vertices)
+        free(data);
+
+    if (index_count > 0) {
+        uint32_t index_size = mesh_index_size(buf->index_type);
+        void* indices = _mesh_index_data(m->indices, index_count, buf->index_type);
+
+        glBindVertexArray(buf->VAO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, m->first_index * index_size,
+                        index_count * index_size, indices);
+
+        if (indices != m->indices)
+            free(indices);
+    }
+
+    buf->vertex_count += m->vertex_count;
+    buf->index_count += index_count;
+}
+
+static inline void mesh_buffer_bind(struct mesh_buffer* buf) {
+    glBindVertexArray(buf->VAO);
+}
+
+static inline void mesh_buffer_uninit(struct mesh_buffer* buf) {
+    if (buf->VAO) {
+        glDeleteBuffers(1, &buf->EBO);
+        glDeleteBuffers(1, &buf->VBO);
+        glDeleteVertexArrays(1, &buf->VAO);
+    }
+
+    *buf = (struct mesh_buffer){0};
+}
+
+// ================ DRAWING ================
+
+// draws a mesh whose VAO (its own or its mesh_buffer's) is already bound
+static inline void mesh_draw_bound(struct mesh* m) {
+    if (m->index_count) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, m->index_count, m->index_type,
+                                 (void*)((size_t)m->first_index * mesh_index_size(m->index_type)),
+                                 m->base_vertex);
+    } else {
+        glDrawArrays(GL_TRIANGLES, m->base_vertex, m->vertex_count);
     }
 }
 
 static inline void mesh_draw(struct mesh* m) {
     glBindVertexArray(m->VAO);
+    mesh_draw_bound(m);
+}
+
+// ================ INSTANCING ================
+
+static inline void _mesh_instance_attributes() {
+    for (uint32_t i = 0; i < 4; i++) {
+        GLuint location = MESH_INSTANCE_LOCATION + i;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(struct mesh_instance),
+                              (void*)(offsetof(struct mesh_instance, model) + i * sizeof(vec4)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+
+    for (uint32_t i = 0; i < 3; i++) {
+        GLuint location = MESH_INSTANCE_LOCATION + 4 + i;
+        glVertexAttribPointer(
+            location, 3, GL_FLOAT, GL_FALSE, sizeof(struct mesh_instance),
+            (void*)(offsetof(struct mesh_instance, normal_matrix) + i * sizeof(vec3)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+// Maps room for count instances in the mesh's instance buffer, growing it if needed. The previous
+// contents are discarded, so the driver can hand out fresh memory instead of waiting on draws
+// that still read the old instances.
+static inline struct mesh_instance* _mesh_map_instances(struct mesh* m, uint32_t count) {
+    glBindVertexArray(m->VAO);
+
+    if (!m->instance_VBO) {
+        glGenBuffers(1, &m->instance_VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, m->instance_VBO);
+        _mesh_instance_attributes();
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, m->instance_VBO);
+    }
+
+    if (count > m->instance_capacity) {
+        m->instance_capacity = next_power_of_2(count);
+        glBufferData(GL_ARRAY_BUFFER, m->instance_capacity * sizeof(struct mesh_instance), nullptr,
+                     GL_STREAM_DRAW);
+    }
+
+    return glMapBufferRange(GL_ARRAY_BUFFER, 0, count * sizeof(struct mesh_instance),
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+// Draws count copies of the mesh with a single instanced draw call, one per model matrix. Needs a
+// shader that reads the instance attributes, see struct mesh_instance. Only standalone meshes
+// (mesh_generate) can be instanced, meshes in a mesh_buffer share their VAO.
+static inline void mesh_draw_instanced(struct mesh* m, const mat4* models, uint32_t count) {
+    if (count == 0)
+        return;
+
+    if (!m->VBO)
+        panic("mesh_draw_instanced: mesh has no buffers of its own");
+
+    struct mesh_instance* instances = _mesh_map_instances(m, count);
+    if (!instances)
+        panic("mesh_draw_instanced: failed to map instance buffer");
+
+    for (uint32_t i = 0; i < count; i++) {
+        instances[i].model = models[i];
+        instances[i].normal_matrix = mat4_normal_matrix(models[i]);
+    }
+
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
     if (m->index_count) {
-        glDrawElements(GL_TRIANGLES, m->index_count, GL_UNSIGNED_INT, 0);
+        glDrawElementsInstanced(GL_TRIANGLES, m->index_count, m->index_type, 0, count);
     } else {
-        glDrawArrays(GL_TRIANGLES, 0, m->vertex_count);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, m->vertex_count, count);
     }
 }
 
@@ -88,6 +588,12 @@ static inline void mesh_uninit(struct mesh* m) {
     if (m->data)
         free(m->data);
 
+    if (m->instance_VBO)
+        glDeleteBuffers(1, &m->instance_VBO);
+
+    m->instance_VBO = 0;
+    m->instance_capacity = 0;
+
     m->data = nullptr;
     m->vertices = nullptr;
     m->vertex_count = 0;
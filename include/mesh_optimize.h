@@ -0,0 +1,821 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmath.h"
+#include "util.h"
+#include "vector.h"
+
+// Index and vertex reordering for indexed triangle lists, meant to run once at load time:
+//
+// - mesh_optimize_vertex_cache reorders triangles for the post-transform vertex cache (Tom
+//   Forsyth's "Linear-Speed Vertex Cache Optimisation").
+// - mesh_optimize_overdraw reorders clusters of the cache optimized triangles so that outward
+//   facing ones are drawn first, without breaking up the clusters the cache order relies on.
+// - mesh_optimize_vertex_fetch renumbers vertices in first use order so vertex fetch walks memory
+//   linearly, dropping unreferenced vertices.
+//
+// mesh_cache_analyze simulates a FIFO cache to measure the result.
+//
+// mesh_simplify builds lower detail index buffers over the same vertices for LODs, and
+// mesh_generate_lod_indices chains it into a set of levels that mesh_lod_select picks from.
+//
+// mesh_split_indices cuts a mesh into parts small enough for 16 bit indices.
+
+#define MESH_CACHE_SIZE 32
+
+struct mesh_cache_stats {
+    uint32_t triangles;
+    uint32_t vertices;
+    uint32_t misses;
+
+    float acmr;  // average cache miss ratio, transformed vertices per triangle (0.5 - 3)
+    float atvr;  // average transformed vertex ratio, transformed vertices per vertex (>= 1)
+};
+
+static inline struct mesh_cache_stats mesh_cache_analyze(const uint32_t* indices,
+                                                         uint32_t index_count,
+                                                         uint32_t vertex_count,
+                                                         uint32_t cache_size) {
+    struct mesh_cache_stats stats = {
+        .triangles = index_count / 3,
+        .vertices = vertex_count,
+    };
+
+    // timestamp of when each vertex entered the fifo, it is cached while within cache_size misses
+    uint32_t* entered = calloc(vertex_count, sizeof(uint32_t));
+    if (!entered && vertex_count)
+        panic("mesh_cache_analyze: failed to allocate memory");
+
+    uint32_t time = cache_size + 1;
+    for (uint32_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (time - entered[v] > cache_size) {
+            entered[v] = time++;
+            stats.misses++;
+        }
+    }
+
+    free(entered);
+
+    stats.acmr = stats.triangles ? (float)stats.misses / stats.triangles : 0;
+    stats.atvr = stats.vertices ? (float)stats.misses / stats.vertices : 0;
+
+    return stats;
+}
+
+// ================ VERTEX CACHE ================
+
+static inline float _forsyth_vertex_score(const float* cache_scores,
+                                          const float* valence_scores,
+                                          int32_t cache_pos,
+                                          uint32_t remaining) {
+    if (remaining == 0)
+        return -1;
+
+    float score = cache_pos >= 0 ? cache_scores[cache_pos] : 0;
+    return score + (remaining < MESH_CACHE_SIZE ? valence_scores[remaining]
+                                                : 2.0f * powf(remaining, -0.5f));
+}
+
+static inline void mesh_optimize_vertex_cache(uint32_t* indices,
+                                              uint32_t index_count,
+                                              uint32_t vertex_count) {
+    uint32_t tri_count = index_count / 3;
+    if (tri_count < 2)
+        return;
+
+    // the last three vertices used get a fixed score so the next triangle doesn't just fan around
+    // them, older entries decay towards the end of the cache
+    float cache_scores[MESH_CACHE_SIZE];
+    for (uint32_t i = 0; i < MESH_CACHE_SIZE; i++)
+        cache_scores[i] =
+            i < 3 ? 0.75f : powf(1.0f - (float)(i - 3) / (MESH_CACHE_SIZE - 3), 1.5f);
+
+    // vertices with few triangles left are boosted so they get finished off and leave the cache
+    float valence_scores[MESH_CACHE_SIZE];
+    valence_scores[0] = 0;
+    for (uint32_t i = 1; i < MESH_CACHE_SIZE; i++)
+        valence_scores[i] = 2.0f * powf(i, -0.5f);
+
+    uint32_t* offsets = calloc(vertex_count + 1, sizeof(uint32_t));
+    uint32_t* remaining = calloc(vertex_count, sizeof(uint32_t));
+    uint32_t* adjacency = malloc(tri_count * 3 * sizeof(uint32_t));
+    int32_t* cache_pos = malloc(vertex_count * sizeof(int32_t));
+    float* vertex_score = malloc(vertex_count * sizeof(float));
+    float* tri_score = malloc(tri_count * sizeof(float));
+    uint8_t* emitted = calloc(tri_count, sizeof(uint8_t));
+    uint32_t* out = malloc(tri_count * 3 * sizeof(uint32_t));
+
+    if (!offsets || !remaining || !adjacency || !cache_pos || !vertex_score || !tri_score ||
+        !emitted || !out)
+        panic("mesh_optimize_vertex_cache: failed to allocate memory");
+
+    for (uint32_t i = 0; i < tri_count * 3; i++)
+        remaining[indices[i]]++;
+
+    for (uint32_t v = 0; v < vertex_count; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    // offsets[v] is used as a fill cursor and walks to offsets[v + 1], rewind it afterwards
+    for (uint32_t t = 0; t < tri_count; t++)
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k];
+            adjacency[offsets[v]++] = t;
+        }
+    for (uint32_t v = vertex_count; v > 0; v--)
+        offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        cache_pos[v] = -1;
+        vertex_score[v] = _forsyth_vertex_score(cache_scores, valence_scores, -1, remaining[v]);
+    }
+
+    uint32_t best = 0;
+    for (uint32_t t = 0; t < tri_count; t++) {
+        tri_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] +
+                       vertex_score[indices[t * 3 + 2]];
+        if (tri_score[t] > tri_score[best])
+            best = t;
+    }
+
+    uint32_t cache[MESH_CACHE_SIZE + 3];
+    uint32_t cache_count = 0;
+    uint32_t scan = 0;
+
+    for (uint32_t n = 0; n < tri_count; n++) {
+        const uint32_t* tri = &indices[best * 3];
+        memcpy(&out[n * 3], tri, 3 * sizeof(uint32_t));
+        emitted[best] = 1;
+
+        // drop the triangle from its vertices' adjacency
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = tri[k];
+            uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t i = 0; i < remaining[v]; i++) {
+                if (list[i] == best) {
+                    list[i] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // move the triangle's vertices to the front of the cache, the tail past
+        // MESH_CACHE_SIZE falls out but is still rescored below
+        uint32_t new_cache[MESH_CACHE_SIZE + 3];
+        uint32_t new_count = 0;
+        for (uint32_t k = 0; k < 3; k++)
+            new_cache[new_count++] = tri[k];
+        for (uint32_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                new_cache[new_count++] = v;
+        }
+
+        float best_score = -1;
+        for (uint32_t i = 0; i < new_count; i++) {
+            uint32_t v = new_cache[i];
+            cache_pos[v] = i < MESH_CACHE_SIZE ? (int32_t)i : -1;
+
+            float score = _forsyth_vertex_score(cache_scores, valence_scores, cache_pos[v],
+                                                remaining[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+
+            uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                uint32_t t = list[j];
+                tri_score[t] += delta;
+                if (tri_score[t] > best_score) {
+                    best_score = tri_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        cache_count = new_count < MESH_CACHE_SIZE ? new_count : MESH_CACHE_SIZE;
+        memcpy(cache, new_cache, cache_count * sizeof(uint32_t));
+
+        // nothing in the cache has triangles left, continue with the next untouched triangle
+        if (best_score < 0 && n + 1 < tri_count) {
+            while (emitted[scan])
+                scan++;
+            best = scan;
+        }
+    }
+
+    memcpy(indices, out, tri_count * 3 * sizeof(uint32_t));
+
+    free(out);
+    free(emitted);
+    free(tri_score);
+    free(vertex_score);
+    free(cache_pos);
+    free(adjacency);
+    free(remaining);
+    free(offsets);
+}
+
+// ================ OVERDRAW ================
+
+struct _overdraw_cluster {
+    uint32_t start, count;
+    float sort_key;
+};
+
+// outward facing first, qsort isn't stable so ties keep the cache order through the start index
+static inline int _overdraw_cluster_comparator(const void* a, const void* b) {
+    const struct _overdraw_cluster* ca = a;
+    const struct _overdraw_cluster* cb = b;
+    if (ca->sort_key != cb->sort_key)
+        return (ca->sort_key < cb->sort_key) - (ca->sort_key > cb->sort_key);
+
+    return (ca->start > cb->start) - (ca->start < cb->start);
+}
+
+static inline vec3 _overdraw_position(const float* positions, uint32_t stride, uint32_t v) {
+    const float* p = (const float*)((const char*)positions + (size_t)v * stride);
+    return (vec3){p[0], p[1], p[2]};
+}
+
+// Must run after mesh_optimize_vertex_cache. The triangle list is cut into clusters wherever the
+// simulated cache misses all three vertices of a triangle, i.e. where the cache order starts over
+// anyway, so moving clusters around costs (almost) no cache efficiency. Clusters are then drawn
+// in order of how far out they face from the mesh centroid, which tends to put occluders first.
+// positions points at the first vertex position, stride is the vertex size in bytes.
+static inline void mesh_optimize_overdraw(uint32_t* indices,
+                                          uint32_t index_count,
+                                          const float* positions,
+                                          uint32_t stride,
+                                          uint32_t vertex_count) {
+    uint32_t tri_count = index_count / 3;
+    if (tri_count < 2)
+        return;
+
+    uint32_t* entered = calloc(vertex_count, sizeof(uint32_t));
+    struct _overdraw_cluster* clusters = malloc(tri_count * sizeof(struct _overdraw_cluster));
+    if (!entered || !clusters)
+        panic("mesh_optimize_overdraw: failed to allocate memory");
+
+    uint32_t cluster_count = 0;
+    uint32_t time = MESH_CACHE_SIZE + 1;
+    for (uint32_t t = 0; t < tri_count; t++) {
+        uint32_t misses = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k];
+            if (time - entered[v] > MESH_CACHE_SIZE) {
+                entered[v] = time++;
+                misses++;
+            }
+        }
+
+        if (t == 0 || misses == 3)
+            clusters[cluster_count++] = (struct _overdraw_cluster){.start = t};
+        clusters[cluster_count - 1].count++;
+    }
+
+    vec3 mesh_centroid = {0};
+    for (uint32_t i = 0; i < index_count; i++)
+        mesh_centroid = vec3_add(mesh_centroid, _overdraw_position(positions, stride, indices[i]));
+    mesh_centroid = vec3_scale(mesh_centroid, 1.0f / index_count);
+
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        vec3 centroid = {0}, normal = {0};
+        float area = 0;
+
+        for (uint32_t t = clusters[c].start; t < clusters[c].start + clusters[c].count; t++) {
+            vec3 a = _overdraw_position(positions, stride, indices[t * 3]);
+            vec3 b = _overdraw_position(positions, stride, indices[t * 3 + 1]);
+            vec3 d = _overdraw_position(positions, stride, indices[t * 3 + 2]);
+
+            // area weighted, the cross product length is twice the triangle area
+            vec3 n = vec3_cross(vec3_sub(b, a), vec3_sub(d, a));
+            float w = vec3_len(n);
+
+            centroid = vec3_add(centroid, vec3_scale(vec3_add(vec3_add(a, b), d), w / 3));
+            normal = vec3_add(normal, n);
+            area += w;
+        }
+
+        float len = vec3_len(normal);
+        if (area > 0 && len > 0) {
+            centroid = vec3_scale(centroid, 1 / area);
+            normal = vec3_scale(normal, 1 / len);
+            clusters[c].sort_key = vec3_dot(vec3_sub(centroid, mesh_centroid), normal);
+        } else {
+            clusters[c].sort_key = 0;
+        }
+    }
+
+    qsort(clusters, cluster_count, sizeof(struct _overdraw_cluster), _overdraw_cluster_comparator);
+
+    uint32_t* out = malloc(index_count * sizeof(uint32_t));
+    if (!out)
+        panic("mesh_optimize_overdraw: failed to allocate memory");
+
+    uint32_t k = 0;
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        memcpy(&out[k], &indices[clusters[c].start * 3], clusters[c].count * 3 * sizeof(uint32_t));
+        k += clusters[c].count * 3;
+    }
+    memcpy(indices, out, k * sizeof(uint32_t));
+
+    free(out);
+    free(clusters);
+    free(entered);
+}
+
+// ================ VERTEX FETCH ================
+
+// Returns the new vertex count, which is smaller than vertex_count if some vertices were unused.
+static inline uint32_t mesh_optimize_vertex_fetch(void* vertices,
+                                                  uint32_t vertex_size,
+                                                  uint32_t vertex_count,
+                                                  uint32_t* indices,
+                                                  uint32_t index_count) {
+    uint32_t* remap = malloc(vertex_count * sizeof(uint32_t));
+    char* copy = malloc((size_t)vertex_count * vertex_size);
+    if (!remap || !copy)
+        panic("mesh_optimize_vertex_fetch: failed to allocate memory");
+
+    memset(remap, 0xFF, vertex_count * sizeof(uint32_t));
+    memcpy(copy, vertices, (size_t)vertex_count * vertex_size);
+
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX) {
+            remap[v] = next;
+            memcpy((char*)vertices + (size_t)next * vertex_size, copy + (size_t)v * vertex_size,
+                   vertex_size);
+            next++;
+        }
+        indices[i] = remap[v];
+    }
+
+    free(copy);
+    free(remap);
+
+    return next;
+}
+
+// ================ SIMPLIFICATION ================
+
+// symmetric 4x4 quadric (Garland-Heckbert) and the total weight that went into it
+struct _quadric {
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double weight;
+};
+
+static inline void _quadric_add_plane(struct _quadric* q, vec3 n, double d, double weight) {
+    q->a2 += weight * n.x * n.x;
+    q->ab += weight * n.x * n.y;
+    q->ac += weight * n.x * n.z;
+    q->ad += weight * n.x * d;
+    q->b2 += weight * n.y * n.y;
+    q->bc += weight * n.y * n.z;
+    q->bd += weight * n.y * d;
+    q->c2 += weight * n.z * n.z;
+    q->cd += weight * n.z * d;
+    q->d2 += weight * d * d;
+    q->weight += weight;
+}
+
+static inline void _quadric_add(struct _quadric* q, const struct _quadric* r) {
+    q->a2 += r->a2;
+    q->ab += r->ab;
+    q->ac += r->ac;
+    q->ad += r->ad;
+    q->b2 += r->b2;
+    q->bc += r->bc;
+    q->bd += r->bd;
+    q->c2 += r->c2;
+    q->cd += r->cd;
+    q->d2 += r->d2;
+    q->weight += r->weight;
+}
+
+// weighted mean squared distance of p to the planes, as a distance
+static inline double _quadric_error(const struct _quadric* q, vec3 p) {
+    double x = p.x, y = p.y, z = p.z;
+    double e = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z +
+               2 * (q->ab * x * y + q->ac * x * z + q->bc * y * z) +
+               2 * (q->ad * x + q->bd * y + q->cd * z) + q->d2;
+
+    return q->weight > 0 ? sqrt(fabs(e) / q->weight) : 0;
+}
+
+struct _simplify_position {
+    float x, y, z;
+    uint32_t id;
+};
+
+static inline int _simplify_position_comparator(const void* a, const void* b) {
+    const struct _simplify_position* p = a;
+    const struct _simplify_position* q = b;
+    if (p->x != q->x)
+        return p->x < q->x ? -1 : 1;
+    if (p->y != q->y)
+        return p->y < q->y ? -1 : 1;
+    if (p->z != q->z)
+        return p->z < q->z ? -1 : 1;
+    return (p->id > q->id) - (p->id < q->id);
+}
+
+static inline int _simplify_u64_comparator(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+struct _simplify_collapse {
+    uint32_t from, to;
+    double error;
+};
+
+static inline int _simplify_collapse_comparator(const void* a, const void* b) {
+    double x = ((const struct _simplify_collapse*)a)->error;
+    double y = ((const struct _simplify_collapse*)b)->error;
+    return (x > y) - (x < y);
+}
+
+// Vertices that must stay where they are: open borders, and seams where several vertices share a
+// position (uv or normal splits), moving one side alone would tear the surface apart.
+static inline uint8_t* _simplify_locked(const uint32_t* indices,
+                                        uint32_t index_count,
+                                        const float* positions,
+                                        uint32_t stride,
+                                        uint32_t vertex_count) {
+    struct _simplify_position* sorted = malloc(vertex_count * sizeof(struct _simplify_position));
+    uint32_t* canonical = malloc(vertex_count * sizeof(uint32_t));
+    uint64_t* edges = malloc(index_count * sizeof(uint64_t));
+    uint8_t* locked = calloc(vertex_count, 1);
+    uint8_t* border = calloc(vertex_count, 1);
+    if (!sorted || !canonical || !edges || !locked || !border)
+        panic("mesh_simplify: failed to allocate memory");
+
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        const float* p = (const float*)((const char*)positions + (size_t)v * stride);
+        sorted[v] = (struct _simplify_position){p[0], p[1], p[2], v};
+    }
+    qsort(sorted, vertex_count, sizeof(*sorted), _simplify_position_comparator);
+
+    for (uint32_t i = 0; i < vertex_count;) {
+        uint32_t j = i + 1;
+        while (j < vertex_count && sorted[j].x == sorted[i].x && sorted[j].y == sorted[i].y &&
+               sorted[j].z == sorted[i].z)
+            j++;
+
+        for (uint32_t k = i; k < j; k++) {
+            canonical[sorted[k].id] = sorted[i].id;
+            locked[sorted[k].id] = j - i > 1;
+        }
+        i = j;
+    }
+
+    // an edge of the welded surface used by a single triangle is on a border
+    for (uint32_t t = 0; t < index_count / 3; t++)
+        for (uint32_t k = 0; k < 3; k++) {
+            uint64_t a = canonical[indices[t * 3 + k]];
+            uint64_t b = canonical[indices[t * 3 + (k + 1) % 3]];
+            edges[t * 3 + k] = a < b ? a << 32 | b : b << 32 | a;
+        }
+    qsort(edges, index_count, sizeof(uint64_t), _simplify_u64_comparator);
+
+    for (uint32_t i = 0; i < index_count;) {
+        uint32_t j = i + 1;
+        while (j < index_count && edges[j] == edges[i])
+            j++;
+
+        if (j - i == 1) {
+            border[edges[i] >> 32] = 1;
+            border[edges[i] & 0xFFFFFFFF] = 1;
+        }
+        i = j;
+    }
+
+    for (uint32_t v = 0; v < vertex_count; v++)
+        locked[v] |= border[canonical[v]];
+
+    free(border);
+    free(edges);
+    free(canonical);
+    free(sorted);
+
+    return locked;
+}
+
+// Simplifies the triangle list by collapsing vertices onto their neighbours in order of quadric
+// error, until at most target_index_count indices are left or no collapse stays within
+// max_error. The vertices are not changed, so the result indexes the same vertex buffer and can
+// serve as a LOD. Writes the new indices to out (room for index_count), returns their count and
+// stores the largest collapse error, a distance in mesh units, in error if it isn't null.
+static inline uint32_t mesh_simplify(uint32_t* out,
+                                     const uint32_t* indices,
+                                     uint32_t index_count,
+                                     const float* positions,
+                                     uint32_t stride,
+                                     uint32_t vertex_count,
+                                     uint32_t target_index_count,
+                                     float max_error,
+                                     float* error) {
+    memcpy(out, indices, index_count * sizeof(uint32_t));
+    if (error)
+        *error = 0;
+
+    if (index_count < 6 || target_index_count >= index_count)
+        return index_count;
+
+#define POSITION(v) _overdraw_position(positions, stride, v)
+
+    struct _quadric* quadrics = calloc(vertex_count, sizeof(struct _quadric));
+    uint8_t* locked = _simplify_locked(indices, index_count, positions, stride, vertex_count);
+    uint32_t* remap = malloc(vertex_count * sizeof(uint32_t));
+    uint8_t* touched = malloc(vertex_count);
+    uint32_t* offsets = malloc((vertex_count + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = malloc(index_count * sizeof(uint32_t));
+    struct _simplify_collapse* collapses = malloc(index_count * 2 * sizeof(*collapses));
+    if (!quadrics || !remap || !touched || !offsets || !adjacency || !collapses)
+        panic("mesh_simplify: failed to allocate memory");
+
+    for (uint32_t t = 0; t < index_count / 3; t++) {
+        uint32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+        vec3 pa = POSITION(a);
+        vec3 n = vec3_cross(vec3_sub(POSITION(b), pa), vec3_sub(POSITION(c), pa));
+        float area = vec3_len(n);
+        if (area == 0)
+            continue;
+
+        n = vec3_scale(n, 1 / area);
+        double d = -vec3_dot(n, pa);
+        for (uint32_t k = 0; k < 3; k++)
+            _quadric_add_plane(&quadrics[indices[t * 3 + k]], n, d, area);
+    }
+
+    float worst = 0;
+    uint32_t count = index_count;
+
+    for (uint32_t pass = 0; pass < 100 && count > target_index_count; pass++) {
+        uint32_t tri_count = count / 3;
+
+        memset(offsets, 0, (vertex_count + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < count; i++)
+            offsets[out[i] + 1]++;
+        for (uint32_t v = 0; v < vertex_count; v++)
+            offsets[v + 1] += offsets[v];
+        for (uint32_t t = 0; t < tri_count; t++)
+            for (uint32_t k = 0; k < 3; k++)
+                adjacency[offsets[out[t * 3 + k]]++] = t;
+        for (uint32_t v = vertex_count; v > 0; v--)
+            offsets[v] = offsets[v - 1];
+        offsets[0] = 0;
+
+        uint32_t collapse_count = 0;
+        for (uint32_t t = 0; t < tri_count; t++)
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t a = out[t * 3 + k], b = out[t * 3 + (k + 1) % 3];
+                for (uint32_t dir = 0; dir < 2; dir++) {
+                    uint32_t from = dir ? b : a, to = dir ? a : b;
+                    if (locked[from])
+                        continue;
+
+                    struct _quadric q = quadrics[from];
+                    _quadric_add(&q, &quadrics[to]);
+                    collapses[collapse_count++] =
+                        (struct _simplify_collapse){from, to, _quadric_error(&q, POSITION(to))};
+                }
+            }
+        qsort(collapses, collapse_count, sizeof(*collapses), _simplify_collapse_comparator);
+
+        for (uint32_t v = 0; v < vertex_count; v++)
+            remap[v] = v;
+        memset(touched, 0, vertex_count);
+
+        uint32_t removed = 0, collapsed = 0;
+        uint32_t to_remove = (count - target_index_count + 2) / 3;
+        for (uint32_t i = 0; i < collapse_count && removed < to_remove; i++) {
+            struct _simplify_collapse c = collapses[i];
+            if (c.error > max_error)
+                break;
+            if (touched[c.from] || touched[c.to])
+                continue;
+
+            // reject collapses that flip a remaining triangle around from
+            vec3 target = POSITION(c.to);
+            uint32_t shared = 0, flips = 0;
+            for (uint32_t j = offsets[c.from]; j < offsets[c.from + 1]; j++) {
+                const uint32_t* tri = &out[adjacency[j] * 3];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                    shared++;
+                    continue;
+                }
+
+                vec3 p[3], q[3];
+                for (uint32_t k = 0; k < 3; k++) {
+                    p[k] = POSITION(tri[k]);
+                    q[k] = tri[k] == c.from ? target : p[k];
+                }
+
+                vec3 n0 = vec3_cross(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+                vec3 n1 = vec3_cross(vec3_sub(q[1], q[0]), vec3_sub(q[2], q[0]));
+                if (vec3_dot(n0, n1) <= 0.25f * vec3_len(n0) * vec3_len(n1))
+                    flips++;
+            }
+
+            if (flips)
+                continue;
+
+            // the whole neighbourhood stays put for the rest of the pass, the flip test above
+            // assumed it doesn't move
+            remap[c.from] = c.to;
+            for (uint32_t j = offsets[c.from]; j < offsets[c.from + 1]; j++)
+                for (uint32_t k = 0; k < 3; k++)
+                    touched[out[adjacency[j] * 3 + k]] = 1;
+            _quadric_add(&quadrics[c.to], &quadrics[c.from]);
+
+            removed += shared;
+            collapsed++;
+            if (c.error > worst)
+                worst = c.error;
+        }
+
+        if (collapsed == 0)
+            break;
+
+        uint32_t k = 0;
+        for (uint32_t t = 0; t < tri_count; t++) {
+            uint32_t a = remap[out[t * 3]], b = remap[out[t * 3 + 1]], c = remap[out[t * 3 + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+
+            out[k++] = a;
+            out[k++] = b;
+            out[k++] = c;
+        }
+        count = k;
+    }
+
+#undef POSITION
+
+    free(collapses);
+    free(adjacency);
+    free(offsets);
+    free(touched);
+    free(remap);
+    free(locked);
+    free(quadrics);
+
+    if (error)
+        *error = worst;
+
+    return count;
+}
+
+// ================ LEVELS OF DETAIL ================
+
+#define MESH_MAX_LODS 4
+
+// A simplified index range over the mesh's full vertex buffer
+struct mesh_lod {
+    uint32_t first_index;  // relative to the mesh's indices
+    uint32_t index_count;
+    float error;  // how far the surface may be off from the full mesh, in local units
+};
+
+// Fills lods[0] with the index_count indices already in indices and appends up to lod_count - 1
+// simplified ranges after them, each aiming for reduction times the triangles of the one before.
+// indices needs room for index_count * lod_count. Levels that barely simplify are left out.
+// Returns the number of levels including the full one.
+static inline uint32_t mesh_generate_lod_indices(struct mesh_lod* lods,
+                                                 uint32_t lod_count,
+                                                 uint32_t* indices,
+                                                 uint32_t index_count,
+                                                 const float* positions,
+                                                 uint32_t stride,
+                                                 uint32_t vertex_count,
+                                                 float reduction) {
+    if (lod_count > MESH_MAX_LODS)
+        lod_count = MESH_MAX_LODS;
+
+    lods[0] = (struct mesh_lod){0, index_count, 0};
+    uint32_t count = 1;
+
+    if (lod_count < 2 || index_count < 6)
+        return count;
+
+    while (count < lod_count) {
+        struct mesh_lod prev = lods[count - 1];
+        uint32_t first = prev.first_index + prev.index_count;
+        uint32_t target = (uint32_t)(prev.index_count / 3 * reduction) * 3;
+
+        float error;
+        uint32_t simplified =
+            mesh_simplify(&indices[first], &indices[prev.first_index], prev.index_count, positions,
+                          stride, vertex_count, target, FLT_MAX, &error);
+
+        // not worth a level, and the coarser ones would fare no better
+        if (simplified == 0 || simplified > prev.index_count - prev.index_count / 8)
+            break;
+
+        mesh_optimize_vertex_cache(&indices[first], simplified, vertex_count);
+
+        // each level is simplified from the previous one, so the errors add up
+        lods[count++] = (struct mesh_lod){first, simplified, prev.error + error};
+    }
+
+    return count;
+}
+
+// Picks the coarsest level whose error stays below one unit once scaled by error_scale / depth,
+// for a perspective projection error_scale is the pixels per unit at depth 1 divided by the
+// tolerated error in pixels. depth is the distance to the closest point of the mesh.
+static inline uint32_t mesh_lod_select(const struct mesh_lod* lods,
+                                       uint32_t lod_count,
+                                       float depth,
+                                       float error_scale) {
+    uint32_t lod = 0;
+    if (depth > 0)
+        while (lod + 1 < lod_count && lods[lod + 1].error * error_scale <= depth)
+            lod++;
+
+    return lod;
+}
+
+// ================ SPLITTING ================
+
+// A run of consecutive triangles referencing at most the max_vertices of mesh_split_indices
+struct mesh_part {
+    uint32_t first_index, index_count;    // into the part local indices
+    uint32_t first_vertex, vertex_count;  // into the vertex map
+};
+
+// Cuts the triangle list into parts of at most max_vertices vertices each, keeping the triangle
+// order. Writes the indices renumbered per part to part_indices and each part's source vertices,
+// in their new order, to vertex_map. Both need room for index_count. The parts are pushed to out
+// (a vector of struct mesh_part), returns their number.
+static inline uint32_t mesh_split_indices(uint32_t* part_indices,
+                                          uint32_t* vertex_map,
+                                          const uint32_t* indices,
+                                          uint32_t index_count,
+                                          uint32_t vertex_count,
+                                          uint32_t max_vertices,
+                                          struct vector* out) {
+    if (index_count == 0 || max_vertices < 3)
+        return 0;
+
+    uint32_t* remap = malloc(vertex_count * sizeof(uint32_t));
+    if (!remap)
+        panic("mesh_split_indices: failed to allocate memory");
+
+    memset(remap, 0xFF, vertex_count * sizeof(uint32_t));
+
+    uint32_t parts = 0;
+    struct mesh_part part = {0};
+    for (uint32_t t = 0; t <= index_count / 3; t++) {
+        uint32_t added = 0;
+        if (t < index_count / 3)
+            for (uint32_t k = 0; k < 3; k++)
+                added += remap[indices[t * 3 + k]] == UINT32_MAX;
+
+        // close the current part when the triangle doesn't fit or at the end
+        if (t == index_count / 3 || part.vertex_count + added > max_vertices) {
+            vec_push(out, &part);
+            parts++;
+
+            for (uint32_t i = 0; i < part.vertex_count; i++)
+                remap[vertex_map[part.first_vertex + i]] = UINT32_MAX;
+
+            part = (struct mesh_part){
+                .first_index = part.first_index + part.index_count,
+                .first_vertex = part.first_vertex + part.vertex_count,
+            };
+
+            if (t == index_count / 3)
+                break;
+        }
+
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k];
+            if (remap[v] == UINT32_MAX) {
+                remap[v] = part.vertex_count;
+                vertex_map[part.first_vertex + part.vertex_count++] = v;
+            }
+            part_indices[part.first_index + part.index_count++] = remap[v];
+        }
+    }
+
+    free(remap);
+
+    return parts;
+}
+
+#endif
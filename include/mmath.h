@@ -2,8 +2,19 @@
 #define MMATH_H
 
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 
+// define MMATH_NO_SIMD to force the scalar kernels
+#if defined(MMATH_NO_SIMD)
+#elif defined(__SSE__)
+#include <immintrin.h>
+#define MMATH_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MMATH_NEON
+#endif
+
 static inline float radians(float degrees) {
     return degrees * acos(-1.) / 180.;
 }
@@ -34,6 +45,15 @@ typedef struct vec4 {
     float x, y, z, w;
 } vec4;
 
+typedef struct aabb {
+    vec3 min, max;
+} aabb;
+
+typedef struct sphere {
+    vec3 center;
+    float radius;
+} sphere;
+
 typedef struct mat3 {
     struct vec3 x, y, z;
 } mat3;
@@ -82,11 +102,19 @@ static inline vec3 vec3_sub(vec3 a, vec3 b) {
     };
 }
 
+static inline float vec3_len(vec3 v) {
+    return sqrt((v.x * v.x) + (v.y * v.y) + (v.z * v.z));
+}
+
 static inline vec3 vec3_norm(vec3 v) {
-    float len = sqrt((v.x * v.x) + (v.y * v.y) + (v.z * v.z));
+    float len = vec3_len(v);
     return (vec3){v.x / len, v.y / len, v.z / len};
 }
 
+static inline float vec3_dot(vec3 a, vec3 b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
 static inline vec3 vec3_cross(vec3 a, vec3 b) {
     return (vec3){
         a.y * b.z - a.z * b.y,
@@ -131,7 +159,14 @@ static inline vec4 vec4_sub(vec4 a, vec4 b) {
         .x = a.x - b.x,
         .y = a.y - b.y,
         .z = a.z - b.z,
-        .w = a.w + b.w,
+        .w = a.w - b.w,
+    };
+}
+
+static inline aabb aabb_merge(aabb a, aabb b) {
+    return (aabb){
+        {fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y), fminf(a.min.z, b.min.z)},
+        {fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y), fmaxf(a.max.z, b.max.z)},
     };
 }
 
@@ -243,7 +278,22 @@ static inline mat4 perspective(float fov, float aspect_ratio, float near, float
     return m;
 }
 
-static inline mat4 mat4_mul(mat4 a, mat4 b) {
+// Reverse-z projection with the far plane at infinity, for a [0, 1] clip depth range. Depth is 1
+// at near and falls towards 0 with distance, which together with the exponent of a float depth
+// buffer spreads the precision evenly instead of spending it all close to the near plane.
+static inline mat4 perspective_reverse_z(float fov, float aspect_ratio, float near) {
+    float f = 1 / tan(radians(fov / 2));
+
+    mat4 m = mat4_new(0.);
+    m.x.x = f / aspect_ratio;
+    m.y.y = f;
+    m.z.w = -1;
+    m.w.z = near;
+
+    return m;
+}
+
+static inline mat4 mat4_mul_scalar(mat4 a, mat4 b) {
     return (mat4){
         {
             a.x.x * b.x.x + a.y.x * b.x.y + a.z.x * b.x.z + a.w.x * b.x.w,
@@ -272,16 +322,236 @@ static inline mat4 mat4_mul(mat4 a, mat4 b) {
     };
 }
 
+static inline vec4 mat4_apply_scalar(mat4 m, vec4 v) {
+    return (vec4){
+        .x = m.x.x * v.x + m.y.x * v.y + m.z.x * v.z + m.w.x * v.w,
+        .y = m.x.y * v.x + m.y.y * v.y + m.z.y * v.z + m.w.y * v.w,
+        .z = m.x.z * v.x + m.y.z * v.y + m.z.z * v.z + m.w.z * v.w,
+        .w = m.x.w * v.x + m.y.w * v.y + m.z.w * v.z + m.w.w * v.w,
+    };
+}
+
+#if defined(MMATH_SSE)
+
+static inline __m128 _mat4_apply_sse(__m128 c0, __m128 c1, __m128 c2, __m128 c3, __m128 v) {
+    __m128 r0 = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(v, v, 0x00)),
+                           _mm_mul_ps(c1, _mm_shuffle_ps(v, v, 0x55)));
+    __m128 r1 = _mm_add_ps(_mm_mul_ps(c2, _mm_shuffle_ps(v, v, 0xAA)),
+                           _mm_mul_ps(c3, _mm_shuffle_ps(v, v, 0xFF)));
+    return _mm_add_ps(r0, r1);
+}
+
+// same as _mat4_apply_sse, but reads v from a by-value struct so the compiler can keep it in
+// registers instead of bouncing it through memory
+static inline __m128 _mat4_column_sse(__m128 c0, __m128 c1, __m128 c2, __m128 c3, vec4 v) {
+    __m128 r0 = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.x)), _mm_mul_ps(c1, _mm_set1_ps(v.y)));
+    __m128 r1 = _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v.z)), _mm_mul_ps(c3, _mm_set1_ps(v.w)));
+    return _mm_add_ps(r0, r1);
+}
+
+#if defined(__AVX__)
+
+// two columns of the result per iteration, the columns of a are broadcast to both lanes
+static inline __m256 _mat4_apply_avx(__m256 c0, __m256 c1, __m256 c2, __m256 c3, __m256 v) {
+    __m256 r0 = _mm256_add_ps(_mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00)),
+                              _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+    __m256 r1 = _mm256_add_ps(_mm256_mul_ps(c2, _mm256_permute_ps(v, 0xAA)),
+                              _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xFF)));
+    return _mm256_add_ps(r0, r1);
+}
+
+#endif
+
+#elif defined(MMATH_NEON)
+
+static inline float32x4_t _mat4_apply_neon(float32x4_t c0,
+                                           float32x4_t c1,
+                                           float32x4_t c2,
+                                           float32x4_t c3,
+                                           float32x4_t v) {
+    float32x4_t r = vmulq_laneq_f32(c0, v, 0);
+    r = vfmaq_laneq_f32(r, c1, v, 1);
+    r = vfmaq_laneq_f32(r, c2, v, 2);
+    r = vfmaq_laneq_f32(r, c3, v, 3);
+    return r;
+}
+
+#endif
+
+static inline void mat4_mul_ptr(const mat4* a, const mat4* b, mat4* out) {
+#if defined(MMATH_SSE) && defined(__AVX__)
+    __m256 a0 = _mm256_broadcast_ps((const __m128*)&a->x);
+    __m256 a1 = _mm256_broadcast_ps((const __m128*)&a->y);
+    __m256 a2 = _mm256_broadcast_ps((const __m128*)&a->z);
+    __m256 a3 = _mm256_broadcast_ps((const __m128*)&a->w);
+
+    __m256 b01 = _mm256_loadu_ps(&b->x.x);
+    __m256 b23 = _mm256_loadu_ps(&b->z.x);
+
+    _mm256_storeu_ps(&out->x.x, _mat4_apply_avx(a0, a1, a2, a3, b01));
+    _mm256_storeu_ps(&out->z.x, _mat4_apply_avx(a0, a1, a2, a3, b23));
+#elif defined(MMATH_SSE)
+    __m128 a0 = _mm_loadu_ps(&a->x.x);
+    __m128 a1 = _mm_loadu_ps(&a->y.x);
+    __m128 a2 = _mm_loadu_ps(&a->z.x);
+    __m128 a3 = _mm_loadu_ps(&a->w.x);
+
+    __m128 b0 = _mm_loadu_ps(&b->x.x);
+    __m128 b1 = _mm_loadu_ps(&b->y.x);
+    __m128 b2 = _mm_loadu_ps(&b->z.x);
+    __m128 b3 = _mm_loadu_ps(&b->w.x);
+
+    _mm_storeu_ps(&out->x.x, _mat4_apply_sse(a0, a1, a2, a3, b0));
+    _mm_storeu_ps(&out->y.x, _mat4_apply_sse(a0, a1, a2, a3, b1));
+    _mm_storeu_ps(&out->z.x, _mat4_apply_sse(a0, a1, a2, a3, b2));
+    _mm_storeu_ps(&out->w.x, _mat4_apply_sse(a0, a1, a2, a3, b3));
+#elif defined(MMATH_NEON)
+    float32x4_t a0 = vld1q_f32(&a->x.x);
+    float32x4_t a1 = vld1q_f32(&a->y.x);
+    float32x4_t a2 = vld1q_f32(&a->z.x);
+    float32x4_t a3 = vld1q_f32(&a->w.x);
+
+    float32x4_t b0 = vld1q_f32(&b->x.x);
+    float32x4_t b1 = vld1q_f32(&b->y.x);
+    float32x4_t b2 = vld1q_f32(&b->z.x);
+    float32x4_t b3 = vld1q_f32(&b->w.x);
+
+    vst1q_f32(&out->x.x, _mat4_apply_neon(a0, a1, a2, a3, b0));
+    vst1q_f32(&out->y.x, _mat4_apply_neon(a0, a1, a2, a3, b1));
+    vst1q_f32(&out->z.x, _mat4_apply_neon(a0, a1, a2, a3, b2));
+    vst1q_f32(&out->w.x, _mat4_apply_neon(a0, a1, a2, a3, b3));
+#else
+    *out = mat4_mul_scalar(*a, *b);
+#endif
+}
+
+static inline mat4 mat4_mul(mat4 a, mat4 b) {
+    mat4 out;
+#if defined(MMATH_SSE)
+    __m128 a0 = _mm_loadu_ps(&a.x.x);
+    __m128 a1 = _mm_loadu_ps(&a.y.x);
+    __m128 a2 = _mm_loadu_ps(&a.z.x);
+    __m128 a3 = _mm_loadu_ps(&a.w.x);
+
+    _mm_storeu_ps(&out.x.x, _mat4_column_sse(a0, a1, a2, a3, b.x));
+    _mm_storeu_ps(&out.y.x, _mat4_column_sse(a0, a1, a2, a3, b.y));
+    _mm_storeu_ps(&out.z.x, _mat4_column_sse(a0, a1, a2, a3, b.z));
+    _mm_storeu_ps(&out.w.x, _mat4_column_sse(a0, a1, a2, a3, b.w));
+#else
+    mat4_mul_ptr(&a, &b, &out);
+#endif
+    return out;
+}
+
 static inline void mat4_comp(mat4* transform, mat4 m) {
-    *transform = mat4_mul(m, *transform);
+    mat4_mul_ptr(&m, transform, transform);
 };
 
 static inline vec4 mat4_apply(mat4 m, vec4 v) {
-    return (vec4){
-        .x = v.x * m.x.x + v.y * m.x.y + v.z * m.x.z + v.w * m.x.w,
-        .y = v.x * m.y.x + v.y * m.y.y + v.z * m.y.z + v.w * m.y.w,
-        .z = v.x * m.z.x + v.y * m.z.y + v.z * m.z.z + v.w * m.z.w,
-        .w = v.x * m.w.x + v.y * m.w.y + v.z * m.w.z + v.w * m.w.w,
+#if defined(MMATH_SSE)
+    vec4 out;
+    _mm_storeu_ps(&out.x, _mat4_apply_sse(_mm_loadu_ps(&m.x.x), _mm_loadu_ps(&m.y.x),
+                                          _mm_loadu_ps(&m.z.x), _mm_loadu_ps(&m.w.x),
+                                          _mm_loadu_ps(&v.x)));
+    return out;
+#elif defined(MMATH_NEON)
+    vec4 out;
+    vst1q_f32(&out.x, _mat4_apply_neon(vld1q_f32(&m.x.x), vld1q_f32(&m.y.x), vld1q_f32(&m.z.x),
+                                       vld1q_f32(&m.w.x), vld1q_f32(&v.x)));
+    return out;
+#else
+    return mat4_apply_scalar(m, v);
+#endif
+}
+
+// out[i] = a * b[i]
+static inline void mat4_mul_many(mat4 a, const mat4* b, mat4* out, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++)
+        mat4_mul_ptr(&a, &b[i], &out[i]);
+}
+
+// Transforms points (w = 1) by an affine matrix, the projective divide is skipped.
+static inline void transform_points(mat4 m, const vec3* in, vec3* out, uint32_t count) {
+#if defined(MMATH_SSE)
+    __m128 c0 = _mm_loadu_ps(&m.x.x);
+    __m128 c1 = _mm_loadu_ps(&m.y.x);
+    __m128 c2 = _mm_loadu_ps(&m.z.x);
+    __m128 c3 = _mm_loadu_ps(&m.w.x);
+
+    for (uint32_t i = 0; i < count; i++) {
+        __m128 r = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(in[i].x)));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(in[i].y)));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[i].z)));
+
+        float tmp[4];
+        _mm_storeu_ps(tmp, r);
+        out[i] = (vec3){tmp[0], tmp[1], tmp[2]};
+    }
+#elif defined(MMATH_NEON)
+    float32x4_t c0 = vld1q_f32(&m.x.x);
+    float32x4_t c1 = vld1q_f32(&m.y.x);
+    float32x4_t c2 = vld1q_f32(&m.z.x);
+    float32x4_t c3 = vld1q_f32(&m.w.x);
+
+    for (uint32_t i = 0; i < count; i++) {
+        float32x4_t r = vfmaq_n_f32(c3, c0, in[i].x);
+        r = vfmaq_n_f32(r, c1, in[i].y);
+        r = vfmaq_n_f32(r, c2, in[i].z);
+
+        float tmp[4];
+        vst1q_f32(tmp, r);
+        out[i] = (vec3){tmp[0], tmp[1], tmp[2]};
+    }
+#else
+    for (uint32_t i = 0; i < count; i++) {
+        vec4 r = mat4_apply_scalar(m, vec4_hom(in[i]));
+        out[i] = (vec3){r.x, r.y, r.z};
+    }
+#endif
+}
+
+// Inverse of a matrix whose last row is (0, 0, 0, 1), i.e. any combination of translate, rotate
+// and (possibly non uniform) scale. The 3x3 part is inverted through cross products of its
+// columns instead of a general 4x4 cofactor expansion.
+static inline mat4 mat4_inverse_affine(mat4 m) {
+    vec3 c0 = {m.x.x, m.x.y, m.x.z};
+    vec3 c1 = {m.y.x, m.y.y, m.y.z};
+    vec3 c2 = {m.z.x, m.z.y, m.z.z};
+    vec3 t = {m.w.x, m.w.y, m.w.z};
+
+    vec3 r0 = vec3_cross(c1, c2);
+    vec3 r1 = vec3_cross(c2, c0);
+    vec3 r2 = vec3_cross(c0, c1);
+
+    float inv_det = 1. / vec3_dot(c0, r0);
+    r0 = vec3_scale(r0, inv_det);
+    r1 = vec3_scale(r1, inv_det);
+    r2 = vec3_scale(r2, inv_det);
+
+    return (mat4){
+        {r0.x, r1.x, r2.x, 0},
+        {r0.y, r1.y, r2.y, 0},
+        {r0.z, r1.z, r2.z, 0},
+        {-vec3_dot(r0, t), -vec3_dot(r1, t), -vec3_dot(r2, t), 1},
+    };
+}
+
+// transpose(inverse(mat3(m))), the matrix that carries normals through the model transform
+static inline mat3 mat4_normal_matrix(mat4 m) {
+    vec3 c0 = {m.x.x, m.x.y, m.x.z};
+    vec3 c1 = {m.y.x, m.y.y, m.y.z};
+    vec3 c2 = {m.z.x, m.z.y, m.z.z};
+
+    vec3 r0 = vec3_cross(c1, c2);
+    vec3 r1 = vec3_cross(c2, c0);
+    vec3 r2 = vec3_cross(c0, c1);
+
+    float inv_det = 1. / vec3_dot(c0, r0);
+
+    return (mat3){
+        vec3_scale(r0, inv_det),
+        vec3_scale(r1, inv_det),
+        vec3_scale(r2, inv_det),
     };
 }
 
@@ -302,4 +572,102 @@ static inline mat4 look_at(vec3 pos, vec3 target, vec3 up) {
     return mat4_mul(a, b);
 }
 
+// float to IEEE half, round to nearest even, overflow goes to infinity
+static inline uint16_t float_to_half(float value) {
+    union {
+        float f;
+        uint32_t u;
+    } bits = {value};
+
+    uint32_t sign = (bits.u >> 16) & 0x8000;
+    uint32_t abs = bits.u & 0x7FFFFFFF;
+
+    if (abs >= 0x7F800000)  // inf or nan
+        return sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0);
+
+    if (abs >= 0x477FF000)  // rounds to more than the largest half
+        return sign | 0x7C00;
+
+    if (abs < 0x38800000) {  // subnormal half, shift the mantissa into place by hand
+        if (abs < 0x33000000)
+            return sign;
+
+        uint32_t exponent = abs >> 23;
+        uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1)))
+            half++;
+        return sign | half;
+    }
+
+    // rebias the exponent, the rounding carry may bump it which is still correct
+    uint32_t half = (abs - 0x38000000) >> 13;
+    uint32_t rest = abs & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+
+    return sign | half;
+}
+
+static inline float half_to_float(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+
+    union {
+        uint32_t u;
+        float f;
+    } bits;
+
+    if (exponent == 0)
+        return (sign ? -1.0f : 1.0f) * ldexpf(mantissa, -24);
+
+    if (exponent == 31)
+        bits.u = sign | 0x7F800000 | (mantissa << 13);
+    else
+        bits.u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    return bits.f;
+}
+
+// [-1, 1] to a normalized short, as read back by GL with normalized = GL_TRUE
+static inline int16_t float_to_snorm16(float value) {
+    return (int16_t)lrintf(clamp(value, -1, 1) * 32767.0f);
+}
+
+static inline float snorm16_to_float(int16_t value) {
+    return fmaxf(value / 32767.0f, -1.0f);
+}
+
+// Octahedral unit vector encoding: the vector is projected onto the octahedron |x|+|y|+|z| = 1
+// and the lower half is folded over the upper one, giving a point in [-1, 1]^2.
+static inline vec2 oct_encode(vec3 n) {
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 == 0)
+        return (vec2){0, 0};
+
+    vec2 p = {n.x / l1, n.y / l1};
+    if (n.z < 0) {
+        vec2 folded = {
+            (1 - fabsf(p.y)) * (p.x >= 0 ? 1 : -1),
+            (1 - fabsf(p.x)) * (p.y >= 0 ? 1 : -1),
+        };
+        p = folded;
+    }
+
+    return p;
+}
+
+static inline vec3 oct_decode(vec2 e) {
+    vec3 n = {e.x, e.y, 1 - fabsf(e.x) - fabsf(e.y)};
+    float t = fmaxf(-n.z, 0);
+    n.x += n.x >= 0 ? -t : t;
+    n.y += n.y >= 0 ? -t : t;
+
+    return vec3_norm(n);
+}
+
 #endif
@@ -1,10 +1,15 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "frustum.h"
+#include "job.h"
 #include "mesh.h"
+#include "model_cache.h"
 #include "mstring.h"
+#include "render_queue.h"
 #include "shader.h"
 #include "texture.h"
+#include "texture_pack.h"
 #include "util.h"
 #include "vector.h"
 
@@ -12,10 +17,72 @@
 #include "assimp/postprocess.h"
 #include "assimp/scene.h"
 
+// levels of detail generated per mesh on import, each with about half the triangles of the last
+#define MODEL_LOD_COUNT 4
+#define MODEL_LOD_REDUCTION 0.5f
+
+// packed models put textures up to MODEL_ATLAS_MAX_SIZE on shared atlas pages, with only as many
+// mip levels as the padding keeps from bleeding
+#define MODEL_ATLAS_SIZE 1024
+#define MODEL_ATLAS_MAX_SIZE 256
+#define MODEL_ATLAS_PADDING 4
+#define MODEL_ATLAS_LEVELS 3
+
+// for materials without a diffuse or specular map
+#define MODEL_FALLBACK_DIFFUSE ((vec4){0, 0.2, 0.6, 1})
+#define MODEL_FALLBACK_SPECULAR ((vec4){1, 1, 1, 1})
+
+// uniforms set for every material, looked up once per program instead of by name per draw
+struct model_uniforms {
+    GLint diffuse_layer, diffuse_rect;
+    GLint specular_layer, specular_rect;
+    GLint shininess;
+    GLint position_offset, position_scale;
+};
+
 struct model {
     struct string path;
     struct vector meshes;
     struct vector materials;
+
+    // with packed textures every material samples a layer of one of these instead of textures of
+    // its own, see model_load_packed
+    struct vector texture_arrays;  // struct texture_array
+    int packed;
+
+    // every mesh is suballocated from this, so drawing binds a single VAO
+    struct mesh_buffer buffer;
+
+    struct vector bounds;   // aabb of every mesh, packed for the cull pass
+    struct vector visible;  // uint8_t per mesh, filled by the cull pass
+
+    // visible meshes sorted by state, rebuilt every draw
+    struct render_queue queue;
+
+    // program whose material sampler units were last set, they are program state and persist
+    GLuint sampler_program;
+    struct model_uniforms uniforms;  // locations in sampler_program
+
+    // pending multi-draw of consecutive meshes sharing a material
+    struct vector batch_counts;   // GLsizei
+    struct vector batch_offsets;  // const void*
+    struct vector batch_bases;    // GLint
+
+    // meshes submitted and rejected by the last model_draw_culled, and the draw calls it issued
+    uint32_t drawn, culled, draw_calls;
+    uint32_t triangles;
+
+    // picks mesh lods by their projected error, see model_set_lod_scale. 0 draws the full meshes
+    float lod_scale;
+
+    // post-transform cache efficiency of all meshes as imported and after mesh_optimize, only
+    // known when the model was imported rather than loaded from the cache
+    struct mesh_cache_stats cache_before, cache_after;
+
+    // mesh data points into the mapped cache when the model was loaded from it
+    struct model_cache cache;
+    int from_cache;
+    double load_ms;
 };
 
 struct model_mesh {
@@ -23,49 +90,121 @@ struct model_mesh {
     uint32_t material_id;
 };
 
+// A texture's place in the model's texture arrays, uv_rect maps its uvs onto an atlas page
+struct model_texture_slot {
+    uint32_t array, layer;
+    vec4 uv_rect;
+};
+
 struct model_material {
+    const char* name;  // interned
     struct texture diffuse, specular;
     float shininess;
+
+    // set instead of the textures for packed models, which only keep the texture paths
+    struct model_texture_slot diffuse_slot, specular_slot;
 };
 
+static inline void _model_load_material(struct model_material* out,
+                                        const char* name,
+                                        const char* diffuse,
+                                        const char* specular,
+                                        float shininess,
+                                        int packed) {
+    out->name = name ? string_intern(name) : nullptr;
+    out->shininess = shininess;
+
+    // loaded by _model_pack_textures once every material is known
+    if (packed) {
+        out->diffuse.path = diffuse ? string_intern(diffuse) : nullptr;
+        out->specular.path = specular ? string_intern(specular) : nullptr;
+        return;
+    }
+
+    // shared with every other material and model using the same image or fallback
+    if (diffuse)
+        texture_acquire(&out->diffuse, diffuse);
+    else
+        texture_acquire_fallback(&out->diffuse, MODEL_FALLBACK_DIFFUSE);
+
+    if (specular)
+        texture_acquire(&out->specular, specular);
+    else
+        texture_acquire_fallback(&out->specular, MODEL_FALLBACK_SPECULAR);
+}
+
 static inline void _model_process_materials(struct model* mod, const struct aiScene* scene) {
-    struct string path;
-    string_clone(&mod->path, &path);
-    string_pop_until(&path, '/');
+    struct string dir, diffuse, specular;
+    string_clone(&mod->path, &dir);
+    string_pop_until(&dir, '/');
 
     for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
         struct aiMaterial* mat = scene->mMaterials[i];
         struct model_material out = {0};
-        struct aiString tex;
+        struct aiString name, tex;
+        float shininess;
 
-        if (aiGetMaterialTextureCount(mat, aiTextureType_DIFFUSE) > 0) {
+        string_clone(&dir, &diffuse);
+        string_clone(&dir, &specular);
+
+        int has_name = aiGetMaterialString(mat, AI_MATKEY_NAME, &name) == aiReturn_SUCCESS;
+
+        int has_diffuse = aiGetMaterialTextureCount(mat, aiTextureType_DIFFUSE) > 0;
+        if (has_diffuse) {
             aiGetMaterialString(mat, AI_MATKEY_TEXTURE(aiTextureType_DIFFUSE, 0), &tex);
-            string_append(&path, (const char*)&tex.data, tex.length);
-            texture_load_image(&out.diffuse, string_ptr(&path));
-            string_pop(&path, tex.length);
-        } else {
-            texture_create_fallback(&out.diffuse, (vec4){0, 0.2, 0.6, 1});
-        };
+            string_append(&diffuse, (const char*)&tex.data, tex.length);
+        }
 
-        if (aiGetMaterialTextureCount(mat, aiTextureType_SPECULAR) > 0) {
+        int has_specular = aiGetMaterialTextureCount(mat, aiTextureType_SPECULAR) > 0;
+        if (has_specular) {
             aiGetMaterialString(mat, AI_MATKEY_TEXTURE(aiTextureType_SPECULAR, 0), &tex);
-            string_append(&path, (const char*)&tex.data, tex.length);
-            texture_load_image(&out.specular, string_ptr(&path));
-            string_pop(&path, tex.length);
-        } else {
-            texture_create_fallback(&out.specular, (vec4){1, 1, 1, 1});
-        };
+            string_append(&specular, (const char*)&tex.data, tex.length);
+        }
 
-        if (!aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &out.shininess))
-            out.shininess = 16;
+        if (aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &shininess) != aiReturn_SUCCESS)
+            shininess = 16;
+
+        _model_load_material(&out, has_name ? string_intern_n(name.data, name.length) : nullptr,
+                             has_diffuse ? string_ptr(&diffuse) : nullptr,
+                             has_specular ? string_ptr(&specular) : nullptr, shininess,
+                             mod->packed);
 
         vec_push(&mod->materials, &out);
+
+        string_uninit(&specular);
+        string_uninit(&diffuse);
     }
 
-    string_uninit(&path);
+    string_uninit(&dir);
+}
+
+static inline void _model_add_cache_stats(struct mesh_cache_stats* total,
+                                          struct mesh_cache_stats stats) {
+    total->triangles += stats.triangles;
+    total->vertices += stats.vertices;
+    total->misses += stats.misses;
+    total->acmr = total->triangles ? (float)total->misses / total->triangles : 0;
+    total->atvr = total->vertices ? (float)total->misses / total->vertices : 0;
+}
+
+// One assimp mesh converted into meshes ready for upload, more than one if it had to be split
+struct _model_import {
+    struct aiMesh* source;
+    struct vector meshes;  // struct mesh
+    struct mesh_cache_stats before, after;
+};
+
+static inline void _model_add_mesh(struct _model_import* import, struct mesh* m) {
+#ifndef MODEL_NO_LODS
+    mesh_generate_lods(m, MODEL_LOD_COUNT, MODEL_LOD_REDUCTION);
+#endif
+
+    vec_push(&import->meshes, m);
 }
 
-static inline struct model_mesh _model_process_mesh(struct aiMesh* mesh) {
+// Touches nothing but the import, so meshes can be converted on any thread
+static inline void _model_convert_mesh(struct _model_import* import) {
+    struct aiMesh* mesh = import->source;
     uint32_t vertex_count = mesh->mNumVertices;
 
     uint32_t index_count = 0;
@@ -100,62 +239,657 @@ static inline struct model_mesh _model_process_mesh(struct aiMesh* mesh) {
             out.indices[k++] = face.mIndices[j];
     }
 
-    mesh_generate(&out);
+    import->before =
+        mesh_cache_analyze(out.indices, out.index_count, out.vertex_count, MESH_CACHE_SIZE);
+
+#ifdef MODEL_NO_OVERDRAW_ORDER
+    mesh_optimize(&out, false);
+#else
+    mesh_optimize(&out, true);
+#endif
+
+    import->after =
+        mesh_cache_analyze(out.indices, out.index_count, out.vertex_count, MESH_CACHE_SIZE);
+
+    mesh_compute_bounds(&out);
 
-    return (struct model_mesh){
-        .mesh = out,
-        .material_id = mesh->mMaterialIndex,
-    };
+#ifndef MODEL_NO_MESH_SPLIT
+    // keep every mesh within reach of 16 bit indices
+    struct vector parts;
+    vec_init(&parts, sizeof(struct mesh));
+
+    if (mesh_split(&out, UINT16_MAX, &parts)) {
+        for (struct mesh* p = vec_iter_start(&parts); p != vec_iter_end(&parts);
+             vec_iter_advance(&parts, (void*)&p))
+            _model_add_mesh(import, p);
+
+        mesh_uninit(&out);
+        vec_uninit(&parts);
+        return;
+    }
+
+    vec_uninit(&parts);
+#endif
+
+    _model_add_mesh(import, &out);
 }
 
-static inline void _model_process_node(struct model* mod,
-                                       struct aiNode* node,
-                                       const struct aiScene* scene) {
+static inline void _model_convert_meshes(uint32_t start, uint32_t end, void* arg) {
+    struct _model_import* imports = arg;
+    for (uint32_t i = start; i < end; i++)
+        _model_convert_mesh(&imports[i]);
+}
+
+static inline void _model_collect_meshes(struct vector* imports,
+                                         struct aiNode* node,
+                                         const struct aiScene* scene) {
     for (uint32_t i = 0; i < node->mNumMeshes; i++) {
-        struct aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        struct model_mesh m = _model_process_mesh(mesh);
-        vec_push(&mod->meshes, &m);
+        struct _model_import* import = vec_emplace(imports);
+        *import = (struct _model_import){.source = scene->mMeshes[node->mMeshes[i]]};
+        vec_init(&import->meshes, sizeof(struct mesh));
     }
 
     for (uint32_t i = 0; i < node->mNumChildren; i++)
-        _model_process_node(mod, node->mChildren[i], scene);
+        _model_collect_meshes(imports, node->mChildren[i], scene);
 }
 
-static inline void model_load(struct model* mod, const char* path) {
+// Converts every mesh in the node tree, spread over the job system's threads when it is running.
+// The meshes keep the order of the node walk.
+static inline void _model_process_meshes(struct model* mod, const struct aiScene* scene) {
+    struct vector imports;
+    vec_init(&imports, sizeof(struct _model_import));
+    _model_collect_meshes(&imports, scene->mRootNode, scene);
+
+    job_parallel_for(imports.size, 1, _model_convert_meshes, imports.data);
+
+    for (struct _model_import* p = vec_iter_start(&imports); p != vec_iter_end(&imports);
+         vec_iter_advance(&imports, (void*)&p)) {
+        _model_add_cache_stats(&mod->cache_before, p->before);
+        _model_add_cache_stats(&mod->cache_after, p->after);
+
+        for (struct mesh* m = vec_iter_start(&p->meshes); m != vec_iter_end(&p->meshes);
+             vec_iter_advance(&p->meshes, (void*)&m)) {
+            struct model_mesh out = {.mesh = *m, .material_id = p->source->mMaterialIndex};
+            vec_push(&mod->meshes, &out);
+        }
+
+        vec_uninit(&p->meshes);
+    }
+
+    vec_uninit(&imports);
+}
+
+// The build options that change the imported meshes, a cache written with others is a miss
+static inline uint64_t _model_cache_options() {
+    uint64_t options = 0;
+#ifdef MODEL_NO_OVERDRAW_ORDER
+    options |= 1 << 0;
+#endif
+#ifdef MODEL_NO_MESH_SPLIT
+    options |= 1 << 1;
+#endif
+#ifdef MODEL_NO_LODS
+    options |= 1 << 2;
+#endif
+    return options;
+}
+
+static inline int _model_load_cache(struct model* mod, const char* cache_path, const char* path) {
+    if (!model_cache_open(&mod->cache, cache_path, path, sizeof(struct vertex),
+                          _model_cache_options()))
+        return 0;
+
+    struct model_cache* cache = &mod->cache;
+
+    for (uint32_t i = 0; i < cache->header->mesh_count; i++) {
+        struct model_cache_mesh* record = &cache->meshes[i];
+
+        // no copy, the buffers are uploaded straight from the mapping
+        struct model_mesh m = {0};
+        m.mesh.vertices = model_cache_vertices(cache, record);
+        m.mesh.vertex_count = record->vertex_count;
+        m.mesh.indices = model_cache_indices(cache, record);
+        m.mesh.index_count = record->lod_count ? record->lods[0].index_count : record->index_count;
+        m.mesh.lod_count = record->lod_count;
+        for (uint32_t j = 0; j < record->lod_count; j++)
+            m.mesh.lods[j] = (struct mesh_lod){record->lods[j].first_index,
+                                               record->lods[j].index_count, record->lods[j].error};
+        m.mesh.bounds = record->bounds;
+        m.mesh.bounding_sphere = record->bounding_sphere;
+        m.material_id = record->material_id;
+
+        vec_push(&mod->meshes, &m);
+    }
+
+    for (uint32_t i = 0; i < cache->header->material_count; i++) {
+        struct model_cache_material* record = &cache->materials[i];
+        struct model_material out = {0};
+
+        _model_load_material(&out, model_cache_string(cache, record->name),
+                             model_cache_string(cache, record->diffuse),
+                             model_cache_string(cache, record->specular), record->shininess,
+                             mod->packed);
+
+        vec_push(&mod->materials, &out);
+    }
+
+    return 1;
+}
+
+static inline void _model_write_cache(struct model* mod, const char* cache_path, const char* path) {
+    struct model_cache_writer writer;
+    model_cache_writer_init(&writer);
+
+    for (struct model_mesh* p = vec_iter_start(&mod->meshes); p != vec_iter_end(&mod->meshes);
+         vec_iter_advance(&mod->meshes, (void*)&p)) {
+        struct model_cache_lod lods[MODEL_CACHE_MAX_LODS];
+        for (uint32_t i = 0; i < p->mesh.lod_count; i++)
+            lods[i] = (struct model_cache_lod){p->mesh.lods[i].first_index,
+                                               p->mesh.lods[i].index_count, p->mesh.lods[i].error};
+
+        model_cache_add_mesh(&writer, p->mesh.vertices, sizeof(struct vertex), p->mesh.vertex_count,
+                             p->mesh.indices, mesh_total_index_count(&p->mesh), lods,
+                             p->mesh.lod_count, p->material_id, p->mesh.bounds,
+                             p->mesh.bounding_sphere);
+    }
+
+    for (struct model_material* p = vec_iter_start(&mod->materials);
+         p != vec_iter_end(&mod->materials); vec_iter_advance(&mod->materials, (void*)&p))
+        model_cache_add_material(&writer, p->name, p->diffuse.path, p->specular.path,
+                                 p->shininess);
+
+    if (!model_cache_write(&writer, cache_path, path, sizeof(struct vertex),
+                           _model_cache_options()))
+        warn("model_load: failed to write cache %s", cache_path);
+
+    model_cache_writer_uninit(&writer);
+}
+
+// ================ TEXTURE PACKING ================
+
+// A distinct image or fallback colour used by the materials of a packed model
+struct _model_pack_source {
+    const char* path;  // interned, nullptr for a fallback colour
+    vec4 color;
+
+    // textures too big for the atlas stay compressed when the GPU supports it
+    int compressed;
+    struct compressed_image bc;
+    struct image img;
+
+    struct texture_pack_rect rect;
+    struct model_texture_slot slot;
+};
+
+static inline uint32_t _model_add_pack_source(struct vector* sources,
+                                              const char* path,
+                                              vec4 color) {
+    struct _model_pack_source* s = sources->data;
+    for (uint32_t i = 0; i < sources->size; i++)
+        if (s[i].path == path && (path || memcmp(&s[i].color, &color, sizeof(vec4)) == 0))
+            return i;
+
+    struct _model_pack_source* out = vec_emplace(sources);
+    *out = (struct _model_pack_source){.path = path, .color = color};
+    return sources->size - 1;
+}
+
+static inline void _model_decode_sources(uint32_t start, uint32_t end, void* arg) {
+    struct _model_pack_source* sources = arg;
+    for (uint32_t i = start; i < end; i++) {
+        struct _model_pack_source* s = &sources[i];
+
+        if (!s->path) {
+            uint8_t* pixel = malloc(4);
+            if (!pixel)
+                panic("model_load: failed to allocate memory");
+
+            const float* c = &s->color.x;
+            for (uint32_t j = 0; j < 4; j++)
+                pixel[j] = (uint8_t)(fminf(fmaxf(c[j], 0), 1) * 255 + 0.5f);
+
+            s->img = (struct image){.data = pixel, .width = 1, .height = 1, .channels = 4};
+            continue;
+        }
+
+        if (s->compressed) {
+            if (!texture_compress_cached(&s->bc, s->path))
+                panic("model_load: failed to load texture %s", s->path);
+            if (s->bc.width > MODEL_ATLAS_MAX_SIZE || s->bc.height > MODEL_ATLAS_MAX_SIZE)
+                continue;
+
+            compressed_image_uninit(&s->bc);
+            s->compressed = 0;
+        }
+
+        if (!image_load(s->path, &s->img) || !_texture_expand_rgba(&s->img))
+            panic("model_load: failed to load texture %s", s->path);
+    }
+}
+
+static inline int _model_atlas_source(const struct _model_pack_source* s) {
+    return !s->compressed && s->img.width <= MODEL_ATLAS_MAX_SIZE &&
+           s->img.height <= MODEL_ATLAS_MAX_SIZE;
+}
+
+// Puts the small sources on the pages of one RGBA8 array
+static inline void _model_pack_atlas(struct model* mod, struct vector* sources) {
+    struct vector rects;
+    vec_init(&rects, sizeof(struct texture_pack_rect));
+
+    struct _model_pack_source* s = sources->data;
+    for (uint32_t i = 0; i < sources->size; i++)
+        if (_model_atlas_source(&s[i])) {
+            struct texture_pack_rect rect = {.width = s[i].img.width, .height = s[i].img.height};
+            vec_push(&rects, &rect);
+        }
+
+    struct texture_pack_rect* packed = rects.data;
+    uint32_t pages = texture_pack_atlas(packed, rects.size, MODEL_ATLAS_SIZE, MODEL_ATLAS_PADDING);
+    if (pages == 0) {
+        vec_uninit(&rects);
+        return;
+    }
+
+    struct texture_array* arr = vec_emplace(&mod->texture_arrays);
+    texture_array_init(arr, MODEL_ATLAS_SIZE, MODEL_ATLAS_SIZE, pages, MODEL_ATLAS_LEVELS,
+                       GL_RGBA8);
+
+    uint8_t* page = malloc(MODEL_ATLAS_SIZE * MODEL_ATLAS_SIZE * 4);
+    if (!page)
+        panic("model_load: failed to allocate memory");
+
+    for (uint32_t p = 0; p < pages; p++) {
+        memset(page, 0, MODEL_ATLAS_SIZE * MODEL_ATLAS_SIZE * 4);
+
+        for (uint32_t i = 0, r = 0; i < sources->size; i++) {
+            if (!_model_atlas_source(&s[i]))
+                continue;
+
+            struct texture_pack_rect* rect = &packed[r++];
+            if (rect->page != p)
+                continue;
+
+            texture_pack_blit(page, MODEL_ATLAS_SIZE, rect, MODEL_ATLAS_PADDING, s[i].img.data);
+            s[i].slot = (struct model_texture_slot){mod->texture_arrays.size - 1, p,
+                                                    texture_pack_uv_rect(rect, MODEL_ATLAS_SIZE)};
+        }
+
+        texture_array_set_layer(arr, p, page);
+    }
+
+    texture_array_generate_mipmaps(arr);
+
+    free(page);
+    vec_uninit(&rects);
+}
+
+// Gives the remaining sources a layer in an array of their size and format
+static inline void _model_pack_layers(struct model* mod, struct vector* sources) {
+    uint32_t first = mod->texture_arrays.size;
+    struct _model_pack_source* s = sources->data;
+
+    // count the layers of every array first, storage is allocated up front
+    for (uint32_t i = 0; i < sources->size; i++) {
+        if (_model_atlas_source(&s[i]))
+            continue;
+
+        uint32_t width = s[i].compressed ? s[i].bc.width : s[i].img.width;
+        uint32_t height = s[i].compressed ? s[i].bc.height : s[i].img.height;
+        GLenum format =
+            s[i].compressed ? _texture_compressed_format(s[i].bc.compression) : GL_RGBA8;
+
+        uint32_t a = first;
+        struct texture_array* arr = nullptr;
+        for (; a < mod->texture_arrays.size; a++) {
+            arr = vec_item(&mod->texture_arrays, a);
+            if (arr->width == width && arr->height == height && arr->format == format)
+                break;
+        }
+
+        if (a == mod->texture_arrays.size) {
+            arr = vec_emplace(&mod->texture_arrays);
+            *arr = (struct texture_array){.width = width, .height = height, .format = format};
+        }
+
+        s[i].slot = (struct model_texture_slot){a, arr->layers++, {1, 1, 0, 0}};
+    }
+
+    for (uint32_t a = first; a < mod->texture_arrays.size; a++) {
+        struct texture_array* arr = vec_item(&mod->texture_arrays, a);
+        texture_array_init(arr, arr->width, arr->height, arr->layers, 0, arr->format);
+    }
+
+    for (uint32_t i = 0; i < sources->size; i++) {
+        if (_model_atlas_source(&s[i]))
+            continue;
+
+        struct texture_array* arr = vec_item(&mod->texture_arrays, s[i].slot.array);
+        if (s[i].compressed)
+            texture_array_set_layer_compressed(arr, s[i].slot.layer, &s[i].bc);
+        else
+            texture_array_set_layer(arr, s[i].slot.layer, s[i].img.data);
+    }
+
+    for (uint32_t a = first; a < mod->texture_arrays.size; a++) {
+        struct texture_array* arr = vec_item(&mod->texture_arrays, a);
+        if (arr->format == GL_RGBA8)
+            texture_array_generate_mipmaps(arr);
+    }
+}
+
+// Loads every texture the materials use into as few texture arrays as their sizes allow, so a
+// packed model rebinds textures only when a material's array differs from the last one's.
+static inline void _model_pack_textures(struct model* mod) {
+    struct vector sources, refs;
+    vec_init(&sources, sizeof(struct _model_pack_source));
+    vec_init(&refs, sizeof(uint32_t));
+
+    for (struct model_material* p = vec_iter_start(&mod->materials);
+         p != vec_iter_end(&mod->materials); vec_iter_advance(&mod->materials, (void*)&p)) {
+        uint32_t diffuse =
+            _model_add_pack_source(&sources, p->diffuse.path, MODEL_FALLBACK_DIFFUSE);
+        uint32_t specular =
+            _model_add_pack_source(&sources, p->specular.path, MODEL_FALLBACK_SPECULAR);
+        vec_push(&refs, &diffuse);
+        vec_push(&refs, &specular);
+    }
+
+    // the compression check needs the GL thread, decoding doesn't
+    int compress = _texture_has_compression();
+    for (struct _model_pack_source* p = vec_iter_start(&sources); p != vec_iter_end(&sources);
+         vec_iter_advance(&sources, (void*)&p))
+        p->compressed = compress && p->path;
+
+    job_parallel_for(sources.size, 1, _model_decode_sources, sources.data);
+
+    _model_pack_atlas(mod, &sources);
+    _model_pack_layers(mod, &sources);
+
+    struct _model_pack_source* s = sources.data;
+    uint32_t* ref = refs.data;
+    for (uint32_t i = 0; i < mod->materials.size; i++) {
+        struct model_material* material = vec_item(&mod->materials, i);
+        material->diffuse_slot = s[ref[2 * i]].slot;
+        material->specular_slot = s[ref[2 * i + 1]].slot;
+    }
+
+    for (struct _model_pack_source* p = vec_iter_start(&sources); p != vec_iter_end(&sources);
+         vec_iter_advance(&sources, (void*)&p)) {
+        compressed_image_uninit(&p->bc);
+        image_uninit(&p->img);
+    }
+
+    vec_uninit(&refs);
+    vec_uninit(&sources);
+}
+
+static inline void _model_generate_buffer(struct model* mod, enum vertex_format format) {
+    uint32_t vertex_count = 0, index_count = 0, max_vertex_count = 0;
+    aabb bounds = {0};
+    for (struct model_mesh* p = vec_iter_start(&mod->meshes); p != vec_iter_end(&mod->meshes);
+         vec_iter_advance(&mod->meshes, (void*)&p)) {
+        bounds = vertex_count ? aabb_merge(bounds, p->mesh.bounds) : p->mesh.bounds;
+        vertex_count += p->mesh.vertex_count;
+        index_count += mesh_total_index_count(&p->mesh);
+        if (p->mesh.vertex_count > max_vertex_count)
+            max_vertex_count = p->mesh.vertex_count;
+    }
+
+    mesh_buffer_init(&mod->buffer, vertex_count, index_count, format, bounds,
+                     mesh_index_type(max_vertex_count));
+    for (struct model_mesh* p = vec_iter_start(&mod->meshes); p != vec_iter_end(&mod->meshes);
+         vec_iter_advance(&mod->meshes, (void*)&p))
+        mesh_buffer_add(&mod->buffer, &p->mesh);
+}
+
+static inline void _model_load(struct model* mod,
+                               const char* path,
+                               enum vertex_format format,
+                               int packed) {
+    double start = time_now();
+
     string_init(&mod->path);
     vec_init(&mod->meshes, sizeof(struct model_mesh));
     vec_init(&mod->materials, sizeof(struct model_material));
+    vec_init(&mod->texture_arrays, sizeof(struct texture_array));
+    mod->packed = packed;
+    vec_init(&mod->bounds, sizeof(aabb));
+    vec_init(&mod->visible, sizeof(uint8_t));
+    render_queue_init(&mod->queue);
+    mod->sampler_program = 0;
+    vec_init(&mod->batch_counts, sizeof(GLsizei));
+    vec_init(&mod->batch_offsets, sizeof(const void*));
+    vec_init(&mod->batch_bases, sizeof(GLint));
+    mod->drawn = 0;
+    mod->culled = 0;
+    mod->draw_calls = 0;
+    mod->triangles = 0;
+    mod->lod_scale = 0;
+    mod->cache_before = (struct mesh_cache_stats){0};
+    mod->cache_after = (struct mesh_cache_stats){0};
+    mod->cache = (struct model_cache){0};
+
+    string_append(&mod->path, path, strlen(path));
 
-    const struct aiScene* scene =
-        aiImportFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+    char cache_path[4096];
+    model_cache_path(path, cache_path, sizeof(cache_path));
 
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
-        panic("model_load: failed to load model\n%s", aiGetErrorString());
+    mod->from_cache = _model_load_cache(mod, cache_path, path);
+    if (!mod->from_cache) {
+        const struct aiScene* scene =
+            aiImportFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
 
-    string_append(&mod->path, path, strlen(path));
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+            panic("model_load: failed to load model\n%s", aiGetErrorString());
+
+        _model_process_meshes(mod, scene);
+        _model_process_materials(mod, scene);
+        aiReleaseImport(scene);
+
+        _model_write_cache(mod, cache_path, path);
+    }
 
-    _model_process_node(mod, scene->mRootNode, scene);
-    _model_process_materials(mod, scene);
+    if (packed)
+        _model_pack_textures(mod);
+
+    _model_generate_buffer(mod, format);
+
+    for (struct model_mesh* p = vec_iter_start(&mod->meshes); p != vec_iter_end(&mod->meshes);
+         vec_iter_advance(&mod->meshes, (void*)&p))
+        vec_push(&mod->bounds, &p->mesh.bounds);
+    vec_resize(&mod->visible, mod->meshes.size);
+    vec_realloc(&mod->batch_counts, mod->meshes.size);
+    vec_realloc(&mod->batch_offsets, mod->meshes.size);
+    vec_realloc(&mod->batch_bases, mod->meshes.size);
+
+    mod->load_ms = (time_now() - start) * 1000;
 }
 
-static inline void model_draw(struct model* mod, struct shader* shader) {
-    shader_set_int(shader, "material.diffuse", 0);
-    shader_set_int(shader, "material.specular", 1);
+// Loads from the binary cache next to path if it is up to date, otherwise imports the model with
+// assimp and writes the cache for the next run. format picks the GPU vertex layout, packed models
+// need shaders/packed_vs.glsl.
+static inline void model_load_format(struct model* mod, const char* path, enum vertex_format format) {
+    _model_load(mod, path, format, 0);
+}
+
+// Like model_load_format, but packs the material textures into texture arrays and atlas pages, so
+// draws switch materials by uniforms instead of texture binds. Needs shaders/model_array_fs.glsl.
+static inline void model_load_packed(struct model* mod, const char* path, enum vertex_format format) {
+    _model_load(mod, path, format, 1);
+}
+
+static inline void model_load(struct model* mod, const char* path) {
+    model_load_format(mod, path, VERTEX_FORMAT_FLOAT);
+}
+
+// Enables lod selection for a perspective projection with a vertical fov in degrees onto a viewport
+// height pixels high. Meshes switch to a coarser level once its error projects to less than
+// pixel_error pixels. Needs a frustum in model_draw_culled to know how far away the meshes are.
+static inline void model_set_lod_scale(struct model* mod,
+                                       float fov,
+                                       float height,
+                                       float pixel_error) {
+    float pixels_per_unit = height / (2 * tan(radians(fov / 2)));
+    mod->lod_scale = pixel_error > 0 ? pixels_per_unit / pixel_error : 0;
+}
+
+// Binds the array of a packed texture unless it is already bound to unit
+static inline void _model_bind_slot(struct model* mod,
+                                    const struct model_texture_slot* slot,
+                                    int unit,
+                                    uint32_t* bound,
+                                    GLint layer,
+                                    GLint uv_rect) {
+    if (slot->array != *bound) {
+        texture_array_bind(vec_item(&mod->texture_arrays, slot->array), unit);
+        *bound = slot->array;
+    }
+
+    shader_set_float_at(layer, slot->layer);
+    shader_set_vec4_at(uv_rect, slot->uv_rect);
+}
+
+static inline void _model_flush_batch(struct model* mod) {
+    uint32_t count = mod->batch_counts.size;
+    if (count == 0)
+        return;
+
+    GLsizei* counts = mod->batch_counts.data;
+    const void** offsets = mod->batch_offsets.data;
+    GLint* bases = mod->batch_bases.data;
+
+    GLenum type = mod->buffer.index_type;
+    if (count == 1)
+        glDrawElementsBaseVertex(GL_TRIANGLES, counts[0], type, offsets[0], bases[0]);
+    else
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, type, (const void* const*)offsets,
+                                      count, bases);
+
+    mod->draw_calls++;
+    mod->batch_counts.size = 0;
+    mod->batch_offsets.size = 0;
+    mod->batch_bases.size = 0;
+}
 
+// Draws the meshes whose bounds intersect the frustum, which must be in the model's local space,
+// e.g. frustum_from_matrix(projection * view * model). A null frustum draws everything.
+//
+// Visible meshes are sorted by material and then front to back, and each run of meshes sharing a
+// material is submitted as one multi-draw, packed models only rebind textures when the array
+// changes. With a lod scale set, every mesh is drawn at the coarsest level that looks the same
+// from its distance.
+static inline void model_draw_culled(struct model* mod,
+                                     struct shader* shader,
+                                     const struct frustum* frustum) {
+    uint8_t* visible = mod->visible.data;
+    if (frustum) {
+        mod->drawn = frustum_cull_aabbs(frustum, mod->bounds.data, mod->bounds.size, visible);
+    } else {
+        memset(visible, 1, mod->visible.size);
+        mod->drawn = mod->meshes.size;
+    }
+    mod->culled = mod->meshes.size - mod->drawn;
+    mod->draw_calls = 0;
+    mod->triangles = 0;
+
+    if (mod->sampler_program != shader->program) {
+        shader_set_int(shader, "material.diffuse", 0);
+        shader_set_int(shader, "material.specular", 1);
+        mod->sampler_program = shader->program;
+
+        struct model_uniforms* u = &mod->uniforms;
+        u->diffuse_layer = shader_location(shader, "material.diffuseLayer");
+        u->diffuse_rect = shader_location(shader, "material.diffuseRect");
+        u->specular_layer = shader_location(shader, "material.specularLayer");
+        u->specular_rect = shader_location(shader, "material.specularRect");
+        u->shininess = shader_location(shader, "material.shininess");
+        u->position_offset = shader_location(shader, "positionOffset");
+        u->position_scale = shader_location(shader, "positionScale");
+    }
+
+    // the near plane is normalized, so its distance is the view depth in model space
+    vec4 near = frustum ? frustum->planes[FRUSTUM_NEAR] : (vec4){0};
+
+    render_queue_clear(&mod->queue);
+    for (uint32_t i = 0; i < mod->meshes.size; i++) {
+        if (!visible[i])
+            continue;
+
+        struct model_mesh* p = vec_item(&mod->meshes, i);
+        vec3 c = p->mesh.bounding_sphere.center;
+        float depth = near.x * c.x + near.y * c.y + near.z * c.z + near.w;
+
+        render_queue_push(&mod->queue,
+                          draw_key(shader->program, p->material_id, p->mesh.VAO, depth), i);
+    }
+    render_queue_sort(&mod->queue);
+
+    if (mod->buffer.format == VERTEX_FORMAT_PACKED) {
+        shader_set_vec3_at(mod->uniforms.position_offset, mod->buffer.quantization.offset);
+        shader_set_vec3_at(mod->uniforms.position_scale, mod->buffer.quantization.scale);
+    }
+
+    mesh_buffer_bind(&mod->buffer);
+
+    struct draw_item* items = render_queue_items(&mod->queue);
     uint32_t last_material_id = -1;
-    for (struct model_mesh* p = vec_iter_start(&mod->meshes); p != vec_iter_end(&mod->meshes);
-         vec_iter_advance(&mod->meshes, (void*)&p)) {
+    uint32_t bound_diffuse = -1, bound_specular = -1;
+    for (uint32_t i = 0; i < render_queue_size(&mod->queue); i++) {
+        struct model_mesh* p = vec_item(&mod->meshes, items[i].index);
+
         if (p->material_id != last_material_id) {
+            _model_flush_batch(mod);
+
             struct model_material* material = vec_item(&mod->materials, p->material_id);
-            texture_bind(&material->diffuse, 0);
-            texture_bind(&material->specular, 1);
-            shader_set_float(shader, "material.shininess", material->shininess);
+            if (mod->packed) {
+                _model_bind_slot(mod, &material->diffuse_slot, 0, &bound_diffuse,
+                                 mod->uniforms.diffuse_layer, mod->uniforms.diffuse_rect);
+                _model_bind_slot(mod, &material->specular_slot, 1, &bound_specular,
+                                 mod->uniforms.specular_layer, mod->uniforms.specular_rect);
+            } else {
+                texture_bind(&material->diffuse, 0);
+                texture_bind(&material->specular, 1);
+            }
+            shader_set_float_at(mod->uniforms.shininess, material->shininess);
         }
 
-        mesh_draw(&p->mesh);
+        if (p->mesh.index_count) {
+            uint32_t first = p->mesh.first_index;
+            GLsizei count = p->mesh.index_count;
+
+            if (frustum && mod->lod_scale > 0 && p->mesh.lod_count > 1) {
+                sphere s = p->mesh.bounding_sphere;
+                float depth = near.x * s.center.x + near.y * s.center.y + near.z * s.center.z +
+                              near.w - s.radius;
+
+                const struct mesh_lod* lod = mesh_select_lod(&p->mesh, depth, mod->lod_scale);
+                first += lod->first_index;
+                count = lod->index_count;
+            }
+
+            const void* offset = (void*)((size_t)first * mesh_index_size(mod->buffer.index_type));
+            GLint base = p->mesh.base_vertex;
+            mod->triangles += count / 3;
+
+            vec_push(&mod->batch_counts, &count);
+            vec_push(&mod->batch_offsets, &offset);
+            vec_push(&mod->batch_bases, &base);
+        } else {
+            _model_flush_batch(mod);
+            mesh_draw_bound(&p->mesh);
+            mod->draw_calls++;
+            mod->triangles += p->mesh.vertex_count / 3;
+        }
 
         last_material_id = p->material_id;
     }
+
+    _model_flush_batch(mod);
+}
+
+static inline void model_draw(struct model* mod, struct shader* shader) {
+    model_draw_culled(mod, shader, nullptr);
 }
 
 static inline void model_uninit(struct model* mod) {
@@ -163,12 +897,31 @@ static inline void model_uninit(struct model* mod) {
          vec_iter_advance(&mod->meshes, (void*)&p))
         mesh_uninit(&p->mesh);
 
+    // packed models never acquired their textures
     for (struct model_material* p = vec_iter_start(&mod->materials);
          p != vec_iter_end(&mod->materials); vec_iter_advance(&mod->materials, (void*)&p)) {
-        texture_uninit(&p->diffuse);
-        texture_uninit(&p->specular);
+        if (mod->packed)
+            break;
+
+        texture_release(&p->diffuse);
+        texture_release(&p->specular);
     }
 
+    for (struct texture_array* p = vec_iter_start(&mod->texture_arrays);
+         p != vec_iter_end(&mod->texture_arrays);
+         vec_iter_advance(&mod->texture_arrays, (void*)&p))
+        texture_array_uninit(p);
+
+    mesh_buffer_uninit(&mod->buffer);
+    model_cache_close(&mod->cache);
+
+    render_queue_uninit(&mod->queue);
+    vec_uninit(&mod->batch_bases);
+    vec_uninit(&mod->batch_offsets);
+    vec_uninit(&mod->batch_counts);
+    vec_uninit(&mod->visible);
+    vec_uninit(&mod->bounds);
+    vec_uninit(&mod->texture_arrays);
     vec_uninit(&mod->materials);
     vec_uninit(&mod->meshes);
     string_uninit(&mod->path);
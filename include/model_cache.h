@@ -0,0 +1,433 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mmath.h"
+#include "util.h"
+#include "vector.h"
+
+// Binary model cache.
+//
+// Written next to the source model after an import and mapped on later loads, so the vertex and
+// index data can be handed to the GPU without any parsing. The layout is native endian and uses the
+// in-memory vertex layout, it is a local cache and not an interchange format:
+//
+//   header | mesh records | material records | string table | (aligned) vertex and index data
+//
+// A cache is only used when its version, vertex size, import options and the recorded size and
+// mtime of the source and its material libraries match, anything else is treated as a miss and
+// the model is imported again.
+
+#define MODEL_CACHE_MAGIC 0x4843444d  // "MDCH"
+#define MODEL_CACHE_VERSION 4
+#define MODEL_CACHE_EXTENSION ".mcache"
+#define MODEL_CACHE_ALIGN 16
+#define MODEL_CACHE_NONE UINT32_MAX
+#define MODEL_CACHE_MAX_LODS 4
+
+struct model_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_size;
+    uint32_t mesh_count;
+    uint32_t material_count;
+    uint32_t strings_size;
+
+    int64_t source_size;
+    int64_t source_mtime;
+
+    // the .mtl files an .obj names, summed sizes and the latest mtime
+    int64_t materials_size;
+    int64_t materials_mtime;
+
+    // whatever the importer changes the meshes with, see _model_cache_options in model.h
+    uint64_t options;
+
+    uint64_t data_offset;
+    uint64_t data_size;
+};
+
+// index range of a level of detail within its mesh's indices
+struct model_cache_lod {
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;
+};
+
+struct model_cache_mesh {
+    uint32_t material_id;
+    uint32_t vertex_count;
+    uint32_t index_count;  // including every lod
+    uint32_t lod_count;
+
+    struct model_cache_lod lods[MODEL_CACHE_MAX_LODS];
+
+    // relative to the start of the data section
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+
+    aabb bounds;
+    sphere bounding_sphere;
+};
+
+struct model_cache_material {
+    float shininess;
+
+    // offsets into the string table, MODEL_CACHE_NONE if missing
+    uint32_t name;
+    uint32_t diffuse;
+    uint32_t specular;
+};
+
+struct model_cache {
+    void* map;
+    size_t size;
+
+    struct model_cache_header* header;
+    struct model_cache_mesh* meshes;
+    struct model_cache_material* materials;
+    const char* strings;
+    char* data;
+};
+
+struct model_cache_writer {
+    struct vector meshes;
+    struct vector materials;
+    struct vector strings;
+    struct vector data;
+};
+
+static inline void model_cache_path(const char* source_path, char* out, size_t size) {
+    snprintf(out, size, "%s" MODEL_CACHE_EXTENSION, source_path);
+}
+
+// ================ READING ================
+
+static inline int _model_cache_stat(const char* path, int64_t* size, int64_t* mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 1;
+}
+
+// Stats the material libraries an .obj names with mtllib, relative to its directory. Only the
+// lines before the first vertex or face are read, exporters write them at the top. Other formats
+// and missing libraries add nothing.
+static inline void _model_cache_stat_materials(const char* source_path,
+                                               int64_t* size,
+                                               int64_t* mtime) {
+    *size = 0;
+    *mtime = 0;
+
+    const char* extension = strrchr(source_path, '.');
+    if (!extension || (strcmp(extension, ".obj") != 0 && strcmp(extension, ".OBJ") != 0))
+        return;
+
+    FILE* file = fopen(source_path, "r");
+    if (!file)
+        return;
+
+    const char* slash = strrchr(source_path, '/');
+    int directory_length = slash ? (int)(slash - source_path + 1) : 0;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file) && line[0] != 'v' && line[0] != 'f') {
+        if (strncmp(line, "mtllib", 6) != 0 || (line[6] != ' ' && line[6] != '\t'))
+            continue;
+
+        char* name = line + 7;
+        while (*name == ' ' || *name == '\t')
+            name++;
+        name[strcspn(name, "\r\n")] = '\0';
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%.*s%s", directory_length, source_path, name);
+
+        int64_t library_size, library_mtime;
+        if (!_model_cache_stat(path, &library_size, &library_mtime))
+            continue;
+
+        *size += library_size;
+        if (library_mtime > *mtime)
+            *mtime = library_mtime;
+    }
+
+    fclose(file);
+}
+
+static inline int _model_cache_validate(struct model_cache* cache,
+                                        const char* source_path,
+                                        uint32_t vertex_size,
+                                        uint64_t options) {
+    if (cache->size < sizeof(struct model_cache_header))
+        return 0;
+
+    struct model_cache_header* h = cache->header;
+    if (h->magic != MODEL_CACHE_MAGIC || h->version != MODEL_CACHE_VERSION ||
+        h->vertex_size != vertex_size || h->options != options)
+        return 0;
+
+    if (source_path) {
+        int64_t size, mtime;
+        if (!_model_cache_stat(source_path, &size, &mtime) || size != h->source_size ||
+            mtime != h->source_mtime)
+            return 0;
+
+        _model_cache_stat_materials(source_path, &size, &mtime);
+        if (size != h->materials_size || mtime != h->materials_mtime)
+            return 0;
+    }
+
+    uint64_t tables = sizeof(struct model_cache_header) +
+                      (uint64_t)h->mesh_count * sizeof(struct model_cache_mesh) +
+                      (uint64_t)h->material_count * sizeof(struct model_cache_material) +
+                      h->strings_size;
+    if (tables > h->data_offset || h->data_offset + h->data_size > cache->size)
+        return 0;
+
+    for (uint32_t i = 0; i < h->mesh_count; i++) {
+        struct model_cache_mesh* m = &cache->meshes[i];
+        if (m->vertex_offset + (uint64_t)m->vertex_count * vertex_size > h->data_size ||
+            m->index_offset + (uint64_t)m->index_count * sizeof(uint32_t) > h->data_size ||
+            m->lod_count > MODEL_CACHE_MAX_LODS || m->material_id >= h->material_count)
+            return 0;
+
+        for (uint32_t j = 0; j < m->lod_count; j++)
+            if ((uint64_t)m->lods[j].first_index + m->lods[j].index_count > m->index_count)
+                return 0;
+    }
+
+    // a terminated table keeps every string that starts inside it from running past its end
+    if (h->strings_size > 0 && cache->strings[h->strings_size - 1] != '\0')
+        return 0;
+
+    for (uint32_t i = 0; i < h->material_count; i++) {
+        struct model_cache_material* m = &cache->materials[i];
+        uint32_t strings[] = {m->name, m->diffuse, m->specular};
+        for (uint32_t j = 0; j < 3; j++)
+            if (strings[j] != MODEL_CACHE_NONE && strings[j] >= h->strings_size)
+                return 0;
+    }
+
+    return 1;
+}
+
+// Maps the cache file at path. Returns 0 if it is missing, stale (when source_path is given) or
+// was written with a different vertex layout or options.
+static inline int model_cache_open(struct model_cache* cache,
+                                   const char* path,
+                                   const char* source_path,
+                                   uint32_t vertex_size,
+                                   uint64_t options) {
+    *cache = (struct model_cache){0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    // private mapping, meshes may modify their vertices in place without touching the file
+    void* map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return 0;
+
+    char* base = map;
+    cache->map = map;
+    cache->size = st.st_size;
+    cache->header = map;
+
+    if (cache->size >= sizeof(struct model_cache_header)) {
+        struct model_cache_header* h = cache->header;
+        cache->meshes = (struct model_cache_mesh*)(base + sizeof(struct model_cache_header));
+        cache->materials = (struct model_cache_material*)(cache->meshes + h->mesh_count);
+        cache->strings = (const char*)(cache->materials + h->material_count);
+        cache->data = base + h->data_offset;
+    }
+
+    if (!_model_cache_validate(cache, source_path, vertex_size, options)) {
+        munmap(map, st.st_size);
+        *cache = (struct model_cache){0};
+        return 0;
+    }
+
+    return 1;
+}
+
+static inline const char* model_cache_string(struct model_cache* cache, uint32_t offset) {
+    if (offset == MODEL_CACHE_NONE || offset >= cache->header->strings_size)
+        return nullptr;
+
+    return cache->strings + offset;
+}
+
+static inline void* model_cache_vertices(struct model_cache* cache, struct model_cache_mesh* m) {
+    return cache->data + m->vertex_offset;
+}
+
+static inline uint32_t* model_cache_indices(struct model_cache* cache, struct model_cache_mesh* m) {
+    return (uint32_t*)(cache->data + m->index_offset);
+}
+
+static inline void model_cache_close(struct model_cache* cache) {
+    if (cache->map)
+        munmap(cache->map, cache->size);
+
+    *cache = (struct model_cache){0};
+}
+
+// ================ WRITING ================
+
+static inline void model_cache_writer_init(struct model_cache_writer* w) {
+    vec_init(&w->meshes, sizeof(struct model_cache_mesh));
+    vec_init(&w->materials, sizeof(struct model_cache_material));
+    vec_init(&w->strings, sizeof(char));
+    vec_init(&w->data, sizeof(char));
+}
+
+static inline uint32_t _model_cache_add_string(struct model_cache_writer* w, const char* s) {
+    if (!s)
+        return MODEL_CACHE_NONE;
+
+    uint32_t offset = w->strings.size;
+    vec_extend(&w->strings, s, strlen(s) + 1);
+
+    return offset;
+}
+
+static inline uint64_t _model_cache_add_data(struct model_cache_writer* w,
+                                             const void* src,
+                                             uint32_t size) {
+    uint32_t start = w->data.size;
+    uint32_t offset = (start + MODEL_CACHE_ALIGN - 1) & ~(MODEL_CACHE_ALIGN - 1);
+    vec_resize(&w->data, offset);
+    vec_zero(&w->data, start, offset);
+    vec_extend(&w->data, src, size);
+
+    return offset;
+}
+
+static inline void model_cache_add_mesh(struct model_cache_writer* w,
+                                        const void* vertices,
+                                        uint32_t vertex_size,
+                                        uint32_t vertex_count,
+                                        const uint32_t* indices,
+                                        uint32_t index_count,
+                                        const struct model_cache_lod* lods,
+                                        uint32_t lod_count,
+                                        uint32_t material_id,
+                                        aabb bounds,
+                                        sphere bounding_sphere) {
+    struct model_cache_mesh m = {
+        .material_id = material_id,
+        .vertex_count = vertex_count,
+        .index_count = index_count,
+        .bounds = bounds,
+        .bounding_sphere = bounding_sphere,
+    };
+
+    if (lod_count > MODEL_CACHE_MAX_LODS)
+        panic("model_cache_add_mesh: too many lods");
+
+    m.lod_count = lod_count;
+    if (lod_count)
+        memcpy(m.lods, lods, lod_count * sizeof(struct model_cache_lod));
+
+    m.vertex_offset = _model_cache_add_data(w, vertices, vertex_count * vertex_size);
+    m.index_offset = _model_cache_add_data(w, indices, index_count * sizeof(uint32_t));
+
+    vec_push(&w->meshes, &m);
+}
+
+static inline void model_cache_add_material(struct model_cache_writer* w,
+                                            const char* name,
+                                            const char* diffuse,
+                                            const char* specular,
+                                            float shininess) {
+    struct model_cache_material m = {
+        .shininess = shininess,
+        .name = _model_cache_add_string(w, name),
+        .diffuse = _model_cache_add_string(w, diffuse),
+        .specular = _model_cache_add_string(w, specular),
+    };
+
+    vec_push(&w->materials, &m);
+}
+
+// Writes to a temporary file first and renames it over path, so a concurrent or interrupted load
+// never sees a partial cache. Returns 0 on failure.
+static inline int model_cache_write(struct model_cache_writer* w,
+                                    const char* path,
+                                    const char* source_path,
+                                    uint32_t vertex_size,
+                                    uint64_t options) {
+    struct model_cache_header h = {
+        .magic = MODEL_CACHE_MAGIC,
+        .version = MODEL_CACHE_VERSION,
+        .vertex_size = vertex_size,
+        .options = options,
+        .mesh_count = w->meshes.size,
+        .material_count = w->materials.size,
+        .strings_size = w->strings.size,
+        .data_size = w->data.size,
+    };
+
+    if (source_path) {
+        if (!_model_cache_stat(source_path, &h.source_size, &h.source_mtime))
+            return 0;
+        _model_cache_stat_materials(source_path, &h.materials_size, &h.materials_mtime);
+    }
+
+    uint64_t tables = sizeof(h) + w->meshes.size * sizeof(struct model_cache_mesh) +
+                      w->materials.size * sizeof(struct model_cache_material) + w->strings.size;
+    h.data_offset = (tables + MODEL_CACHE_ALIGN - 1) & ~(uint64_t)(MODEL_CACHE_ALIGN - 1);
+
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+    FILE* file = fopen(temp, "wb");
+    if (!file)
+        return 0;
+
+    static const char zeros[MODEL_CACHE_ALIGN] = {0};
+    size_t expected = 1 + w->meshes.size + w->materials.size + w->strings.size +
+                      (h.data_offset - tables) + w->data.size;
+    size_t written = fwrite(&h, sizeof(h), 1, file);
+    written += fwrite(w->meshes.data, sizeof(struct model_cache_mesh), w->meshes.size, file);
+    written += fwrite(w->materials.data, sizeof(struct model_cache_material), w->materials.size,
+                      file);
+    written += fwrite(w->strings.data, 1, w->strings.size, file);
+    written += fwrite(zeros, 1, h.data_offset - tables, file);
+    written += fwrite(w->data.data, 1, w->data.size, file);
+
+    if (fclose(file) != 0 || written != expected || rename(temp, path) != 0) {
+        remove(temp);
+        return 0;
+    }
+
+    return 1;
+}
+
+static inline void model_cache_writer_uninit(struct model_cache_writer* w) {
+    vec_uninit(&w->data);
+    vec_uninit(&w->strings);
+    vec_uninit(&w->materials);
+    vec_uninit(&w->meshes);
+}
+
+#endif
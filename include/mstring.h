@@ -1,79 +1,164 @@
 #ifndef MSTRING_H
 #define MSTRING_H
 
-#include "vector.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+#include "util.h"
 
 #define TERMINATOR '\0'
 
+// strings up to this length are stored inline, without touching the heap
+#define STRING_INLINE_CAPACITY 23
+
 struct string {
-    struct vector inner;
+    uint32_t len;
+    uint32_t capacity;  // heap capacity, 0 while the string is inline
+    union {
+        char* heap;
+        char inline_data[STRING_INLINE_CAPACITY + 1];
+    };
 };
 
 static inline void string_init(struct string* str) {
-    vec_init(&str->inner, 1);
+    str->len = 0;
+    str->capacity = 0;
+    str->inline_data[0] = TERMINATOR;
+}
+
+static inline int string_is_inline(struct string* str) {
+    return str->capacity == 0;
 }
 
 static inline char* string_ptr(struct string* str) {
-    return str->inner.data;
+    return string_is_inline(str) ? str->inline_data : str->heap;
 }
 
 static inline uint32_t string_len(struct string* str) {
-    uint32_t size = str->inner.size;
-    return size == 0 ? 0 : size - 1;
+    return str->len;
 }
 
-static inline struct vector* string_as_vec(struct string* str) {
-    return &str->inner;
-}
+static inline void string_reserve(struct string* str, uint32_t len) {
+    if (string_is_inline(str) ? len <= STRING_INLINE_CAPACITY : len < str->capacity)
+        return;
 
-static inline void string_add_terminator(struct string* str) {
-    char term = TERMINATOR;
-    vec_push(&str->inner, &term);
-}
+    uint32_t new_capacity = next_power_of_2(len + 1);
+    new_capacity = new_capacity < 32 ? 32 : new_capacity;
+
+    if (string_is_inline(str)) {
+        char* data = malloc(new_capacity);
+        if (!data)
+            panic("string_reserve: failed to allocate memory");
+
+        memcpy(data, str->inline_data, str->len + 1);
+        str->heap = data;
+    } else {
+        char* data = realloc(str->heap, new_capacity);
+        if (!data)
+            panic("string_reserve: failed to allocate memory");
 
-static inline void string_strip_terminator(struct string* str) {
-    char* back = vec_back(&str->inner);
-    if (back && *back == TERMINATOR)
-        str->inner.size -= 1;
+        str->heap = data;
+    }
+
+    str->capacity = new_capacity;
 }
 
 static inline void string_push(struct string* str, char c) {
-    string_strip_terminator(str);
-    *(char*)vec_emplace(&str->inner) = c;
-    string_add_terminator(str);
+    string_reserve(str, str->len + 1);
+
+    char* data = string_ptr(str);
+    data[str->len++] = c;
+    data[str->len] = TERMINATOR;
 }
 
 static inline void string_append(struct string* str, const char* s, uint32_t count) {
-    string_strip_terminator(str);
-    vec_extend(&str->inner, s, count);
-    string_add_terminator(str);
+    if (!s || !count)
+        return;
+
+    string_reserve(str, str->len + count);
+
+    char* data = string_ptr(str);
+    memcpy(data + str->len, s, count);
+    str->len += count;
+    data[str->len] = TERMINATOR;
 }
 
 static inline void string_pop(struct string* str, uint32_t count) {
-    string_strip_terminator(str);
+    if (count > str->len)
+        count = str->len;
 
-    if (count > str->inner.size)
-        count = str->inner.size;
-
-    str->inner.size -= count;
-    string_add_terminator(str);
+    str->len -= count;
+    string_ptr(str)[str->len] = TERMINATOR;
 }
 
 static inline void string_pop_until(struct string* str, char c) {
-    string_strip_terminator(str);
+    char* data = string_ptr(str);
 
-    while (str->inner.size && *(char*)vec_back(&str->inner) != c)
-        str->inner.size--;
+    while (str->len && data[str->len - 1] != c)
+        str->len--;
 
-    string_add_terminator(str);
+    data[str->len] = TERMINATOR;
 }
 
 static inline void string_clone(struct string* src, struct string* dst) {
-    vec_clone(&src->inner, &dst->inner);
+    string_init(dst);
+    string_append(dst, string_ptr(src), src->len);
 }
 
 static inline void string_uninit(struct string* str) {
-    vec_uninit(&str->inner);
+    if (!string_is_inline(str))
+        free(str->heap);
+
+    string_init(str);
+}
+
+// Interned strings are unique for the lifetime of the program (or until string_intern_clear), so
+// two interned pointers are equal if and only if their contents are equal.
+static struct map Interner = {0};
+
+static inline const char* string_intern(const char* s) {
+    if (Interner.hash == nullptr)
+        map_init(&Interner, str_comparator, str_hasher);
+
+    struct map_entry* entry = map_find(&Interner, (void*)s);
+    if (entry)
+        return entry->key;
+
+    uint32_t len = strlen(s);
+    char* key = malloc(len + 1);
+    if (!key)
+        panic("string_intern: failed to allocate memory");
+
+    memcpy(key, s, len + 1);
+    map_insert(&Interner, key, key);
+
+    return key;
+}
+
+static inline const char* string_intern_n(const char* s, uint32_t len) {
+    struct string temp;
+    string_init(&temp);
+    string_append(&temp, s, len);
+
+    const char* interned = string_intern(string_ptr(&temp));
+
+    string_uninit(&temp);
+    return interned;
+}
+
+static inline void _string_intern_free_key(void* entry) {
+    free(((struct map_entry*)entry)->key);
+}
+
+static inline void string_intern_clear() {
+    if (Interner.hash == nullptr)
+        return;
+
+    map_for_each(&Interner, _string_intern_free_key);
+    map_uninit(&Interner);
+    Interner = (struct map){0};
 }
 
 #endif
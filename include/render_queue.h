@@ -0,0 +1,121 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "util.h"
+#include "vector.h"
+
+// Draws are collected as (key, index) pairs and sorted by key before submission. The key packs,
+// from most to least significant, the state that is most expensive to change:
+//
+//   program (8 bits) | material (16 bits) | vertex array (12 bits) | depth (28 bits)
+//
+// so a sorted queue switches programs as rarely as possible, then materials, then VAOs, and draws
+// front to back within the same state. Fields wider than their slot wrap around, which only costs
+// some extra state changes, never correctness.
+
+#define DRAW_KEY_PROGRAM_BITS 8
+#define DRAW_KEY_MATERIAL_BITS 16
+#define DRAW_KEY_VAO_BITS 12
+#define DRAW_KEY_DEPTH_BITS 28
+
+struct draw_item {
+    uint64_t key;
+    uint32_t index;  // caller defined, usually the mesh or draw to submit
+};
+
+struct render_queue {
+    struct vector items;
+    struct vector scratch;
+};
+
+// depth must be >= 0, negative values are clamped
+static inline uint64_t draw_key(uint32_t program, uint32_t material, uint32_t vao, float depth) {
+    // the bit pattern of a non-negative float grows with its value, keep the top bits of it
+    uint32_t depth_bits = 0;
+    if (depth > 0)
+        memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    depth_bits >>= 31 - DRAW_KEY_DEPTH_BITS;
+
+    uint64_t key = program & ((1u << DRAW_KEY_PROGRAM_BITS) - 1);
+    key = key << DRAW_KEY_MATERIAL_BITS | (material & ((1u << DRAW_KEY_MATERIAL_BITS) - 1));
+    key = key << DRAW_KEY_VAO_BITS | (vao & ((1u << DRAW_KEY_VAO_BITS) - 1));
+    key = key << DRAW_KEY_DEPTH_BITS | (depth_bits & ((1u << DRAW_KEY_DEPTH_BITS) - 1));
+
+    return key;
+}
+
+static inline void render_queue_init(struct render_queue* q) {
+    vec_init(&q->items, sizeof(struct draw_item));
+    vec_init(&q->scratch, sizeof(struct draw_item));
+}
+
+static inline void render_queue_clear(struct render_queue* q) {
+    q->items.size = 0;
+}
+
+static inline void render_queue_push(struct render_queue* q, uint64_t key, uint32_t index) {
+    struct draw_item item = {key, index};
+    vec_push(&q->items, &item);
+}
+
+static inline struct draw_item* render_queue_items(struct render_queue* q) {
+    return q->items.data;
+}
+
+static inline uint32_t render_queue_size(struct render_queue* q) {
+    return q->items.size;
+}
+
+// Stable LSD radix sort on the keys, one byte per pass. Passes where every key has the same byte
+// are skipped, which for a handful of programs and materials leaves only a few of the eight.
+static inline void render_queue_sort(struct render_queue* q) {
+    uint32_t count = q->items.size;
+    if (count < 2)
+        return;
+
+    vec_resize(&q->scratch, count);
+
+    uint32_t histograms[8][256] = {0};
+    struct draw_item* items = q->items.data;
+    for (uint32_t i = 0; i < count; i++)
+        for (uint32_t pass = 0; pass < 8; pass++)
+            histograms[pass][(items[i].key >> (pass * 8)) & 0xFF]++;
+
+    struct draw_item* src = q->items.data;
+    struct draw_item* dst = q->scratch.data;
+
+    for (uint32_t pass = 0; pass < 8; pass++) {
+        uint32_t* histogram = histograms[pass];
+        uint32_t shift = pass * 8;
+
+        if (histogram[(src[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t n = histogram[i];
+            histogram[i] = offset;
+            offset += n;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+        struct draw_item* t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != q->items.data)
+        memcpy(q->items.data, src, count * sizeof(struct draw_item));
+}
+
+static inline void render_queue_uninit(struct render_queue* q) {
+    vec_uninit(&q->scratch);
+    vec_uninit(&q->items);
+}
+
+#endif
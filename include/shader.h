@@ -2,12 +2,18 @@
 #define SHADER_H
 
 #include "gl_loader.h"
+#include "map.h"
 #include "mmath.h"
 #include "mstring.h"
 #include "util.h"
 
 struct shader {
     GLuint program;
+    struct map uniforms;  // interned uniform name -> location
+
+    // looked up once at init, shader_set_model and shader_set_transform run for every object
+    GLint model_location, normal_matrix_location;
+    GLint view_location, projection_location;
 };
 
 struct dir_light {
@@ -101,6 +107,7 @@ static inline GLuint link_shaders(GLuint vertex, GLuint fragment) {
 
 static inline void shader_init(struct shader* shader, const char* vertex, const char* fragment) {
     shader->program = 0;
+    map_init(&shader->uniforms, ptr_comparator, ptr_hasher);
 
     GLuint vertex_shader = compile_shader(vertex, GL_VERTEX_SHADER);
     GLuint fragment_shader = compile_shader(fragment, GL_FRAGMENT_SHADER);
@@ -110,6 +117,10 @@ static inline void shader_init(struct shader* shader, const char* vertex, const
     glDeleteShader(fragment_shader);
 
     shader->program = program;
+    shader->model_location = glGetUniformLocation(program, "model");
+    shader->normal_matrix_location = glGetUniformLocation(program, "normalMatrix");
+    shader->view_location = glGetUniformLocation(program, "view");
+    shader->projection_location = glGetUniformLocation(program, "projection");
 }
 
 static inline void shader_activate(struct shader* shader) {
@@ -120,199 +131,298 @@ static inline void shader_deactivate() {
     glUseProgram(0);
 }
 
+// Caches the location of name. Every call interns name, which hashes and compares the whole
+// string, and so does every setter taking a name. Anything set every frame or every draw should
+// keep the location and use the shader_set_*_at functions instead.
+static inline GLint shader_location(struct shader* shader, const char* name) {
+    const char* key = string_intern(name);
+
+    struct map_entry* entry = map_find(&shader->uniforms, (void*)key);
+    if (entry)
+        return (GLint)(intptr_t)entry->item;
+
+    GLint location = glGetUniformLocation(shader->program, key);
+    map_insert(&shader->uniforms, (void*)key, (void*)(intptr_t)location);
+
+    return location;
+}
+
+static inline void shader_set_int_at(GLint location, int value) {
+    glUniform1i(location, value);
+}
+
+static inline void shader_set_float_at(GLint location, float value) {
+    glUniform1f(location, value);
+}
+
+static inline void shader_set_vec3_at(GLint location, vec3 vec) {
+    glUniform3f(location, vec.x, vec.y, vec.z);
+}
+
+static inline void shader_set_vec4_at(GLint location, vec4 vec) {
+    glUniform4f(location, vec.x, vec.y, vec.z, vec.w);
+}
+
+static inline void shader_set_mat3_at(GLint location, mat3* mat) {
+    glUniformMatrix3fv(location, 1, GL_FALSE, (float*)mat);
+}
+
+static inline void shader_set_mat4_at(GLint location, mat4* mat) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, (float*)mat);
+}
+
 static inline void shader_set_int(struct shader* shader, const char* name, int value) {
-    glUniform1i(glGetUniformLocation(shader->program, name), value);
+    shader_set_int_at(shader_location(shader, name), value);
 }
 
 static inline void shader_set_float(struct shader* shader, const char* name, float value) {
-    glUniform1f(glGetUniformLocation(shader->program, name), value);
+    shader_set_float_at(shader_location(shader, name), value);
 }
 
 static inline void shader_set_vec3(struct shader* shader, const char* name, vec3 vec) {
-    glUniform3f(glGetUniformLocation(shader->program, name), vec.x, vec.y, vec.z);
+    shader_set_vec3_at(shader_location(shader, name), vec);
+}
+
+static inline void shader_set_vec4(struct shader* shader, const char* name, vec4 vec) {
+    shader_set_vec4_at(shader_location(shader, name), vec);
 }
 
 static inline void shader_set_mat3(struct shader* shader, const char* name, mat3* mat) {
-    glUniformMatrix3fv(glGetUniformLocation(shader->program, name), 1, GL_FALSE, (float*)mat);
+    shader_set_mat3_at(shader_location(shader, name), mat);
 }
 
 static inline void shader_set_mat4(struct shader* shader, const char* name, mat4* mat) {
-    glUniformMatrix4fv(glGetUniformLocation(shader->program, name), 1, GL_FALSE, (float*)mat);
+    shader_set_mat4_at(shader_location(shader, name), mat);
 }
 
-static inline void shader_set_material(struct shader* shader,
-                                       const char* name,
-                                       struct material* material) {
-    struct string temp;
-    string_init(&temp);
-    string_append(&temp, name, strlen(name));
+// Locations of the members of a uniform struct, see shader_*_locations
+struct material_locations {
+    GLint ambient, diffuse, specular, shininess;
+};
 
-    string_append(&temp, ".ambient", 8);
-    shader_set_vec3(shader, string_ptr(&temp), material->ambient);
-    string_pop(&temp, 8);
+struct material_map_locations {
+    GLint diffuse, specular, shininess;
+};
 
-    string_append(&temp, ".diffuse", 8);
-    shader_set_vec3(shader, string_ptr(&temp), material->diffuse);
-    string_pop(&temp, 8);
+struct point_light_locations {
+    GLint pos, ambient, diffuse, specular;
+    GLint constant, linear, quadratic;
+};
 
-    string_append(&temp, ".specular", 9);
-    shader_set_vec3(shader, string_ptr(&temp), material->specular);
-    string_pop(&temp, 9);
+struct dir_light_locations {
+    GLint dir, ambient, diffuse, specular;
+};
 
-    string_append(&temp, ".shininess", 10);
-    shader_set_float(shader, string_ptr(&temp), material->shininess);
-    string_pop(&temp, 10);
+struct spot_light_locations {
+    GLint pos, dir, ambient, diffuse, specular;
+    GLint constant, linear, quadratic;
+    GLint cutoff, outerCutoff;
+};
 
-    string_uninit(&temp);
+// the location of member appended to the struct name in temp
+static inline GLint _shader_member(struct shader* shader, struct string* temp, const char* member) {
+    uint32_t length = strlen(member);
+    string_append(temp, member, length);
+    GLint location = shader_location(shader, string_ptr(temp));
+    string_pop(temp, length);
+
+    return location;
 }
 
-static inline void shader_set_material_map(struct shader* shader,
-                                           const char* name,
-                                           struct material_map* material) {
+static inline void shader_material_locations(struct shader* shader,
+                                             const char* name,
+                                             struct material_locations* out) {
     struct string temp;
     string_init(&temp);
     string_append(&temp, name, strlen(name));
 
-    string_append(&temp, ".diffuse", 8);
-    shader_set_int(shader, string_ptr(&temp), material->diffuse_sampler);
-    string_pop(&temp, 8);
-
-    string_append(&temp, ".specular", 9);
-    shader_set_int(shader, string_ptr(&temp), material->specular_sampler);
-    string_pop(&temp, 9);
-
-    string_append(&temp, ".shininess", 10);
-    shader_set_float(shader, string_ptr(&temp), material->shininess);
-    string_pop(&temp, 10);
+    out->ambient = _shader_member(shader, &temp, ".ambient");
+    out->diffuse = _shader_member(shader, &temp, ".diffuse");
+    out->specular = _shader_member(shader, &temp, ".specular");
+    out->shininess = _shader_member(shader, &temp, ".shininess");
 
     string_uninit(&temp);
 }
 
-static inline void shader_set_point_light(struct shader* shader,
-                                          const char* name,
-                                          struct point_light* light) {
+static inline void shader_material_map_locations(struct shader* shader,
+                                                 const char* name,
+                                                 struct material_map_locations* out) {
     struct string temp;
     string_init(&temp);
     string_append(&temp, name, strlen(name));
 
-    string_append(&temp, ".pos", 4);
-    shader_set_vec3(shader, string_ptr(&temp), light->pos);
-    string_pop(&temp, 4);
-
-    string_append(&temp, ".ambient", 8);
-    shader_set_vec3(shader, string_ptr(&temp), light->ambient);
-    string_pop(&temp, 8);
-
-    string_append(&temp, ".diffuse", 8);
-    shader_set_vec3(shader, string_ptr(&temp), light->diffuse);
-    string_pop(&temp, 8);
-
-    string_append(&temp, ".specular", 9);
-    shader_set_vec3(shader, string_ptr(&temp), light->specular);
-    string_pop(&temp, 9);
-
-    string_append(&temp, ".constant", 9);
-    shader_set_float(shader, string_ptr(&temp), light->constant);
-    string_pop(&temp, 9);
-
-    string_append(&temp, ".linear", 7);
-    shader_set_float(shader, string_ptr(&temp), light->linear);
-    string_pop(&temp, 7);
-
-    string_append(&temp, ".quadratic", 10);
-    shader_set_float(shader, string_ptr(&temp), light->quadratic);
-    string_pop(&temp, 10);
+    out->diffuse = _shader_member(shader, &temp, ".diffuse");
+    out->specular = _shader_member(shader, &temp, ".specular");
+    out->shininess = _shader_member(shader, &temp, ".shininess");
 
     string_uninit(&temp);
 }
 
-static inline void shader_set_directional_light(struct shader* shader,
+static inline void shader_point_light_locations(struct shader* shader,
                                                 const char* name,
-                                                struct dir_light* light) {
+                                                struct point_light_locations* out) {
     struct string temp;
     string_init(&temp);
     string_append(&temp, name, strlen(name));
 
-    string_append(&temp, ".dir", 4);
-    shader_set_vec3(shader, string_ptr(&temp), light->dir);
-    string_pop(&temp, 4);
+    out->pos = _shader_member(shader, &temp, ".pos");
+    out->ambient = _shader_member(shader, &temp, ".ambient");
+    out->diffuse = _shader_member(shader, &temp, ".diffuse");
+    out->specular = _shader_member(shader, &temp, ".specular");
+    out->constant = _shader_member(shader, &temp, ".constant");
+    out->linear = _shader_member(shader, &temp, ".linear");
+    out->quadratic = _shader_member(shader, &temp, ".quadratic");
 
-    string_append(&temp, ".ambient", 8);
-    shader_set_vec3(shader, string_ptr(&temp), light->ambient);
-    string_pop(&temp, 8);
+    string_uninit(&temp);
+}
 
-    string_append(&temp, ".diffuse", 8);
-    shader_set_vec3(shader, string_ptr(&temp), light->diffuse);
-    string_pop(&temp, 8);
+static inline void shader_dir_light_locations(struct shader* shader,
+                                              const char* name,
+                                              struct dir_light_locations* out) {
+    struct string temp;
+    string_init(&temp);
+    string_append(&temp, name, strlen(name));
 
-    string_append(&temp, ".specular", 9);
-    shader_set_vec3(shader, string_ptr(&temp), light->specular);
-    string_pop(&temp, 9);
+    out->dir = _shader_member(shader, &temp, ".dir");
+    out->ambient = _shader_member(shader, &temp, ".ambient");
+    out->diffuse = _shader_member(shader, &temp, ".diffuse");
+    out->specular = _shader_member(shader, &temp, ".specular");
 
     string_uninit(&temp);
 }
 
-static inline void shader_set_spot_light(struct shader* shader,
-                                         const char* name,
-                                         struct spot_light* light) {
+static inline void shader_spot_light_locations(struct shader* shader,
+                                               const char* name,
+                                               struct spot_light_locations* out) {
     struct string temp;
     string_init(&temp);
     string_append(&temp, name, strlen(name));
 
-    string_append(&temp, ".pos", 4);
-    shader_set_vec3(shader, string_ptr(&temp), light->pos);
-    string_pop(&temp, 4);
+    out->pos = _shader_member(shader, &temp, ".pos");
+    out->dir = _shader_member(shader, &temp, ".dir");
+    out->ambient = _shader_member(shader, &temp, ".ambient");
+    out->diffuse = _shader_member(shader, &temp, ".diffuse");
+    out->specular = _shader_member(shader, &temp, ".specular");
+    out->constant = _shader_member(shader, &temp, ".constant");
+    out->linear = _shader_member(shader, &temp, ".linear");
+    out->quadratic = _shader_member(shader, &temp, ".quadratic");
+    out->cutoff = _shader_member(shader, &temp, ".cutoff");
+    out->outerCutoff = _shader_member(shader, &temp, ".outerCutoff");
+
+    string_uninit(&temp);
+}
 
-    string_append(&temp, ".dir", 4);
-    shader_set_vec3(shader, string_ptr(&temp), light->dir);
-    string_pop(&temp, 4);
+static inline void shader_set_material_at(const struct material_locations* at,
+                                          struct material* material) {
+    shader_set_vec3_at(at->ambient, material->ambient);
+    shader_set_vec3_at(at->diffuse, material->diffuse);
+    shader_set_vec3_at(at->specular, material->specular);
+    shader_set_float_at(at->shininess, material->shininess);
+}
 
-    string_append(&temp, ".ambient", 8);
-    shader_set_vec3(shader, string_ptr(&temp), light->ambient);
-    string_pop(&temp, 8);
+static inline void shader_set_material_map_at(const struct material_map_locations* at,
+                                              struct material_map* material) {
+    shader_set_int_at(at->diffuse, material->diffuse_sampler);
+    shader_set_int_at(at->specular, material->specular_sampler);
+    shader_set_float_at(at->shininess, material->shininess);
+}
+
+static inline void shader_set_point_light_at(const struct point_light_locations* at,
+                                             struct point_light* light) {
+    shader_set_vec3_at(at->pos, light->pos);
+    shader_set_vec3_at(at->ambient, light->ambient);
+    shader_set_vec3_at(at->diffuse, light->diffuse);
+    shader_set_vec3_at(at->specular, light->specular);
+    shader_set_float_at(at->constant, light->constant);
+    shader_set_float_at(at->linear, light->linear);
+    shader_set_float_at(at->quadratic, light->quadratic);
+}
+
+static inline void shader_set_directional_light_at(const struct dir_light_locations* at,
+                                                   struct dir_light* light) {
+    shader_set_vec3_at(at->dir, light->dir);
+    shader_set_vec3_at(at->ambient, light->ambient);
+    shader_set_vec3_at(at->diffuse, light->diffuse);
+    shader_set_vec3_at(at->specular, light->specular);
+}
 
-    string_append(&temp, ".diffuse", 8);
-    shader_set_vec3(shader, string_ptr(&temp), light->diffuse);
-    string_pop(&temp, 8);
+static inline void shader_set_spot_light_at(const struct spot_light_locations* at,
+                                            struct spot_light* light) {
+    shader_set_vec3_at(at->pos, light->pos);
+    shader_set_vec3_at(at->dir, light->dir);
+    shader_set_vec3_at(at->ambient, light->ambient);
+    shader_set_vec3_at(at->diffuse, light->diffuse);
+    shader_set_vec3_at(at->specular, light->specular);
+    shader_set_float_at(at->constant, light->constant);
+    shader_set_float_at(at->linear, light->linear);
+    shader_set_float_at(at->quadratic, light->quadratic);
+    shader_set_float_at(at->cutoff, light->cutoff);
+    shader_set_float_at(at->outerCutoff, light->outerCutoff);
+}
 
-    string_append(&temp, ".specular", 9);
-    shader_set_vec3(shader, string_ptr(&temp), light->specular);
-    string_pop(&temp, 9);
+// The struct setters below look every member up by name, keep the locations for anything set
+// every frame
 
-    string_append(&temp, ".constant", 9);
-    shader_set_float(shader, string_ptr(&temp), light->constant);
-    string_pop(&temp, 9);
+static inline void shader_set_material(struct shader* shader,
+                                       const char* name,
+                                       struct material* material) {
+    struct material_locations at;
+    shader_material_locations(shader, name, &at);
+    shader_set_material_at(&at, material);
+}
 
-    string_append(&temp, ".linear", 7);
-    shader_set_float(shader, string_ptr(&temp), light->linear);
-    string_pop(&temp, 7);
+static inline void shader_set_material_map(struct shader* shader,
+                                           const char* name,
+                                           struct material_map* material) {
+    struct material_map_locations at;
+    shader_material_map_locations(shader, name, &at);
+    shader_set_material_map_at(&at, material);
+}
 
-    string_append(&temp, ".quadratic", 10);
-    shader_set_float(shader, string_ptr(&temp), light->quadratic);
-    string_pop(&temp, 10);
+static inline void shader_set_point_light(struct shader* shader,
+                                          const char* name,
+                                          struct point_light* light) {
+    struct point_light_locations at;
+    shader_point_light_locations(shader, name, &at);
+    shader_set_point_light_at(&at, light);
+}
 
-    string_append(&temp, ".cutoff", 7);
-    shader_set_float(shader, string_ptr(&temp), light->cutoff);
-    string_pop(&temp, 7);
+static inline void shader_set_directional_light(struct shader* shader,
+                                                const char* name,
+                                                struct dir_light* light) {
+    struct dir_light_locations at;
+    shader_dir_light_locations(shader, name, &at);
+    shader_set_directional_light_at(&at, light);
+}
 
-    string_append(&temp, ".outerCutoff", 12);
-    shader_set_float(shader, string_ptr(&temp), light->outerCutoff);
-    string_pop(&temp, 12);
+static inline void shader_set_spot_light(struct shader* shader,
+                                         const char* name,
+                                         struct spot_light* light) {
+    struct spot_light_locations at;
+    shader_spot_light_locations(shader, name, &at);
+    shader_set_spot_light_at(&at, light);
+}
 
-    string_uninit(&temp);
+// uploads the model matrix together with its normal matrix, so vertex shaders don't have to
+// compute transpose(inverse(model)) for every vertex
+static inline void shader_set_model(struct shader* shader, mat4* model) {
+    mat3 normal = mat4_normal_matrix(*model);
+    shader_set_mat4_at(shader->model_location, model);
+    shader_set_mat3_at(shader->normal_matrix_location, &normal);
 }
 
 static inline void shader_set_transform(struct shader* shader,
                                         mat4* model,
                                         mat4* view,
                                         mat4* projection) {
-    shader_set_mat4(shader, "model", model);
-    shader_set_mat4(shader, "view", view);
-    shader_set_mat4(shader, "projection", projection);
+    shader_set_model(shader, model);
+    shader_set_mat4_at(shader->view_location, view);
+    shader_set_mat4_at(shader->projection_location, projection);
 }
 
 static inline void shader_uninit(struct shader* shader) {
     glDeleteProgram(shader->program);
+    map_uninit(&shader->uniforms);
 }
 
 #endif
@@ -1,22 +1,239 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 
+#include "gl_caps.h"
 #include "gl_loader.h"
 #include "image.h"
+#include "job.h"
+#include "map.h"
 #include "mmath.h"
+#include "mstring.h"
+#include "texture_compress.h"
 
 struct texture {
     uint32_t width, height, channels;
     GLuint id;
+    const char* path;       // interned, nullptr for generated textures
+    const char* cache_key;  // interned, set when shared through the texture cache
 };
 
+struct texture_cache_entry {
+    struct texture tex;
+    uint32_t refs;
+};
+
+// Textures shared by path (or fallback colour) so every image is decoded and uploaded once, see
+// texture_acquire and texture_release.
+struct texture_cache {
+    struct map entries;  // interned key -> struct texture_cache_entry*
+    uint32_t hits, misses;
+};
+
+static struct texture_cache TextureCache = {0};
+
+#define TEXTURE_STREAM_SLOTS 4
+
+enum texture_stream_state {
+    TEXTURE_STREAM_DECODING,  // decode job running
+    TEXTURE_STREAM_WAITING,   // decoded, waiting for a free pixel buffer
+    TEXTURE_STREAM_COPYING,   // copy job writing into the mapped pixel buffer
+};
+
+// A pixel unpack buffer in the upload ring, reused once the GPU has consumed its last upload
+struct texture_stream_slot {
+    GLuint pbo;
+    uint32_t capacity;
+    int mapped;    // a copy job is writing into it
+    GLsync fence;  // last upload from it, nullptr once the GPU is done with it
+};
+
+struct texture_stream_request {
+    struct texture* target;  // nullptr once the texture was released before it finished
+    GLuint id;
+    const char* path;
+    uint32_t channels;  // of the source, img is expanded to RGBA
+
+    // Set by the decode and copy jobs once they are finished with the request. Job slots are
+    // recycled, so polling the job itself across frames could end up watching another one.
+    enum texture_stream_state state;
+    atomic_int done;
+    int loaded;
+
+    // decoded pixels, or the block compressed mip chain when compressed is set
+    int compressed;
+    struct image img;
+    struct compressed_image bc;
+
+    uint32_t slot;
+    void* mapped;
+};
+
+// Streams textures in without stalling the GL thread: decoding and the copy into a mapped pixel
+// buffer run on the job system, the GL thread only issues the upload from the buffer. See
+// texture_stream_init and texture_load_async.
+struct texture_streamer {
+    struct texture_stream_slot slots[TEXTURE_STREAM_SLOTS];
+    struct vector requests;  // struct texture_stream_request*, jobs hold on to them
+    int active;
+    uint32_t uploaded;
+};
+
+static struct texture_streamer TextureStreamer = {0};
+
+// Time the GL thread spends allocating and uploading textures, the driver may finish the copy
+// later on its own
+struct texture_upload_stats {
+    uint32_t count;
+    uint64_t bytes;
+    double ms;
+};
+
+static struct texture_upload_stats TextureUploads = {0};
+
+// Immutable storage needs GL 4.2 or ARB_texture_storage, the 3.3 context gets it as an extension
+// on most drivers. Build with TEXTURE_NO_STORAGE to always use glTexImage2D.
+static inline int _texture_has_storage() {
+#ifdef TEXTURE_NO_STORAGE
+    return 0;
+#else
+    static int supported = -1;
+    if (supported >= 0)
+        return supported;
+
+    supported = gl_has_version(4, 2) || gl_has_extension("GL_ARB_texture_storage");
+
+    return supported;
+#endif
+}
+
+// BC1/BC3 are not core, but every desktop driver has them. Build with TEXTURE_NO_COMPRESSION to
+// keep all textures uncompressed.
+static inline int _texture_has_compression() {
+#ifdef TEXTURE_NO_COMPRESSION
+    return 0;
+#else
+    static int supported = -1;
+    if (supported < 0)
+        supported = gl_has_extension("GL_EXT_texture_compression_s3tc");
+
+    return supported;
+#endif
+}
+
+static inline uint32_t _texture_levels(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    for (uint32_t size = width > height ? width : height; size > 1; size >>= 1)
+        levels++;
+
+    return levels;
+}
+
+// Allocates every mip level of the bound texture up front as RGBA8, so neither the upload nor
+// glGenerateMipmap make the driver reallocate.
+static inline void _texture_allocate(uint32_t width, uint32_t height) {
+    if (_texture_has_storage()) {
+        glTexStorage2D(GL_TEXTURE_2D, _texture_levels(width, height), GL_RGBA8, width, height);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     nullptr);
+    }
+}
+
+// Uploads RGBA8 pixels, from client memory or an offset into the bound unpack buffer, into
+// storage from _texture_allocate and builds the mip chain.
+static inline void _texture_upload(uint32_t width, uint32_t height, const void* pixels) {
+    double start = time_now();
+
+    _texture_allocate(width, height);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    TextureUploads.count++;
+    TextureUploads.bytes += (uint64_t)width * height * 4;
+    TextureUploads.ms += (time_now() - start) * 1000;
+}
+
+static inline GLenum _texture_compressed_format(enum texture_compression compression) {
+    return compression == TEXTURE_COMPRESSION_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                                   : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+// Uploads a compressed mip chain, from client memory or with data an offset into the bound unpack
+// buffer. Nothing to generate, every level is already there.
+static inline void _texture_upload_compressed(const struct compressed_image* img,
+                                              const uint8_t* data) {
+    double start = time_now();
+
+    GLenum format = _texture_compressed_format(img->compression);
+    int storage = _texture_has_storage();
+    if (storage)
+        glTexStorage2D(GL_TEXTURE_2D, img->levels, format, img->width, img->height);
+
+    for (uint32_t i = 0, w = img->width, h = img->height; i < img->levels; i++) {
+        GLsizei size = img->offsets[i + 1] - img->offsets[i];
+        if (storage)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, w, h, format, size,
+                                      data + img->offsets[i]);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format, w, h, 0, size,
+                                   data + img->offsets[i]);
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    TextureUploads.count++;
+    TextureUploads.bytes += img->offsets[img->levels];
+    TextureUploads.ms += (time_now() - start) * 1000;
+}
+
+// Widens 3 channel images to 4, RGB rows are not 4 byte aligned and take slow unpack paths.
+// Returns 0 for channel counts textures don't support.
+static inline int _texture_expand_rgba(struct image* img) {
+    if (img->channels == 4)
+        return 1;
+    if (img->channels != 3)
+        return 0;
+
+    uint32_t count = img->width * img->height;
+    uint8_t* rgba = malloc(count * 4);
+    if (!rgba)
+        panic("texture: failed to allocate memory");
+
+    for (uint32_t i = 0; i < count; i++) {
+        rgba[i * 4 + 0] = img->data[i * 3 + 0];
+        rgba[i * 4 + 1] = img->data[i * 3 + 1];
+        rgba[i * 4 + 2] = img->data[i * 3 + 2];
+        rgba[i * 4 + 3] = 255;
+    }
+
+    free(img->data);
+    img->data = rgba;
+    img->channels = 4;
+    return 1;
+}
+
+static inline void _texture_target_parameters(GLenum target) {
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+static inline void _texture_parameters() {
+    _texture_target_parameters(GL_TEXTURE_2D);
+}
+
 static inline void texture_load_image(struct texture* tex, const char* path) {
     tex->width = 0;
     tex->height = 0;
     tex->channels = 0;
     tex->id = 0;
+    tex->path = string_intern(path);
+    tex->cache_key = nullptr;
 
     struct image img;
 
@@ -24,62 +241,498 @@ static inline void texture_load_image(struct texture* tex, const char* path) {
     if (!ret)
         panic("texture_load_image: failed to load image %s", path);
 
+    uint32_t channels = img.channels;
+    if (!_texture_expand_rgba(&img)) {
+        image_uninit(&img);
+        panic("texture_load_image: image has invalid format channels %d", channels);
+    }
+
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int format = 0;
-    switch (img.channels) {
-        case 3:
-            format = GL_RGB;
-            break;
-        case 4:
-            format = GL_RGBA;
-            break;
-
-        case 1:
-        case 2:
-        default:
-            image_uninit(&img);
-            panic("texture_load_image: image has invalid format channels %d", img.channels);
-    };
-
-    glTexImage2D(GL_TEXTURE_2D, 0, format, img.width, img.height, 0, format, GL_UNSIGNED_BYTE,
-                 img.data);
-
-    glGenerateMipmap(GL_TEXTURE_2D);
+    _texture_parameters();
+    _texture_upload(img.width, img.height, img.data);
 
     tex->width = img.width;
     tex->height = img.height;
-    tex->channels = img.channels;
+    tex->channels = channels;
     tex->id = texture;
 
     image_uninit(&img);
 }
 
+// Like texture_load_image, but uploads the image block compressed, 4-8x smaller on the GPU. The
+// compressed mip chain is cached next to the image, see texture_compress_cached. Falls back to
+// texture_load_image when the GPU can't sample BC1/BC3.
+static inline void texture_load_compressed(struct texture* tex, const char* path) {
+    if (!_texture_has_compression()) {
+        texture_load_image(tex, path);
+        return;
+    }
+
+    struct compressed_image img;
+    if (!texture_compress_cached(&img, path))
+        panic("texture_load_compressed: failed to load image %s", path);
+
+    *tex = (struct texture){
+        .width = img.width,
+        .height = img.height,
+        .channels = img.compression == TEXTURE_COMPRESSION_BC1 ? 3 : 4,
+        .path = string_intern(path),
+    };
+
+    glGenTextures(1, &tex->id);
+    glBindTexture(GL_TEXTURE_2D, tex->id);
+
+    _texture_parameters();
+    _texture_upload_compressed(&img, img.data);
+
+    compressed_image_uninit(&img);
+}
+
 static inline void texture_create_fallback(struct texture* tex, vec4 color) {
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_FLOAT, &color);
+    _texture_parameters();
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    _texture_allocate(1, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_FLOAT, &color);
 
     tex->width = 1;
     tex->height = 1;
     tex->channels = 4;
     tex->id = texture;
+    tex->path = nullptr;
+    tex->cache_key = nullptr;
+}
+
+// ================ STREAMING ================
+
+// Starts streaming for texture_load_async, textures loaded before keep loading synchronously.
+// Decoding runs on the job system, inline if it was not started.
+static inline void texture_stream_init() {
+    TextureStreamer = (struct texture_streamer){.active = 1};
+    vec_init(&TextureStreamer.requests, sizeof(struct texture_stream_request*));
+
+    for (uint32_t i = 0; i < TEXTURE_STREAM_SLOTS; i++)
+        glGenBuffers(1, &TextureStreamer.slots[i].pbo);
+}
+
+static inline void _texture_stream_decode(void* arg) {
+    struct texture_stream_request* req = arg;
+
+    if (req->compressed) {
+        req->loaded = texture_compress_cached(&req->bc, req->path);
+        req->channels = req->bc.compression == TEXTURE_COMPRESSION_BC1 ? 3 : 4;
+    } else {
+        req->loaded = image_load(req->path, &req->img);
+        req->channels = req->img.channels;
+
+        if (req->loaded)
+            req->loaded = _texture_expand_rgba(&req->img);
+    }
+
+    atomic_store_explicit(&req->done, 1, memory_order_release);
+}
+
+static inline uint32_t _texture_stream_size(struct texture_stream_request* req) {
+    if (req->compressed)
+        return req->bc.offsets[req->bc.levels];
+
+    return req->img.width * req->img.height * req->img.channels;
+}
+
+static inline void _texture_stream_copy(void* arg) {
+    struct texture_stream_request* req = arg;
+    memcpy(req->mapped, req->compressed ? req->bc.data : req->img.data, _texture_stream_size(req));
+    atomic_store_explicit(&req->done, 1, memory_order_release);
+}
+
+static inline int _texture_stream_done(struct texture_stream_request* req) {
+    return atomic_load_explicit(&req->done, memory_order_acquire);
+}
+
+// Like texture_load_image (or texture_load_compressed with compressed set), but returns right
+// away once streaming is on. The texture name is valid immediately and samples as black until the
+// upload lands in a later texture_stream_update. tex must stay at the same address until then,
+// copies of it share the texture but keep a zero size.
+static inline void texture_load_async(struct texture* tex, const char* path, int compressed) {
+    compressed = compressed && _texture_has_compression();
+
+    if (!TextureStreamer.active) {
+        if (compressed)
+            texture_load_compressed(tex, path);
+        else
+            texture_load_image(tex, path);
+        return;
+    }
+
+    *tex = (struct texture){.path = string_intern(path)};
+    glGenTextures(1, &tex->id);
+    glBindTexture(GL_TEXTURE_2D, tex->id);
+    _texture_parameters();
+
+    struct texture_stream_request* req = malloc(sizeof(struct texture_stream_request));
+    if (!req)
+        panic("texture_load_async: failed to allocate memory");
+
+    *req = (struct texture_stream_request){
+        .target = tex,
+        .id = tex->id,
+        .path = tex->path,
+        .state = TEXTURE_STREAM_DECODING,
+        .compressed = compressed,
+    };
+    atomic_init(&req->done, 0);
+    vec_push(&TextureStreamer.requests, &req);
+
+    job_run(job_create(_texture_stream_decode, req));
+}
+
+static inline int _texture_stream_slot_free(struct texture_stream_slot* slot) {
+    if (slot->mapped)
+        return 0;
+    if (!slot->fence)
+        return 1;
+
+    GLenum status = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return 0;
+
+    glDeleteSync(slot->fence);
+    slot->fence = nullptr;
+    return 1;
+}
+
+// Maps a free pixel buffer for the decoded image and hands the copy to a job. Returns 0 while
+// every buffer is still in use by the GPU.
+static inline int _texture_stream_map(struct texture_stream_request* req) {
+    for (uint32_t i = 0; i < TEXTURE_STREAM_SLOTS; i++) {
+        struct texture_stream_slot* slot = &TextureStreamer.slots[i];
+        if (!_texture_stream_slot_free(slot))
+            continue;
+
+        uint32_t size = _texture_stream_size(req);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+        if (size > slot->capacity) {
+            slot->capacity = size;
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        }
+
+        // the fence already guarantees the GPU is done with the old contents
+        req->mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                                           GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!req->mapped)
+            panic("texture_stream: failed to map pixel buffer");
+
+        slot->mapped = 1;
+        req->slot = i;
+        atomic_store_explicit(&req->done, 0, memory_order_relaxed);
+        job_run(job_create(_texture_stream_copy, req));
+        return 1;
+    }
+
+    return 0;
+}
+
+static inline void _texture_stream_upload(struct texture_stream_request* req) {
+    struct texture_stream_slot* slot = &TextureStreamer.slots[req->slot];
+    struct image* img = &req->img;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // the pixels come from the bound buffer, the pointer is an offset into it
+    if (req->id) {
+        glBindTexture(GL_TEXTURE_2D, req->id);
+        if (req->compressed)
+            _texture_upload_compressed(&req->bc, (const uint8_t*)0);
+        else
+            _texture_upload(img->width, img->height, (void*)0);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    slot->mapped = 0;
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    if (req->target) {
+        req->target->width = req->compressed ? req->bc.width : img->width;
+        req->target->height = req->compressed ? req->bc.height : img->height;
+        req->target->channels = req->channels;
+    }
+
+    TextureStreamer.uploaded++;
+}
+
+// Advances every pending texture, call it once per frame on the GL thread. Returns the number of
+// textures still in flight.
+static inline uint32_t texture_stream_update() {
+    if (!TextureStreamer.active)
+        return 0;
+
+    struct texture_stream_request** requests = TextureStreamer.requests.data;
+    uint32_t pending = 0;
+
+    for (uint32_t i = 0; i < TextureStreamer.requests.size; i++) {
+        struct texture_stream_request* req = requests[i];
+        int done = 0;
+
+        if (req->state == TEXTURE_STREAM_DECODING && _texture_stream_done(req)) {
+            if (!req->loaded)
+                panic("texture_load_async: failed to load image %s", req->path);
+
+            req->state = TEXTURE_STREAM_WAITING;
+        }
+
+        if (req->state == TEXTURE_STREAM_WAITING && _texture_stream_map(req))
+            req->state = TEXTURE_STREAM_COPYING;
+        else if (req->state == TEXTURE_STREAM_COPYING && _texture_stream_done(req)) {
+            _texture_stream_upload(req);
+            if (req->compressed)
+                compressed_image_uninit(&req->bc);
+            else
+                image_uninit(&req->img);
+            free(req);
+            done = 1;
+        }
+
+        if (!done)
+            requests[pending++] = req;
+    }
+
+    TextureStreamer.requests.size = pending;
+    return pending;
+}
+
+// Blocks until every pending texture is uploaded
+static inline void texture_stream_finish() {
+    while (texture_stream_update())
+        sched_yield();
+}
+
+// forgets a texture that is deleted before its upload finished
+static inline void _texture_stream_cancel(struct texture* tex) {
+    struct texture_stream_request** requests = TextureStreamer.requests.data;
+    for (uint32_t i = 0; i < TextureStreamer.requests.size; i++)
+        if (requests[i]->id == tex->id) {
+            requests[i]->target = nullptr;
+            requests[i]->id = 0;
+        }
+}
+
+static inline void texture_stream_uninit() {
+    if (!TextureStreamer.active)
+        return;
+
+    texture_stream_finish();
+
+    for (uint32_t i = 0; i < TEXTURE_STREAM_SLOTS; i++) {
+        struct texture_stream_slot* slot = &TextureStreamer.slots[i];
+        if (slot->fence)
+            glDeleteSync(slot->fence);
+        glDeleteBuffers(1, &slot->pbo);
+    }
+
+    vec_uninit(&TextureStreamer.requests);
+    TextureStreamer = (struct texture_streamer){0};
+}
+
+// ================ ARRAYS ================
+
+// Same sized images as the layers of one GL_TEXTURE_2D_ARRAY, so draws sampling different ones
+// only change a layer index instead of rebinding textures. Layers are RGBA8 or block compressed.
+struct texture_array {
+    GLuint id;
+    uint32_t width, height, layers, levels;
+    GLenum format;
+};
+
+// Allocates layers of width x height with levels mip levels, 0 for the full chain
+static inline void texture_array_init(struct texture_array* arr,
+                                      uint32_t width,
+                                      uint32_t height,
+                                      uint32_t layers,
+                                      uint32_t levels,
+                                      GLenum format) {
+    uint32_t full = _texture_levels(width, height);
+    *arr = (struct texture_array){
+        .width = width,
+        .height = height,
+        .layers = layers,
+        .levels = levels == 0 || levels > full ? full : levels,
+        .format = format,
+    };
+
+    glGenTextures(1, &arr->id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arr->id);
+    _texture_target_parameters(GL_TEXTURE_2D_ARRAY);
+
+    if (_texture_has_storage()) {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, arr->levels, format, width, height, layers);
+        return;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, arr->levels - 1);
+    for (uint32_t i = 0, w = width, h = height; i < arr->levels; i++) {
+        if (format == GL_RGBA8) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, i, format, w, h, layers, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, nullptr);
+        } else {
+            uint32_t block = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+            GLsizei size = ((w + 3) / 4) * ((h + 3) / 4) * block * layers;
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, format, w, h, layers, 0, size, nullptr);
+        }
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+}
+
+// Uploads the top level of an RGBA8 layer, see texture_array_generate_mipmaps
+static inline void texture_array_set_layer(struct texture_array* arr,
+                                           uint32_t layer,
+                                           const uint8_t* pixels) {
+    double start = time_now();
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arr->id);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, arr->width, arr->height, 1, GL_RGBA,
+                    GL_UNSIGNED_BYTE, pixels);
+
+    TextureUploads.count++;
+    TextureUploads.bytes += (uint64_t)arr->width * arr->height * 4;
+    TextureUploads.ms += (time_now() - start) * 1000;
+}
+
+// Uploads every level of a compressed layer, img must match the array's size and format
+static inline void texture_array_set_layer_compressed(struct texture_array* arr,
+                                                      uint32_t layer,
+                                                      const struct compressed_image* img) {
+    double start = time_now();
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arr->id);
+    uint32_t levels = img->levels < arr->levels ? img->levels : arr->levels;
+    for (uint32_t i = 0, w = img->width, h = img->height; i < levels; i++) {
+        GLsizei size = img->offsets[i + 1] - img->offsets[i];
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, w, h, 1, arr->format, size,
+                                  img->data + img->offsets[i]);
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    TextureUploads.count++;
+    TextureUploads.bytes += img->offsets[levels];
+    TextureUploads.ms += (time_now() - start) * 1000;
+}
+
+// Builds the mip chains of RGBA8 arrays once every layer is set
+static inline void texture_array_generate_mipmaps(struct texture_array* arr) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arr->id);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+static inline void texture_array_bind(struct texture_array* arr, int index) {
+    if (index >= 16)
+        return;
+
+    glActiveTexture(GL_TEXTURE0 + index);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arr->id);
+}
+
+static inline void texture_array_uninit(struct texture_array* arr) {
+    glDeleteTextures(1, &arr->id);
+    *arr = (struct texture_array){0};
+}
+
+// ================ CACHE ================
+
+static inline struct texture_cache_entry* _texture_cache_find(const char* key) {
+    if (TextureCache.entries.hash == nullptr)
+        map_init(&TextureCache.entries, ptr_comparator, ptr_hasher);
+
+    struct map_entry* entry = map_find(&TextureCache.entries, (void*)key);
+    if (entry) {
+        TextureCache.hits++;
+        struct texture_cache_entry* cached = entry->item;
+        cached->refs++;
+        return cached;
+    }
+
+    TextureCache.misses++;
+    return nullptr;
+}
+
+static inline struct texture_cache_entry* _texture_cache_insert(const char* key) {
+    struct texture_cache_entry* cached = malloc(sizeof(struct texture_cache_entry));
+    if (!cached)
+        panic("texture_cache: failed to allocate memory");
+
+    cached->refs = 1;
+    map_insert(&TextureCache.entries, (void*)key, cached);
+
+    return cached;
+}
+
+// Like texture_load_async, compressed unless built with TEXTURE_NO_COMPRESSION, but reuses the
+// texture if path is already loaded. Release it with
+// texture_release rather than texture_uninit.
+static inline void texture_acquire(struct texture* tex, const char* path) {
+    const char* key = string_intern(path);
+
+    struct texture_cache_entry* cached = _texture_cache_find(key);
+    if (!cached) {
+        // the entry doesn't move, so a streamed upload can fill in its size later
+        cached = _texture_cache_insert(key);
+        texture_load_async(&cached->tex, path, 1);
+        cached->tex.cache_key = key;
+    }
+
+    *tex = cached->tex;
+}
+
+// Like texture_create_fallback, with one shared texture per colour
+static inline void texture_acquire_fallback(struct texture* tex, vec4 color) {
+    char name[64];
+    snprintf(name, sizeof(name), "fallback:%g,%g,%g,%g", color.x, color.y, color.z, color.w);
+    const char* key = string_intern(name);
+
+    struct texture_cache_entry* cached = _texture_cache_find(key);
+    if (!cached) {
+        cached = _texture_cache_insert(key);
+        texture_create_fallback(&cached->tex, color);
+        cached->tex.cache_key = key;
+    }
+
+    *tex = cached->tex;
+}
+
+// Drops a reference taken by texture_acquire*, the texture is deleted with the last one
+static inline void texture_release(struct texture* tex) {
+    struct map_entry* entry =
+        tex->cache_key ? map_find(&TextureCache.entries, (void*)tex->cache_key) : nullptr;
+    if (!entry)
+        panic("texture_release: texture is not in the cache");
+
+    struct texture_cache_entry* cached = entry->item;
+    if (--cached->refs == 0) {
+        _texture_stream_cancel(&cached->tex);
+        glDeleteTextures(1, &cached->tex.id);
+        map_remove(&TextureCache.entries, (void*)tex->cache_key);
+        free(cached);
+    }
+
+    *tex = (struct texture){0};
+}
+
+// distinct textures currently alive in the cache
+static inline uint32_t texture_cache_size() {
+    return TextureCache.entries.size;
 }
 
 static inline void texture_bind(struct texture* tex, int index) {
@@ -95,6 +748,7 @@ static inline void texture_unbind() {
 }
 
 static inline void texture_uninit(struct texture* tex) {
+    _texture_stream_cancel(tex);
     glDeleteTextures(1, &tex->id);
 }
 
@@ -0,0 +1,513 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "util.h"
+
+// CPU block compression into BC1 (opaque, 4 bits per pixel) and BC3 (with alpha, 8 bits per
+// pixel), with the full mip chain, since glGenerateMipmap can't build one for compressed formats.
+//
+// The encoder fits each 4x4 block's colours to the principal axis of the block, which is fast and
+// good enough for diffuse and specular maps. Results are cached on disk next to the source image,
+// see texture_compress_cached, so each image is encoded once.
+
+#define TEXTURE_COMPRESS_MAGIC 0x58544342  // "BCTX"
+#define TEXTURE_COMPRESS_VERSION 1
+#define TEXTURE_COMPRESS_EXTENSION ".bcache"
+#define TEXTURE_COMPRESS_MAX_LEVELS 16
+
+enum texture_compression {
+    TEXTURE_COMPRESSION_BC1,
+    TEXTURE_COMPRESSION_BC3,
+};
+
+// every mip level, back to back from the largest
+struct compressed_image {
+    enum texture_compression compression;
+    uint32_t width, height, levels;
+    uint32_t offsets[TEXTURE_COMPRESS_MAX_LEVELS + 1];  // level i is [offsets[i], offsets[i + 1])
+    uint8_t* data;
+};
+
+struct compressed_image_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t compression;
+    uint32_t width, height, levels;
+    int64_t source_size;
+    int64_t source_mtime;
+    uint32_t offsets[TEXTURE_COMPRESS_MAX_LEVELS + 1];
+};
+
+static inline uint32_t texture_compression_block_size(enum texture_compression compression) {
+    return compression == TEXTURE_COMPRESSION_BC1 ? 8 : 16;
+}
+
+static inline uint32_t texture_compression_size(enum texture_compression compression,
+                                                uint32_t width,
+                                                uint32_t height) {
+    return ((width + 3) / 4) * ((height + 3) / 4) * texture_compression_block_size(compression);
+}
+
+// ================ BLOCKS ================
+
+static inline uint16_t _bc_pack565(const float c[3]) {
+    uint32_t r = (uint32_t)(fminf(fmaxf(c[0], 0), 255) * 31 / 255 + 0.5f);
+    uint32_t g = (uint32_t)(fminf(fmaxf(c[1], 0), 255) * 63 / 255 + 0.5f);
+    uint32_t b = (uint32_t)(fminf(fmaxf(c[2], 0), 255) * 31 / 255 + 0.5f);
+    return r << 11 | g << 5 | b;
+}
+
+static inline void _bc_unpack565(uint16_t c, uint8_t out[3]) {
+    uint32_t r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+    out[0] = r << 3 | r >> 2;
+    out[1] = g << 2 | g >> 4;
+    out[2] = b << 3 | b >> 2;
+}
+
+// 4 colour mode block from 16 RGBA pixels, alpha is ignored
+static inline void _bc_encode_color(const uint8_t* pixels, uint8_t* out) {
+    float mean[3] = {0};
+    for (uint32_t i = 0; i < 16; i++)
+        for (uint32_t c = 0; c < 3; c++)
+            mean[c] += pixels[i * 4 + c] / 16.0f;
+
+    float cov[6] = {0};  // xx xy xz yy yz zz
+    for (uint32_t i = 0; i < 16; i++) {
+        float d[3] = {pixels[i * 4] - mean[0], pixels[i * 4 + 1] - mean[1],
+                      pixels[i * 4 + 2] - mean[2]};
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+
+    // principal axis by power iteration
+    float axis[3] = {1, 1, 1};
+    for (uint32_t iter = 0; iter < 8; iter++) {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+        };
+        float len = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (len < 1e-6f)
+            break;
+
+        for (uint32_t c = 0; c < 3; c++)
+            axis[c] = next[c] / len;
+    }
+
+    float lo = 0, hi = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        float t = 0;
+        for (uint32_t c = 0; c < 3; c++)
+            t += (pixels[i * 4 + c] - mean[c]) * axis[c];
+        lo = fminf(lo, t);
+        hi = fmaxf(hi, t);
+    }
+
+    float e0[3], e1[3];
+    for (uint32_t c = 0; c < 3; c++) {
+        e0[c] = mean[c] + axis[c] * hi;
+        e1[c] = mean[c] + axis[c] * lo;
+    }
+
+    uint16_t c0 = _bc_pack565(e0), c1 = _bc_pack565(e1);
+    if (c0 < c1) {
+        uint16_t t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+
+    uint8_t palette[4][3];
+    _bc_unpack565(c0, palette[0]);
+    _bc_unpack565(c1, palette[1]);
+    for (uint32_t c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    // equal endpoints select 3 colour mode, where index 0 is still the endpoint
+    uint32_t indices = 0;
+    for (uint32_t i = 0; i < 16 && c0 != c1; i++) {
+        uint32_t best = 0, best_dist = UINT32_MAX;
+        for (uint32_t p = 0; p < 4; p++) {
+            uint32_t dist = 0;
+            for (uint32_t c = 0; c < 3; c++) {
+                int32_t d = pixels[i * 4 + c] - palette[p][c];
+                dist += d * d;
+            }
+            if (dist < best_dist) {
+                best_dist = dist;
+                best = p;
+            }
+        }
+        indices |= best << (i * 2);
+    }
+
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for (uint32_t i = 0; i < 4; i++)
+        out[4 + i] = indices >> (i * 8);
+}
+
+// 8 alpha mode block from the alpha of 16 RGBA pixels
+static inline void _bc_encode_alpha(const uint8_t* pixels, uint8_t* out) {
+    uint8_t a0 = 0, a1 = 255;
+    for (uint32_t i = 0; i < 16; i++) {
+        uint8_t a = pixels[i * 4 + 3];
+        a0 = a > a0 ? a : a0;
+        a1 = a < a1 ? a : a1;
+    }
+
+    uint8_t palette[8] = {a0, a1};
+    for (uint32_t p = 1; p < 7; p++)
+        palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+    uint64_t indices = 0;
+    for (uint32_t i = 0; i < 16 && a0 != a1; i++) {
+        uint32_t best = 0, best_dist = UINT32_MAX;
+        for (uint32_t p = 0; p < 8; p++) {
+            int32_t d = pixels[i * 4 + 3] - palette[p];
+            if ((uint32_t)(d * d) < best_dist) {
+                best_dist = d * d;
+                best = p;
+            }
+        }
+        indices |= (uint64_t)best << (i * 3);
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (uint32_t i = 0; i < 6; i++)
+        out[2 + i] = indices >> (i * 8);
+}
+
+static inline void bc1_encode_block(const uint8_t* pixels, uint8_t* out) {
+    _bc_encode_color(pixels, out);
+}
+
+static inline void bc3_encode_block(const uint8_t* pixels, uint8_t* out) {
+    _bc_encode_alpha(pixels, out);
+    _bc_encode_color(pixels, out + 8);
+}
+
+// Decoders, the GPU does this when sampling, these are for checking the encoder
+static inline void _bc_decode_color(const uint8_t* block, uint8_t* pixels, int four_color) {
+    uint16_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+    uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+
+    uint8_t palette[4][4];
+    _bc_unpack565(c0, palette[0]);
+    _bc_unpack565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+    for (uint32_t c = 0; c < 3; c++) {
+        if (four_color || c0 > c1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    if (!four_color && c0 <= c1)
+        palette[3][3] = 0;
+
+    for (uint32_t i = 0; i < 16; i++)
+        memcpy(&pixels[i * 4], palette[indices >> (i * 2) & 3], 4);
+}
+
+static inline void bc1_decode_block(const uint8_t* block, uint8_t* pixels) {
+    _bc_decode_color(block, pixels, 0);
+}
+
+static inline void bc3_decode_block(const uint8_t* block, uint8_t* pixels) {
+    _bc_decode_color(block + 8, pixels, 1);
+
+    uint8_t a0 = block[0], a1 = block[1];
+    uint8_t palette[8] = {a0, a1};
+    if (a0 > a1) {
+        for (uint32_t p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+    } else {
+        for (uint32_t p = 1; p < 5; p++)
+            palette[p + 1] = ((5 - p) * a0 + p * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (uint32_t i = 0; i < 6; i++)
+        indices |= (uint64_t)block[2 + i] << (i * 8);
+
+    for (uint32_t i = 0; i < 16; i++)
+        pixels[i * 4 + 3] = palette[indices >> (i * 3) & 7];
+}
+
+// ================ IMAGES ================
+
+// Encodes a 3 or 4 channel image, blocks past the edges repeat the last row and column
+static inline void texture_compress_level(const uint8_t* data,
+                                          uint32_t width,
+                                          uint32_t height,
+                                          uint32_t channels,
+                                          enum texture_compression compression,
+                                          uint8_t* out) {
+    uint32_t block_size = texture_compression_block_size(compression);
+    uint8_t pixels[16 * 4];
+
+    for (uint32_t by = 0; by < height; by += 4) {
+        for (uint32_t bx = 0; bx < width; bx += 4) {
+            for (uint32_t i = 0; i < 16; i++) {
+                uint32_t x = bx + i % 4 < width ? bx + i % 4 : width - 1;
+                uint32_t y = by + i / 4 < height ? by + i / 4 : height - 1;
+                const uint8_t* p = &data[(y * width + x) * channels];
+                pixels[i * 4 + 0] = p[0];
+                pixels[i * 4 + 1] = p[1];
+                pixels[i * 4 + 2] = p[2];
+                pixels[i * 4 + 3] = channels == 4 ? p[3] : 255;
+            }
+
+            if (compression == TEXTURE_COMPRESSION_BC1)
+                bc1_encode_block(pixels, out);
+            else
+                bc3_encode_block(pixels, out);
+            out += block_size;
+        }
+    }
+}
+
+// 2x2 box filter into a width / 2 by height / 2 (at least 1) image with the same channels
+static inline void _texture_downsample(const uint8_t* src,
+                                       uint32_t width,
+                                       uint32_t height,
+                                       uint32_t channels,
+                                       uint8_t* dst) {
+    uint32_t w = width > 1 ? width / 2 : 1, h = height > 1 ? height / 2 : 1;
+
+    for (uint32_t y = 0; y < h; y++) {
+        uint32_t y0 = y * 2, y1 = y * 2 + 1 < height ? y * 2 + 1 : y0;
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t x0 = x * 2, x1 = x * 2 + 1 < width ? x * 2 + 1 : x0;
+            for (uint32_t c = 0; c < channels; c++) {
+                uint32_t sum = src[(y0 * width + x0) * channels + c] +
+                               src[(y0 * width + x1) * channels + c] +
+                               src[(y1 * width + x0) * channels + c] +
+                               src[(y1 * width + x1) * channels + c];
+                dst[(y * w + x) * channels + c] = (sum + 2) / 4;
+            }
+        }
+    }
+}
+
+// BC1 when every pixel is opaque, BC3 otherwise
+static inline enum texture_compression texture_compression_for(const struct image* img) {
+    if (img->channels == 4)
+        for (uint32_t i = 0; i < img->width * img->height; i++)
+            if (img->data[i * 4 + 3] != 255)
+                return TEXTURE_COMPRESSION_BC3;
+
+    return TEXTURE_COMPRESSION_BC1;
+}
+
+// Builds and encodes the mip chain of a 3 or 4 channel image. Returns 0 for other images.
+static inline int texture_compress_image(const struct image* img,
+                                         enum texture_compression compression,
+                                         struct compressed_image* out) {
+    *out = (struct compressed_image){0};
+    if (img->channels < 3 || img->channels > 4 || img->width == 0 || img->height == 0)
+        return 0;
+
+    uint32_t levels = 1;
+    for (uint32_t size = img->width > img->height ? img->width : img->height; size > 1; size >>= 1)
+        levels++;
+    if (levels > TEXTURE_COMPRESS_MAX_LEVELS)
+        return 0;
+
+    out->compression = compression;
+    out->width = img->width;
+    out->height = img->height;
+    out->levels = levels;
+
+    for (uint32_t i = 0, w = img->width, h = img->height; i < levels; i++) {
+        out->offsets[i + 1] = out->offsets[i] + texture_compression_size(compression, w, h);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    uint32_t channels = img->channels;
+    out->data = malloc(out->offsets[levels]);
+    uint8_t* mips[2] = {malloc(img->width * img->height * channels),
+                        malloc(img->width * img->height * channels)};
+    if (!out->data || !mips[0] || !mips[1])
+        panic("texture_compress_image: failed to allocate memory");
+
+    const uint8_t* level = img->data;
+    for (uint32_t i = 0, w = img->width, h = img->height; i < levels; i++) {
+        texture_compress_level(level, w, h, channels, compression, out->data + out->offsets[i]);
+
+        if (i + 1 < levels) {
+            _texture_downsample(level, w, h, channels, mips[i % 2]);
+            level = mips[i % 2];
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+    }
+
+    free(mips[1]);
+    free(mips[0]);
+
+    return 1;
+}
+
+static inline void compressed_image_uninit(struct compressed_image* img) {
+    free(img->data);
+    *img = (struct compressed_image){0};
+}
+
+// ================ CACHE ================
+
+static inline int _texture_compress_stat(const char* path, int64_t* size, int64_t* mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 1;
+}
+
+// Levels must follow each other from offset 0, each exactly as large as its block rounded size,
+// and end within the file. Anything else would upload memory past the data that was read.
+static inline int _compressed_image_layout_valid(const struct compressed_image_header* h,
+                                                 uint64_t file_size) {
+    if (h->offsets[0] != 0 || h->width == 0 || h->height == 0)
+        return 0;
+
+    uint64_t block_size = texture_compression_block_size(h->compression);
+    for (uint64_t i = 0, w = h->width, ht = h->height; i < h->levels; i++) {
+        // in 64 bits, a corrupt size mustn't wrap around into a matching one
+        uint64_t size = (w + 3) / 4 * ((ht + 3) / 4) * block_size;
+        if (h->offsets[i + 1] < h->offsets[i] || h->offsets[i + 1] - h->offsets[i] != size)
+            return 0;
+
+        w = w > 1 ? w / 2 : 1;
+        ht = ht > 1 ? ht / 2 : 1;
+    }
+
+    return sizeof(*h) + (uint64_t)h->offsets[h->levels] <= file_size;
+}
+
+// Reads the cache file at path, 0 if it is missing, older than source_path or malformed
+static inline int compressed_image_read(struct compressed_image* img,
+                                        const char* path,
+                                        const char* source_path) {
+    *img = (struct compressed_image){0};
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return 0;
+
+    struct compressed_image_header h;
+    int64_t file_size, file_mtime, source_size, source_mtime;
+    int ok = _texture_compress_stat(path, &file_size, &file_mtime) &&
+             fread(&h, sizeof(h), 1, file) == 1 && h.magic == TEXTURE_COMPRESS_MAGIC &&
+             h.version == TEXTURE_COMPRESS_VERSION &&
+             h.compression <= TEXTURE_COMPRESSION_BC3 && h.levels > 0 &&
+             h.levels <= TEXTURE_COMPRESS_MAX_LEVELS &&
+             _texture_compress_stat(source_path, &source_size, &source_mtime) &&
+             source_size == h.source_size && source_mtime == h.source_mtime &&
+             _compressed_image_layout_valid(&h, file_size);
+
+    if (ok) {
+        img->compression = h.compression;
+        img->width = h.width;
+        img->height = h.height;
+        img->levels = h.levels;
+        memcpy(img->offsets, h.offsets, sizeof(h.offsets));
+
+        img->data = malloc(h.offsets[h.levels] + 1);
+        if (!img->data)
+            panic("compressed_image_read: failed to allocate memory");
+
+        ok = fread(img->data, 1, h.offsets[h.levels], file) == h.offsets[h.levels];
+    }
+
+    fclose(file);
+
+    if (!ok)
+        compressed_image_uninit(img);
+
+    return ok;
+}
+
+// Writes through a temporary file renamed over path, like the model cache
+static inline int compressed_image_write(const struct compressed_image* img,
+                                         const char* path,
+                                         const char* source_path) {
+    struct compressed_image_header h = {
+        .magic = TEXTURE_COMPRESS_MAGIC,
+        .version = TEXTURE_COMPRESS_VERSION,
+        .compression = img->compression,
+        .width = img->width,
+        .height = img->height,
+        .levels = img->levels,
+    };
+    memcpy(h.offsets, img->offsets, sizeof(h.offsets));
+
+    if (!_texture_compress_stat(source_path, &h.source_size, &h.source_mtime))
+        return 0;
+
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+    FILE* file = fopen(temp, "wb");
+    if (!file)
+        return 0;
+
+    size_t written = fwrite(&h, sizeof(h), 1, file);
+    written += fwrite(img->data, img->offsets[img->levels], 1, file);
+
+    if (fclose(file) != 0 || written != 2 || rename(temp, path) != 0) {
+        remove(temp);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Loads the compressed mip chain of the image at path from its cache, or encodes it and writes
+// the cache. Safe to call from any thread. Returns 0 if the image can't be loaded.
+static inline int texture_compress_cached(struct compressed_image* out, const char* path) {
+    char cache_path[4096];
+    snprintf(cache_path, sizeof(cache_path), "%s" TEXTURE_COMPRESS_EXTENSION, path);
+
+    if (compressed_image_read(out, cache_path, path))
+        return 1;
+
+    struct image img;
+    if (!image_load(path, &img))
+        return 0;
+
+    int ok = texture_compress_image(&img, texture_compression_for(&img), out);
+    image_uninit(&img);
+
+    if (ok && !compressed_image_write(out, cache_path, path))
+        warn("texture_compress: failed to write cache %s", cache_path);
+
+    return ok;
+}
+
+#endif
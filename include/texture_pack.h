@@ -0,0 +1,112 @@
+#ifndef TEXTURE_PACK_H
+#define TEXTURE_PACK_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mmath.h"
+#include "util.h"
+
+// Atlas packing for small textures, so they can share a texture array layer instead of each taking
+// a texture (and a bind) of their own.
+//
+// Rects are placed on shelves, tallest first, and get a border of padding pixels that
+// texture_pack_blit fills with their clamped edges, so filtering and the first few mip levels don't
+// bleed between neighbours.
+
+struct texture_pack_rect {
+    uint32_t width, height;
+
+    // filled in by texture_pack_atlas, the top left corner inside the padding
+    uint32_t x, y, page;
+};
+
+static inline int _texture_pack_taller(const void* a, const void* b) {
+    const struct texture_pack_rect* ra = *(const struct texture_pack_rect* const*)a;
+    const struct texture_pack_rect* rb = *(const struct texture_pack_rect* const*)b;
+    if (ra->height != rb->height)
+        return ra->height < rb->height ? 1 : -1;
+
+    // keep equal heights in input order, qsort is not stable
+    return ra < rb ? -1 : ra > rb;
+}
+
+// Places every rect on size x size pages. Returns the number of pages used, 0 if a rect doesn't
+// fit on a page at all.
+static inline uint32_t texture_pack_atlas(struct texture_pack_rect* rects,
+                                          uint32_t count,
+                                          uint32_t size,
+                                          uint32_t padding) {
+    if (count == 0)
+        return 0;
+
+    struct texture_pack_rect** order = malloc(count * sizeof(struct texture_pack_rect*));
+    if (!order)
+        panic("texture_pack_atlas: failed to allocate memory");
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (rects[i].width + 2 * padding > size || rects[i].height + 2 * padding > size) {
+            free(order);
+            return 0;
+        }
+        order[i] = &rects[i];
+    }
+    qsort(order, count, sizeof(struct texture_pack_rect*), _texture_pack_taller);
+
+    uint32_t page = 0, x = 0, y = 0, shelf = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        struct texture_pack_rect* r = order[i];
+        uint32_t w = r->width + 2 * padding, h = r->height + 2 * padding;
+
+        if (x + w > size) {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        if (y + h > size) {
+            page++;
+            x = y = shelf = 0;
+        }
+
+        r->x = x + padding;
+        r->y = y + padding;
+        r->page = page;
+
+        x += w;
+        if (h > shelf)
+            shelf = h;
+    }
+
+    free(order);
+    return page + 1;
+}
+
+// Scale in xy and offset in zw that map a rect's [0, 1] uvs into its place on the page
+static inline vec4 texture_pack_uv_rect(const struct texture_pack_rect* r, uint32_t size) {
+    return (vec4){(float)r->width / size, (float)r->height / size, (float)r->x / size,
+                  (float)r->y / size};
+}
+
+// Copies RGBA8 pixels into their rect on an RGBA8 page, repeating the edges into the padding
+static inline void texture_pack_blit(uint8_t* page,
+                                     uint32_t size,
+                                     const struct texture_pack_rect* r,
+                                     uint32_t padding,
+                                     const uint8_t* pixels) {
+    for (uint32_t y = 0; y < r->height + 2 * padding; y++) {
+        uint32_t sy = y < padding ? 0 : y - padding;
+        if (sy >= r->height)
+            sy = r->height - 1;
+
+        uint8_t* dst = page + ((size_t)(r->y - padding + y) * size + r->x - padding) * 4;
+        const uint8_t* src = pixels + (size_t)sy * r->width * 4;
+
+        for (uint32_t x = 0; x < padding; x++) {
+            memcpy(dst + x * 4, src, 4);
+            memcpy(dst + (padding + r->width + x) * 4, src + (r->width - 1) * 4, 4);
+        }
+        memcpy(dst + padding * 4, src, r->width * 4);
+    }
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Fixed timestep accumulator. Frame times are cut into updates of step seconds and the remainder is
+// carried to the next frame, alpha is how far the frame lies between the last two updates so
+// rendering can interpolate between them.
+//
+// A frame that would need more than max_updates drops the rest of its time instead of catching
+// up, otherwise every slow update makes the next frame slower still.
+
+struct timestep {
+    double step;
+    double accumulator;
+    uint32_t max_updates;
+
+    uint64_t updates;
+    double dropped;  // seconds of simulation skipped by slow frames
+};
+
+static inline void timestep_init(struct timestep* ts, double step, uint32_t max_updates) {
+    *ts = (struct timestep){
+        .step = step,
+        .max_updates = max_updates == 0 ? 1 : max_updates,
+    };
+}
+
+// Adds a frame of delta seconds and returns the number of updates to run for it
+static inline uint32_t timestep_advance(struct timestep* ts, double delta) {
+    if (ts->step <= 0)
+        return 0;
+
+    ts->accumulator += delta > 0 ? delta : 0;
+
+    uint32_t count = 0;
+    while (ts->accumulator >= ts->step && count < ts->max_updates) {
+        ts->accumulator -= ts->step;
+        count++;
+    }
+
+    if (ts->accumulator >= ts->step) {
+        // keep the fraction, so alpha stays continuous
+        double excess = ts->accumulator - fmod(ts->accumulator, ts->step);
+        ts->dropped += excess;
+        ts->accumulator -= excess;
+    }
+
+    ts->updates += count;
+    return count;
+}
+
+// in [0, 1), 0 renders the state of the last update
+static inline double timestep_alpha(const struct timestep* ts) {
+    return ts->step > 0 ? ts->accumulator / ts->step : 0;
+}
+
+#endif
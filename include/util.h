@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define nullptr NULL
 
@@ -73,6 +74,13 @@ static inline uint32_t next_power_of_2(uint32_t size) {
     return size;
 }
 
+// wall clock seconds, for coarse timings where no window clock is available
+static inline double time_now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 static inline char* read_file(const char* path) {
     int ret;
 
@@ -1,18 +1,57 @@
 #define GL_LOADER
 #include "gl_loader.h"
 
+#include "frame_ring.h"
+#include "gl_caps.h"
+#include "timestep.h"
 #include "util.h"
 #include "vector.h"
 
 #include <GLFW/glfw3.h>
+#include <stdatomic.h>
+#include <threads.h>
 
 struct key_handler {
     callback handler;
     int key;
+    int next;  // next handler of the same key, -1 for none
     double debounce;
     double last_press;
 };
 
+#define WINDOW_KEY_COUNT (GLFW_KEY_LAST + 1)
+
+// states of keyboard.active
+#define WINDOW_KEY_PRESSED 1  // not seen down by a frame yet
+#define WINDOW_KEY_HELD 2     // its handlers ran while it was down
+
+// Kept up to date by the GLFW key callback, so a frame only visits the keys that are down instead
+// of polling every handler
+struct keyboard {
+    uint8_t down[WINDOW_KEY_COUNT];
+    int handlers[WINDOW_KEY_COUNT];  // first handler of each key, -1 for none
+
+    // keys that are down or were released since the last frame, a tap between two frames still
+    // runs its handlers once. A key that was held stops as soon as it is released.
+    uint8_t active[WINDOW_KEY_COUNT];
+    int keys[WINDOW_KEY_COUNT];
+    uint32_t count;
+};
+
+// fixed timestep updates of step seconds, see window_set_update_callback
+#define WINDOW_MAX_UPDATES 8
+
+// frames the CPU may queue ahead of the GPU, see window_set_frames_in_flight
+#define WINDOW_MAX_FRAMES_IN_FLIGHT 4
+
+// the frame limiter spins for the last stretch, sleeps overshoot by up to a scheduler tick
+#define WINDOW_SPIN_SECONDS 0.002
+
+// packets between the main and the render thread, see window_set_render_thread
+#define WINDOW_FRAME_PACKETS 2
+
+typedef void (*update_callback)(double step);
+typedef void (*packet_callback)(void* packet);
 typedef void (*mouse_callback)(float x, float y, float xdelta, float ydelta);
 typedef void (*scroll_callback)(float xdelta, float ydelta);
 
@@ -23,17 +62,66 @@ struct mouse {
     uint8_t init;
 };
 
+// Accumulated over the frames since the last window_reset_frame_stats. Owned by the main thread,
+// with a render thread each frame's numbers come back in its packet, see struct _window_frame.
+struct frame_stats {
+    uint32_t frames;
+    double wait_ms;  // blocked on frames in flight and the frame limiter
+
+    // from the input poll a frame acts on to its swap, how stale the shown input is
+    double latency_ms;
+    double max_latency_ms;
+};
+
 struct window {
-    float time;
-    float delta;
+    // seconds since glfwInit, doubles so long uptimes keep sub-millisecond precision
+    double time;
+    double delta;
     uint32_t width;
     uint32_t height;
     GLFWwindow* glfw;
     callback render;
+    update_callback update;
+    struct timestep timestep;
     struct vector key_handlers;
+    struct keyboard keyboard;
     struct mouse mouse;
     scroll_callback scroll_handler;
     GLbitfield clear;
+
+    // requested by window_set_swap_interval and the one last applied on the GL thread
+    _Atomic int swap_interval;
+    int applied_swap_interval;
+
+    // pacing, see window_set_frame_limit and window_set_frames_in_flight
+    double frame_interval;
+    double next_frame;
+    uint32_t frames_in_flight;
+    GLsync fences[WINDOW_MAX_FRAMES_IN_FLIGHT];
+    uint32_t fence_index;
+
+    double input_time;
+    struct frame_stats stats;
+
+    // size the GL viewport was last set to, resizes apply on the GL thread
+    uint32_t viewport_width, viewport_height;
+
+    // frames handed from the main thread to the render thread when prepare is set
+    packet_callback prepare;
+    uint32_t packet_size;
+    struct frame_ring frames;
+    const void* packet;
+};
+
+// Leads every frame packet, the state of the main thread the frame was prepared with
+struct _window_frame {
+    double input_time;
+    uint32_t width, height;
+
+    // the frame's own stats, written by the render thread and added up once the main thread
+    // acquires the packet again
+    struct frame_stats stats;
+    _Alignas(16) uint8_t packet[];
 };
 
 static struct window Window = {0};
@@ -43,7 +131,22 @@ static inline void _framebuffer_size_callback(GLFWwindow* window, int width, int
     Window.width = width;
     Window.height = height;
     Window.mouse.init = 0;
-    glViewport(0, 0, width, height);
+}
+
+static inline void _key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    unused(window);
+    unused(scancode);
+    unused(mods);
+
+    struct keyboard* keyboard = &Window.keyboard;
+    if (key < 0 || key >= WINDOW_KEY_COUNT || action == GLFW_REPEAT)
+        return;
+
+    keyboard->down[key] = action == GLFW_PRESS;
+    if (keyboard->down[key] && !keyboard->active[key]) {
+        keyboard->active[key] = WINDOW_KEY_PRESSED;
+        keyboard->keys[keyboard->count++] = key;
+    }
 }
 
 static inline int window_init(uint32_t width, uint32_t height) {
@@ -53,9 +156,25 @@ static inline int window_init(uint32_t width, uint32_t height) {
     Window.height = height;
     Window.glfw = nullptr;
     Window.render = nullptr;
+    Window.update = nullptr;
+    Window.timestep = (struct timestep){0};
     Window.mouse = (struct mouse){0};
     Window.clear = GL_COLOR_BUFFER_BIT;
+    Window.frame_interval = 0;
+    Window.next_frame = 0;
+    Window.frames_in_flight = 0;
+    Window.fence_index = 0;
+    for (uint32_t i = 0; i < WINDOW_MAX_FRAMES_IN_FLIGHT; i++)
+        Window.fences[i] = nullptr;
+    Window.stats = (struct frame_stats){0};
+    Window.viewport_width = width;
+    Window.viewport_height = height;
+    Window.prepare = nullptr;
+    Window.packet_size = 0;
+    Window.packet = nullptr;
     vec_init(&Window.key_handlers, sizeof(struct key_handler));
+    Window.keyboard = (struct keyboard){0};
+    memset(Window.keyboard.handlers, -1, sizeof(Window.keyboard.handlers));
 
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -70,6 +189,11 @@ static inline int window_init(uint32_t width, uint32_t height) {
 
     glfwMakeContextCurrent(window);
 
+    // vsync, rather than whatever the driver defaults to
+    glfwSwapInterval(1);
+    atomic_init(&Window.swap_interval, 1);
+    Window.applied_swap_interval = 1;
+
     if (!load_gl_procs((ProcLoader)glfwGetProcAddress)) {
         printf("window_init failed:\ncould not load OpenGL\n");
         return 0;
@@ -77,6 +201,7 @@ static inline int window_init(uint32_t width, uint32_t height) {
 
     glViewport(0, 0, width, height);
     glfwSetFramebufferSizeCallback(window, _framebuffer_size_callback);
+    glfwSetKeyCallback(window, _key_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     Window.glfw = window;
@@ -88,14 +213,38 @@ static inline void window_set_clear_color(float r, float g, float b, float a) {
     glClearColor(r, g, b, a);
 }
 
-static inline void _key_handler_check_and_run(void* handler) {
-    struct key_handler* p = handler;
+// Runs the handlers of the active keys, each at most once per debounce interval of the frame
+// time
+static inline void _window_process_keys(double time) {
+    struct keyboard* keyboard = &Window.keyboard;
+
+    for (uint32_t i = 0; i < keyboard->count;) {
+        int key = keyboard->keys[i];
+
+        // released after a frame already saw it down, running it again would overshoot
+        if (!keyboard->down[key] && keyboard->active[key] == WINDOW_KEY_HELD) {
+            keyboard->active[key] = 0;
+            keyboard->keys[i] = keyboard->keys[--keyboard->count];
+            continue;
+        }
+
+        for (int h = keyboard->handlers[key]; h >= 0;) {
+            // handlers may register more handlers and move the vector
+            struct key_handler* p = vec_item(&Window.key_handlers, h);
+            h = p->next;
 
-    if (glfwGetKey(Window.glfw, p->key) == GLFW_PRESS) {
-        double time = glfwGetTime();
-        if (time > p->last_press + p->debounce) {
-            p->last_press = time;
-            p->handler();
+            if (time > p->last_press + p->debounce) {
+                p->last_press = time;
+                p->handler();
+            }
+        }
+
+        if (keyboard->down[key]) {
+            keyboard->active[key] = WINDOW_KEY_HELD;
+            i++;
+        } else {
+            keyboard->active[key] = 0;
+            keyboard->keys[i] = keyboard->keys[--keyboard->count];
         }
     }
 }
@@ -130,12 +279,34 @@ static inline void window_set_render_callback(callback cb) {
     Window.render = cb;
 }
 
+// Calls cb every step seconds of window time, independent of the frame rate. Frames run as many
+// updates as their time covers, at most WINDOW_MAX_UPDATES, and render in between the last two,
+// see window_alpha.
+static inline void window_set_update_callback(update_callback cb, double step) {
+    Window.update = cb;
+    timestep_init(&Window.timestep, step, WINDOW_MAX_UPDATES);
+}
+
 static inline void window_set_key_handler(int key, callback cb, uint32_t debounce) {
+    if (key < 0 || key >= WINDOW_KEY_COUNT)
+        panic("window_set_key_handler: invalid key %d", key);
+
     struct key_handler* handler = vec_emplace(&Window.key_handlers);
     handler->debounce = (double)debounce / 1000.;
     handler->key = key;
     handler->handler = cb;
     handler->last_press = 0;
+
+    // handlers of a key run in the order they were set
+    handler->next = -1;
+    int* last = &Window.keyboard.handlers[key];
+    while (*last >= 0)
+        last = &((struct key_handler*)vec_item(&Window.key_handlers, *last))->next;
+    *last = Window.key_handlers.size - 1;
+}
+
+static inline int window_key_down(int key) {
+    return key >= 0 && key < WINDOW_KEY_COUNT && Window.keyboard.down[key];
 }
 
 static inline void window_set_mouse_handler(mouse_callback cb) {
@@ -151,32 +322,270 @@ static inline void window_set_scroll_handler(scroll_callback cb) {
     glfwSetScrollCallback(Window.glfw, _scroll_callback);
 }
 
+// 0 swaps immediately, 1 waits for every vertical blank, n for every nth. The swap interval is
+// state of the GL context, so it is only recorded here and applied on the GL thread before the next
+// frame, which makes it safe to call from the main thread with a render thread running.
+static inline void window_set_swap_interval(int interval) {
+    atomic_store_explicit(&Window.swap_interval, interval, memory_order_relaxed);
+}
+
+// Caps the frame rate on the CPU, for uncapped swap intervals or displays faster than needed. 0
+// removes the cap.
+static inline void window_set_frame_limit(double fps) {
+    Window.frame_interval = fps > 0 ? 1 / fps : 0;
+    Window.next_frame = 0;
+}
+
+// Waits before a frame until the GPU finished all but the last count frames, so the driver can't
+// queue frames up and add their time to the input latency. 0 leaves it to the driver.
+static inline void window_set_frames_in_flight(uint32_t count) {
+    if (count > WINDOW_MAX_FRAMES_IN_FLIGHT)
+        count = WINDOW_MAX_FRAMES_IN_FLIGHT;
+
+    Window.frames_in_flight = count;
+}
+
+static inline struct frame_stats* window_frame_stats() {
+    return &Window.stats;
+}
+
+static inline void window_reset_frame_stats() {
+    Window.stats = (struct frame_stats){0};
+}
+
+static inline void _window_sleep_until(double target) {
+    double remaining = target - glfwGetTime() - WINDOW_SPIN_SECONDS;
+    if (remaining > 0) {
+        struct timespec duration = {(time_t)remaining, (long)(fmod(remaining, 1) * 1e9)};
+        thrd_sleep(&duration, nullptr);
+    }
+
+    while (glfwGetTime() < target)
+        ;
+}
+
+// Blocks until the frame count frames ago is done on the GPU, the fence of the frame being
+// started reuses its slot
+static inline void _window_wait_frames_in_flight() {
+    uint32_t count = Window.frames_in_flight;
+    if (count == 0)
+        return;
+
+    GLsync* fence = &Window.fences[Window.fence_index % count];
+    if (*fence) {
+        glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(*fence);
+        *fence = nullptr;
+    }
+}
+
+static inline void _window_fence_frame() {
+    uint32_t count = Window.frames_in_flight;
+    if (count == 0)
+        return;
+
+    GLsync* fence = &Window.fences[Window.fence_index++ % count];
+    if (*fence)
+        glDeleteSync(*fence);
+    *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static inline void _window_update_viewport(uint32_t width, uint32_t height) {
+    if (width == Window.viewport_width && height == Window.viewport_height)
+        return;
+
+    glViewport(0, 0, width, height);
+    Window.viewport_width = width;
+    Window.viewport_height = height;
+}
+
+static inline void _window_add_frame_stats(struct frame_stats* total, struct frame_stats* frame) {
+    total->frames += frame->frames;
+    total->wait_ms += frame->wait_ms;
+    total->latency_ms += frame->latency_ms;
+    if (frame->max_latency_ms > total->max_latency_ms)
+        total->max_latency_ms = frame->max_latency_ms;
+}
+
+static inline void _window_pace_frame(struct frame_stats* stats) {
+    int interval = atomic_load_explicit(&Window.swap_interval, memory_order_relaxed);
+    if (interval != Window.applied_swap_interval) {
+        glfwSwapInterval(interval);
+        Window.applied_swap_interval = interval;
+    }
+
+    double start = glfwGetTime();
+
+    _window_wait_frames_in_flight();
+
+    if (Window.frame_interval > 0) {
+        // a late frame starts the schedule over instead of rushing the next ones
+        if (Window.next_frame < start)
+            Window.next_frame = start;
+        _window_sleep_until(Window.next_frame);
+        Window.next_frame += Window.frame_interval;
+    }
+
+    stats->wait_ms += (glfwGetTime() - start) * 1000;
+}
+
 static inline void window_enable_depth_testing() {
     glEnable(GL_DEPTH_TEST);
 
     Window.clear |= GL_DEPTH_BUFFER_BIT;
 }
 
+// Clip depth in [0, 1] and a greater depth test, for camera_set_reverse_z. Needs GL 4.5 or
+// ARB_clip_control, returns 0 and leaves the depth state alone without them. With the [-1, 1]
+// range the precision reverse-z gains is lost again mapping it to window depth.
+static inline int window_enable_reverse_z() {
+    if (!gl_has_version(4, 5) && !gl_has_extension("GL_ARB_clip_control"))
+        return 0;
+
+    glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+    glDepthFunc(GL_GREATER);
+    glClearDepth(0);
+
+    return 1;
+}
+
 static inline void window_clear() {
     glClear(Window.clear);
 }
 
-static inline void window_run() {
+// Runs the render callback and the swap on a thread of their own, so a blocking swap or GPU wait
+// no longer stalls input and updates. After input and updates the main thread calls prepare to
+// fill a packet of packet_size bytes, the render callback reads it back with window_frame_packet
+// while the main thread prepares the next one.
+//
+// The render callback owns the GL context and must only use the packet and GL state, everything
+// else is the main thread's. Call before window_run, GL objects can be created and deleted on the
+// main thread before and after it.
+static inline void window_set_render_thread(packet_callback prepare, uint32_t packet_size) {
+    Window.prepare = prepare;
+    Window.packet_size = packet_size;
+}
+
+// the packet of the frame being rendered, see window_set_render_thread
+static inline const void* window_frame_packet() {
+    return Window.packet;
+}
+
+// Polls events and runs the key handlers and updates of a frame on the main thread
+static inline void _window_poll_input() {
+    glfwPollEvents();
+    Window.input_time = glfwGetTime();
+
+    if (Window.keyboard.down[GLFW_KEY_ESCAPE])
+        glfwSetWindowShouldClose(Window.glfw, true);
+
+    double time = Window.input_time;
+    Window.delta = time - Window.time;
+    Window.time = time;
+
+    _window_process_keys(time);
+
+    if (Window.update) {
+        uint32_t updates = timestep_advance(&Window.timestep, Window.delta);
+        for (uint32_t i = 0; i < updates; i++)
+            Window.update(Window.timestep.step);
+    }
+}
+
+static inline void _window_present(double input_time, struct frame_stats* stats) {
+    glfwSwapBuffers(Window.glfw);
+    _window_fence_frame();
+
+    double latency = (glfwGetTime() - input_time) * 1000;
+    stats->frames++;
+    stats->latency_ms += latency;
+    if (latency > stats->max_latency_ms)
+        stats->max_latency_ms = latency;
+}
+
+static inline int _window_render_main(void* arg) {
+    unused(arg);
+    glfwMakeContextCurrent(Window.glfw);
+
+    while (!frame_ring_done(&Window.frames)) {
+        struct _window_frame* frame = frame_ring_peek_wait(&Window.frames);
+        if (!frame)
+            continue;
+
+        frame->stats = (struct frame_stats){0};
+        _window_pace_frame(&frame->stats);
+        _window_update_viewport(frame->width, frame->height);
+
+        Window.packet = frame->packet;
+        if (Window.render)
+            Window.render();
+        Window.packet = nullptr;
+
+        _window_present(frame->input_time, &frame->stats);
+        frame_ring_release(&Window.frames);
+    }
+
+    glfwMakeContextCurrent(nullptr);
+    return 0;
+}
+
+static inline void _window_run_threaded() {
+    frame_ring_init(&Window.frames, sizeof(struct _window_frame) + Window.packet_size,
+                    WINDOW_FRAME_PACKETS);
+
+    // the context can only be current on one thread at a time
+    glfwMakeContextCurrent(nullptr);
+
+    thrd_t render_thread;
+    if (thrd_create(&render_thread, _window_render_main, nullptr) != thrd_success)
+        panic("window_run: failed to start the render thread");
+
     while (!glfwWindowShouldClose(Window.glfw)) {
-        if (glfwGetKey(Window.glfw, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-            glfwSetWindowShouldClose(Window.glfw, true);
+        // wait for a free packet before polling, so the input is fresh once it gets one
+        struct _window_frame* frame = frame_ring_acquire_wait(&Window.frames);
+        _window_add_frame_stats(&Window.stats, &frame->stats);
+        frame->stats = (struct frame_stats){0};
 
-        float time = glfwGetTime();
-        Window.delta = time - Window.time;
-        Window.time = time;
+        _window_poll_input();
 
-        vec_for_each(&Window.key_handlers, _key_handler_check_and_run);
+        frame->input_time = Window.input_time;
+        frame->width = Window.width;
+        frame->height = Window.height;
+        Window.prepare(frame->packet);
+
+        frame_ring_publish(&Window.frames);
+    }
+
+    frame_ring_close(&Window.frames);
+    thrd_join(render_thread, nullptr);
+
+    // the frames released since their packet was last acquired
+    for (uint32_t i = 0; i < WINDOW_FRAME_PACKETS; i++) {
+        struct _window_frame* frame =
+            (void*)(Window.frames.packets + (size_t)i * Window.frames.stride);
+        _window_add_frame_stats(&Window.stats, &frame->stats);
+    }
+    frame_ring_uninit(&Window.frames);
+
+    glfwMakeContextCurrent(Window.glfw);
+}
+
+static inline void window_run() {
+    if (Window.prepare) {
+        _window_run_threaded();
+        return;
+    }
+
+    while (!glfwWindowShouldClose(Window.glfw)) {
+        // input is polled after waiting, so the wait doesn't age it
+        _window_pace_frame(&Window.stats);
+        _window_poll_input();
+        _window_update_viewport(Window.width, Window.height);
 
         if (Window.render)
             Window.render();
 
-        glfwSwapBuffers(Window.glfw);
-        glfwPollEvents();
+        _window_present(Window.input_time, &Window.stats);
     }
 }
 
@@ -184,15 +593,29 @@ static inline float window_aspect_ratio() {
     return (float)Window.width / (float)Window.height;
 }
 
-static inline float window_time() {
+static inline uint32_t window_height() {
+    return Window.height;
+}
+
+static inline double window_time() {
     return Window.time;
 }
 
-static inline float window_delta() {
+static inline double window_delta() {
     return Window.delta;
 }
 
+// How far the current frame is past the last fixed update, in steps. Render at
+// mix(previous, current, alpha) to move smoothly at any frame rate.
+static inline double window_alpha() {
+    return timestep_alpha(&Window.timestep);
+}
+
 static inline void window_uninit() {
+    for (uint32_t i = 0; i < WINDOW_MAX_FRAMES_IN_FLIGHT; i++)
+        if (Window.fences[i])
+            glDeleteSync(Window.fences[i]);
+
     if (Window.glfw)
         glfwDestroyWindow(Window.glfw);
 
@@ -0,0 +1,26 @@
+#version 330 core
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+
+// per instance, see struct mesh_instance
+layout(location = 3) in mat4 aModel;
+layout(location = 7) in mat3 aNormalMatrix;
+
+out vec3 fragPos;
+out vec3 fragNormal;
+out vec2 fragTexCoords;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform bool useGeneratedCoords;
+
+void main() {
+    vec4 worldPos = aModel * vec4(aPos, 1.0);
+    gl_Position = projection * (view * worldPos);
+    fragPos = vec3(worldPos);
+    fragNormal = aNormalMatrix * aNormal;
+    fragTexCoords = useGeneratedCoords ? fragPos.xz : aTexCoords;
+}
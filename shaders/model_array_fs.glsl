@@ -0,0 +1,71 @@
+#version 330 core
+
+// model_fs.glsl for packed models, see model_load_packed
+struct Material {
+    sampler2DArray diffuse;
+    sampler2DArray specular;
+    float diffuseLayer;
+    float specularLayer;
+    vec4 diffuseRect;  // uv scale in xy and offset in zw, for textures on an atlas page
+    vec4 specularRect;
+    float shininess;
+};
+
+struct Light {
+    vec3 pos;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+in vec3 fragPos;
+in vec3 fragNormal;
+in vec2 fragTexCoords;
+
+out vec4 fragColor;
+
+uniform vec3 viewPos;
+uniform Light light;
+uniform Material material;
+
+vec3 CalcLight(Light light, vec3 normal, vec3 fragPos, vec3 ViewDir);
+
+// repeats within the rect, the gradients of the unwrapped uvs keep mip selection smooth at seams
+vec4 SampleLayer(sampler2DArray tex, float layer, vec4 rect) {
+    vec2 uv = fract(fragTexCoords) * rect.xy + rect.zw;
+    return textureGrad(tex, vec3(uv, layer), dFdx(fragTexCoords) * rect.xy,
+                       dFdy(fragTexCoords) * rect.xy);
+}
+
+void main() {
+    vec3 normal = normalize(fragNormal);
+    vec3 viewDir = normalize(viewPos - fragPos);
+    fragColor = vec4(CalcLight(light, normal, fragPos, viewDir), 1);
+}
+
+vec3 CalcLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir) {
+    vec3 lightDir = normalize(light.pos - fragPos);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuseColor = vec3(SampleLayer(material.diffuse, material.diffuseLayer,
+                                         material.diffuseRect));
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    vec3 specularColor = vec3(SampleLayer(material.specular, material.specularLayer,
+                                          material.specularRect));
+
+    float dist = length(light.pos - fragPos);
+    float attenuation = 1 / (light.constant + light.linear * dist + light.quadratic * dist * dist);
+
+    vec3 ambient = attenuation * light.ambient * diffuseColor;
+    vec3 diffuse = attenuation * light.diffuse * diff * diffuseColor;
+    vec3 specular = attenuation * light.specular * spec * specularColor;
+
+    return ambient + diffuse + specular;
+}
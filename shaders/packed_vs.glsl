@@ -0,0 +1,36 @@
+#version 330 core
+
+// struct vertex_packed, see mesh.h
+layout(location = 0) in vec3 aPos;        // snorm16, relative to the mesh bounds
+layout(location = 1) in vec2 aNormal;     // snorm16, octahedral
+layout(location = 2) in vec2 aTexCoords;  // half float
+
+out vec3 fragPos;
+out vec3 fragNormal;
+out vec2 fragTexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat3 normalMatrix;
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+uniform bool useGeneratedCoords;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main() {
+    vec3 pos = positionOffset + aPos * positionScale;
+    vec4 worldPos = model * vec4(pos, 1.0);
+    gl_Position = projection * (view * worldPos);
+    fragPos = vec3(worldPos);
+    fragNormal = normalMatrix * octDecode(aNormal);
+    fragTexCoords = useGeneratedCoords ? fragPos.xz : aTexCoords;
+}
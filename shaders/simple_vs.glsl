@@ -11,12 +11,14 @@ out vec2 fragTexCoords;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat3 normalMatrix;
 
 uniform bool useGeneratedCoords;
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    fragPos = vec3(model * vec4(aPos, 1.0));
-    fragNormal = mat3(transpose(inverse(model))) * aNormal;
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    gl_Position = projection * (view * worldPos);
+    fragPos = vec3(worldPos);
+    fragNormal = normalMatrix * aNormal;
     fragTexCoords = useGeneratedCoords ? fragPos.xz : aTexCoords;
 }
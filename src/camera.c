@@ -4,6 +4,7 @@ static struct fly_camera Camera;
 static struct shader Shader;
 static struct texture Face;
 static GLuint VAO;
+static GLint Texture0Location;
 
 void init_vertex_data() {
     glGenVertexArrays(1, &VAO);
@@ -23,6 +24,7 @@ void init_vertex_data() {
 
 void init() {
     shader_init(&Shader, "shaders/transform_vs.glsl", "shaders/transform_fs.glsl");
+    Texture0Location = shader_location(&Shader, "texture0");
 
     texture_load_image(&Face, "assets/awesomeface.png");
 
@@ -40,13 +42,13 @@ void draw() {
     shader_activate(&Shader);
 
     texture_bind(&Face, 0);
-    shader_set_int(&Shader, "texture0", 0);
+    shader_set_int_at(Texture0Location, 0);
 
     mat4 projection = camera_projection(&Camera.inner, window_aspect_ratio());
-    shader_set_mat4(&Shader, "projection", &projection);
+    shader_set_mat4_at(Shader.projection_location, &projection);
 
     mat4 view = camera_view(&Camera.inner);
-    shader_set_mat4(&Shader, "view", &view);
+    shader_set_mat4_at(Shader.view_location, &view);
 
     glBindVertexArray(VAO);
 
@@ -69,7 +71,7 @@ void draw() {
         mat4_comp(&model, rotate_y(6. * i));
         mat4_comp(&model, rotate_z(10. * i));
         mat4_comp(&model, translate(positions[i]));
-        shader_set_mat4(&Shader, "model", &model);
+        shader_set_mat4_at(Shader.model_location, &model);
 
         glDrawArrays(GL_TRIANGLES, 0, cube_vertex_count);
     }
@@ -106,7 +108,7 @@ void mouse(float x, float y, float xdelta, float ydelta) {
 
 void scroll(float xdelta, float ydelta) {
     unused(xdelta);
-    Camera.inner.fov = clamp(Camera.inner.fov - ydelta, 10, 90);
+    camera_set_fov(&Camera.inner, clamp(Camera.inner.fov - ydelta, 10, 90));
 }
 
 int main() {
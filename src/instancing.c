@@ -0,0 +1,183 @@
+#include "graphics.h"
+
+// Instancing stress test: a field of spinning crates, drawn either with one instanced draw call or
+// with one draw call per crate. Press I to switch, timings are printed every 128 frames. V toggles
+// vsync, at most two frames are queued on the GPU either way.
+
+#define GRID_X 100
+#define GRID_Y 4
+#define GRID_Z 100
+#define INSTANCE_COUNT (GRID_X * GRID_Y * GRID_Z)
+
+static struct shader InstancedShader;
+static struct shader LoopShader;
+
+// uniforms set every frame, looked up once per shader in init_uniforms
+struct crate_uniforms {
+    GLint view_pos;
+    struct point_light_locations light;
+    struct material_map_locations material;
+};
+
+static struct crate_uniforms InstancedUniforms;
+static struct crate_uniforms LoopUniforms;
+
+static struct texture Crate;
+static struct texture CrateSpecular;
+
+static struct mesh Cube;
+
+static mat4 Models[INSTANCE_COUNT];
+
+static struct gpu_timer DrawTimer;
+static double CpuTime = 0;
+static uint32_t Frames = 0;
+static int Instanced = 1;
+static int Vsync = 1;
+
+static struct point_light Light = {
+    .pos = {50, 20, 50},
+
+    .ambient = {0.3, 0.3, 0.3},
+    .diffuse = {0.8, 0.8, 0.8},
+    .specular = {1, 1, 1},
+
+    .constant = 1.0,
+    .linear = 0.007,
+    .quadratic = 0.0002,
+};
+
+void update_models() {
+    float time = window_time();
+
+    for (int y = 0; y < GRID_Y; y++) {
+        for (int z = 0; z < GRID_Z; z++) {
+            for (int x = 0; x < GRID_X; x++) {
+                int i = (y * GRID_Z + z) * GRID_X + x;
+                mat4 model = rotate_y(45 * time + i % 360);
+                mat4_comp(&model, translate((vec3){x * 2.0, y * 2.0, -z * 2.0}));
+                Models[i] = model;
+            }
+        }
+    }
+}
+
+void init_uniforms(struct shader* shader, struct crate_uniforms* u) {
+    u->view_pos = shader_location(shader, "viewPos");
+    shader_point_light_locations(shader, "light", &u->light);
+    shader_material_map_locations(shader, "material", &u->material);
+}
+
+void setup_shader(struct shader* shader, struct crate_uniforms* u) {
+    shader_activate(shader);
+
+    mat4 projection = camera_projection(DebugCamera, window_aspect_ratio());
+    shader_set_mat4_at(shader->projection_location, &projection);
+
+    mat4 view = camera_view(DebugCamera);
+    shader_set_mat4_at(shader->view_location, &view);
+
+    shader_set_point_light_at(&u->light, &Light);
+    shader_set_vec3_at(u->view_pos, camera_pos(DebugCamera));
+
+    struct material_map material = {
+        .diffuse_sampler = 0,
+        .specular_sampler = 1,
+        .shininess = 32,
+    };
+    shader_set_material_map_at(&u->material, &material);
+}
+
+void draw() {
+    window_clear();
+
+    texture_bind(&Crate, 0);
+    texture_bind(&CrateSpecular, 1);
+
+    double start = time_now();
+    gpu_timer_begin(&DrawTimer);
+
+    update_models();
+
+    if (Instanced) {
+        setup_shader(&InstancedShader, &InstancedUniforms);
+        mesh_draw_instanced(&Cube, Models, INSTANCE_COUNT);
+    } else {
+        setup_shader(&LoopShader, &LoopUniforms);
+        for (int i = 0; i < INSTANCE_COUNT; i++) {
+            shader_set_model(&LoopShader, &Models[i]);
+            mesh_draw(&Cube);
+        }
+    }
+
+    gpu_timer_end(&DrawTimer);
+    CpuTime += time_now() - start;
+
+    if (++Frames == 128) {
+        struct frame_stats* stats = window_frame_stats();
+        printf("%s: %d crates, %.3f ms cpu, %.3f ms gpu, %.1f fps, %.2f ms latency (%.2f max)\n",
+               Instanced ? "instanced" : "per draw", INSTANCE_COUNT, CpuTime * 1000 / Frames,
+               gpu_timer_average_ms(&DrawTimer), 1 / window_delta(),
+               stats->latency_ms / stats->frames, stats->max_latency_ms);
+
+        CpuTime = 0;
+        Frames = 0;
+        gpu_timer_reset(&DrawTimer);
+        window_reset_frame_stats();
+    }
+}
+
+void toggle_vsync() {
+    Vsync = !Vsync;
+    window_set_swap_interval(Vsync);
+    window_reset_frame_stats();
+}
+
+void toggle_instancing() {
+    Instanced = !Instanced;
+
+    CpuTime = 0;
+    Frames = 0;
+    gpu_timer_reset(&DrawTimer);
+}
+
+int main() {
+    if (!window_init(800, 600))
+        return 1;
+
+    shader_init(&InstancedShader, "shaders/instanced_vs.glsl", "shaders/model_fs.glsl");
+    shader_init(&LoopShader, "shaders/simple_vs.glsl", "shaders/model_fs.glsl");
+    init_uniforms(&InstancedShader, &InstancedUniforms);
+    init_uniforms(&LoopShader, &LoopUniforms);
+
+    texture_load_compressed(&Crate, "assets/crate.png");
+    texture_load_compressed(&CrateSpecular, "assets/crate_specular.png");
+
+    mesh_allocate(&Cube, cube_vertex_count, 0);
+    mesh_copy_vertices(&Cube, cube_vertices);
+    mesh_generate(&Cube);
+
+    gpu_timer_init(&DrawTimer);
+
+    debug_camera_init((vec3){GRID_X, 30, 20});
+    window_register_debug_camera();
+    window_set_key_handler(GLFW_KEY_I, toggle_instancing, 300);
+    window_set_key_handler(GLFW_KEY_V, toggle_vsync, 300);
+    window_set_frames_in_flight(2);
+
+    window_enable_depth_testing();
+    window_set_clear_color(0, 0, 0, 1);
+    window_set_render_callback(draw);
+
+    window_run();
+    window_uninit();
+
+    gpu_timer_uninit(&DrawTimer);
+    mesh_uninit(&Cube);
+    texture_uninit(&CrateSpecular);
+    texture_uninit(&Crate);
+    shader_uninit(&LoopShader);
+    shader_uninit(&InstancedShader);
+
+    return 0;
+}
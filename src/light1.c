@@ -3,6 +3,17 @@
 static struct shader ObjectShader;
 static struct shader LightShader;
 
+// uniforms set for every object, looked up once in init_uniforms
+struct object_uniforms {
+    GLint view_pos, use_generated_coords, use_texture;
+    struct point_light_locations light;
+    struct material_locations material;
+    struct material_map_locations material_map;
+};
+
+static struct object_uniforms ObjectUniforms;
+static GLint SolidColorLocation;
+
 static struct texture Crate;
 static struct texture CrateSpecular;
 static struct texture Checkered;
@@ -66,6 +77,18 @@ void init_floor_mesh() {
     mesh_generate(&Floor);
 }
 
+void init_uniforms() {
+    struct object_uniforms* u = &ObjectUniforms;
+    u->view_pos = shader_location(&ObjectShader, "viewPos");
+    u->use_generated_coords = shader_location(&ObjectShader, "useGeneratedCoords");
+    u->use_texture = shader_location(&ObjectShader, "useTexture");
+    shader_point_light_locations(&ObjectShader, "light", &u->light);
+    shader_material_locations(&ObjectShader, "material", &u->material);
+    shader_material_map_locations(&ObjectShader, "materialMap", &u->material_map);
+
+    SolidColorLocation = shader_location(&LightShader, "solidColor");
+}
+
 void draw_floor() {
     shader_activate(&ObjectShader);
 
@@ -79,11 +102,11 @@ void draw_floor() {
     FloorMat.diffuse_sampler = 0;
     FloorMat.specular_sampler = 1;
 
-    shader_set_vec3(&ObjectShader, "viewPos", camera_pos(DebugCamera));
-    shader_set_point_light(&ObjectShader, "light", &Light);
-    shader_set_material_map(&ObjectShader, "materialMap", &FloorMat);
-    shader_set_int(&ObjectShader, "useGeneratedCoords", GL_TRUE);
-    shader_set_int(&ObjectShader, "useTexture", GL_TRUE);
+    shader_set_vec3_at(ObjectUniforms.view_pos, camera_pos(DebugCamera));
+    shader_set_point_light_at(&ObjectUniforms.light, &Light);
+    shader_set_material_map_at(&ObjectUniforms.material_map, &FloorMat);
+    shader_set_int_at(ObjectUniforms.use_generated_coords, GL_TRUE);
+    shader_set_int_at(ObjectUniforms.use_texture, GL_TRUE);
 
     mesh_draw(&Floor);
 }
@@ -94,9 +117,9 @@ void draw_light() {
     mat4 model = identity();
     mat4_comp(&model, scale((vec3){0.2, 0.2, 0.2}));
     mat4_comp(&model, translate(Light.pos));
-    shader_set_transform(&ObjectShader, &model, &View, &Projection);
+    shader_set_transform(&LightShader, &model, &View, &Projection);
 
-    shader_set_vec3(&LightShader, "solidColor", vec3_new(1));
+    shader_set_vec3_at(SolidColorLocation, vec3_new(1));
 
     mesh_draw(&Cube);
 }
@@ -107,11 +130,11 @@ void draw_simple_object() {
     mat4 model = translate((vec3){-1.5, 1.5, 0});
     shader_set_transform(&ObjectShader, &model, &View, &Projection);
 
-    shader_set_vec3(&ObjectShader, "viewPos", camera_pos(DebugCamera));
-    shader_set_point_light(&ObjectShader, "light", &Light);
-    shader_set_material(&ObjectShader, "material", &SimpleCube);
-    shader_set_int(&ObjectShader, "useGeneratedCoords", GL_FALSE);
-    shader_set_int(&ObjectShader, "useTexture", GL_FALSE);
+    shader_set_vec3_at(ObjectUniforms.view_pos, camera_pos(DebugCamera));
+    shader_set_point_light_at(&ObjectUniforms.light, &Light);
+    shader_set_material_at(&ObjectUniforms.material, &SimpleCube);
+    shader_set_int_at(ObjectUniforms.use_generated_coords, GL_FALSE);
+    shader_set_int_at(ObjectUniforms.use_texture, GL_FALSE);
 
     mesh_draw(&Cube);
 }
@@ -127,11 +150,11 @@ void draw_textured_object() {
     TexturedCube.diffuse_sampler = 2;
     TexturedCube.specular_sampler = 3;
 
-    shader_set_vec3(&ObjectShader, "viewPos", camera_pos(DebugCamera));
-    shader_set_point_light(&ObjectShader, "light", &Light);
-    shader_set_material_map(&ObjectShader, "materialMap", &TexturedCube);
-    shader_set_int(&ObjectShader, "useGeneratedCoords", GL_FALSE);
-    shader_set_int(&ObjectShader, "useTexture", GL_TRUE);
+    shader_set_vec3_at(ObjectUniforms.view_pos, camera_pos(DebugCamera));
+    shader_set_point_light_at(&ObjectUniforms.light, &Light);
+    shader_set_material_map_at(&ObjectUniforms.material_map, &TexturedCube);
+    shader_set_int_at(ObjectUniforms.use_generated_coords, GL_FALSE);
+    shader_set_int_at(ObjectUniforms.use_texture, GL_TRUE);
 
     mesh_draw(&Cube);
 }
@@ -179,9 +202,10 @@ int main() {
 
     shader_init(&ObjectShader, "shaders/simple_vs.glsl", "shaders/light1_fs.glsl");
     shader_init(&LightShader, "shaders/simple_vs.glsl", "shaders/solid_fs.glsl");
+    init_uniforms();
 
-    texture_load_image(&Crate, "assets/crate.png");
-    texture_load_image(&CrateSpecular, "assets/crate_specular.png");
+    texture_load_compressed(&Crate, "assets/crate.png");
+    texture_load_compressed(&CrateSpecular, "assets/crate_specular.png");
     texture_load_image(&Checkered, "assets/checkered.png");
     texture_create_fallback(&Black, (vec4){0, 0, 0, 0});
 
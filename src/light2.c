@@ -3,6 +3,17 @@
 static struct shader CrateShader;
 static struct shader LightShader;
 
+// uniforms set every frame, looked up once in init_uniforms
+struct crate_uniforms {
+    struct dir_light_locations sun;
+    struct point_light_locations lights[4];
+    struct spot_light_locations flashlight;
+    struct material_map_locations material;
+};
+
+static struct crate_uniforms CrateUniforms;
+static GLint SolidColorLocation;
+
 static struct texture Crate;
 static struct texture CrateSpecular;
 
@@ -81,26 +92,37 @@ void init_cube_mesh() {
     mesh_generate(&Cube);
 }
 
+void init_uniforms() {
+    struct crate_uniforms* u = &CrateUniforms;
+    shader_dir_light_locations(&CrateShader, "dirLight", &u->sun);
+    shader_point_light_locations(&CrateShader, "pointLights[0]", &u->lights[0]);
+    shader_point_light_locations(&CrateShader, "pointLights[1]", &u->lights[1]);
+    shader_point_light_locations(&CrateShader, "pointLights[2]", &u->lights[2]);
+    shader_point_light_locations(&CrateShader, "pointLights[3]", &u->lights[3]);
+    shader_spot_light_locations(&CrateShader, "spotLight", &u->flashlight);
+    shader_material_map_locations(&CrateShader, "material", &u->material);
+
+    SolidColorLocation = shader_location(&LightShader, "solidColor");
+}
+
 void draw_crates() {
     shader_activate(&CrateShader);
 
     mat4 projection = camera_projection(DebugCamera, window_aspect_ratio());
-    shader_set_mat4(&CrateShader, "projection", &projection);
+    shader_set_mat4_at(CrateShader.projection_location, &projection);
 
     mat4 view = camera_view(DebugCamera);
-    shader_set_mat4(&CrateShader, "view", &view);
+    shader_set_mat4_at(CrateShader.view_location, &view);
 
-    shader_set_directional_light(&CrateShader, "dirLight", &Sun);
-    shader_set_point_light(&CrateShader, "pointLights[0]", &Lights[0]);
-    shader_set_point_light(&CrateShader, "pointLights[1]", &Lights[1]);
-    shader_set_point_light(&CrateShader, "pointLights[2]", &Lights[2]);
-    shader_set_point_light(&CrateShader, "pointLights[3]", &Lights[3]);
+    shader_set_directional_light_at(&CrateUniforms.sun, &Sun);
+    for (int i = 0; i < 4; i++)
+        shader_set_point_light_at(&CrateUniforms.lights[i], &Lights[i]);
 
     Flashlight.cutoff = cos(radians(12.5));
     Flashlight.outerCutoff = cos(radians(15));
     Flashlight.pos = camera_pos(DebugCamera);
     Flashlight.dir = camera_front(DebugCamera);
-    shader_set_spot_light(&CrateShader, "spotLight", &Flashlight);
+    shader_set_spot_light_at(&CrateUniforms.flashlight, &Flashlight);
 
     texture_bind(&Crate, 0);
     texture_bind(&CrateSpecular, 1);
@@ -109,7 +131,7 @@ void draw_crates() {
         .specular_sampler = 1,
         .shininess = 32,
     };
-    shader_set_material_map(&CrateShader, "material", &material);
+    shader_set_material_map_at(&CrateUniforms.material, &material);
 
     vec3 positions[10] = {
         {0.0, 0.0, 0.0},      //
@@ -124,33 +146,33 @@ void draw_crates() {
         {-1.3, 1.0, -1.5},    //
     };
 
-    for (int i = 0; i < 10; i++) {
-        mat4 model = translate(positions[i]);
-        shader_set_mat4(&CrateShader, "model", &model);
+    mat4 models[10];
+    for (int i = 0; i < 10; i++)
+        models[i] = translate(positions[i]);
 
-        mesh_draw(&Cube);
-    }
+    mesh_draw_instanced(&Cube, models, 10);
 }
 
 void draw_lights() {
     shader_activate(&LightShader);
 
     mat4 projection = camera_projection(DebugCamera, window_aspect_ratio());
-    shader_set_mat4(&CrateShader, "projection", &projection);
+    shader_set_mat4_at(LightShader.projection_location, &projection);
 
     mat4 view = camera_view(DebugCamera);
-    shader_set_mat4(&CrateShader, "view", &view);
-
-    for (int i = 0; i < 4; i++) {
-        mat4 model = identity();
-        mat4_comp(&model, scale(vec3_new(0.2)));
-        mat4_comp(&model, translate(Lights[i].pos));
-        shader_set_mat4(&LightShader, "model", &model);
+    shader_set_mat4_at(LightShader.view_location, &view);
 
-        shader_set_vec3(&LightShader, "solidColor", Lights[i].specular);
+    // the lights share their colour, so they are one instanced draw
+    shader_set_vec3_at(SolidColorLocation, Lights[0].specular);
 
-        mesh_draw(&Cube);
+    mat4 models[4];
+    for (int i = 0; i < 4; i++) {
+        models[i] = identity();
+        mat4_comp(&models[i], scale(vec3_new(0.2)));
+        mat4_comp(&models[i], translate(Lights[i].pos));
     }
+
+    mesh_draw_instanced(&Cube, models, 4);
 }
 
 void draw() {
@@ -164,11 +186,12 @@ int main() {
     if (!window_init(800, 600))
         return 1;
 
-    shader_init(&CrateShader, "shaders/simple_vs.glsl", "shaders/light2_fs.glsl");
-    shader_init(&LightShader, "shaders/simple_vs.glsl", "shaders/solid_fs.glsl");
+    shader_init(&CrateShader, "shaders/instanced_vs.glsl", "shaders/light2_fs.glsl");
+    shader_init(&LightShader, "shaders/instanced_vs.glsl", "shaders/solid_fs.glsl");
+    init_uniforms();
 
-    texture_load_image(&Crate, "assets/crate.png");
-    texture_load_image(&CrateSpecular, "assets/crate_specular.png");
+    texture_load_compressed(&Crate, "assets/crate.png");
+    texture_load_compressed(&CrateSpecular, "assets/crate_specular.png");
 
     init_cube_mesh();
 
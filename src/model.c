@@ -1,9 +1,33 @@
 #include "graphics.h"
 
+// A field of backpacks, distant ones are drawn with coarser lods. Press L to toggle lod selection.
+// Depth is reverse-z with an infinite far plane when the driver supports clip control.
+// Drawing runs on the render thread from frame packets, input and the camera stay on the main
+// thread.
+
+#define GRID 8
+#define SPACING 5.0f
+
 static struct shader Shader;
+static struct point_light_locations LightLocations;
+static GLint ViewPosLocation;
 
 static struct model Model;
 
+static struct gpu_timer DrawTimer;
+static int Lods = 1;
+
+// everything draw needs from the main thread
+struct frame {
+    mat4 view, projection, view_projection;
+    vec3 view_pos;
+    float fov;
+    uint32_t height;
+    double time;
+    int lods;
+    int reverse_z;
+};
+
 static struct point_light Light = {
     .pos = {1.0, 1.0, 0.4},
 
@@ -16,43 +40,120 @@ static struct point_light Light = {
     .quadratic = 0.07,
 };
 
+void prepare(void* packet) {
+    struct frame* frame = packet;
+    frame->view = camera_view(DebugCamera);
+    frame->projection = camera_projection(DebugCamera, window_aspect_ratio());
+    frame->view_projection = camera_view_projection(DebugCamera, window_aspect_ratio());
+    frame->view_pos = camera_pos(DebugCamera);
+    frame->fov = DebugCamera->fov;
+    frame->height = window_height();
+    frame->time = window_time();
+    frame->lods = Lods;
+    frame->reverse_z = DebugCamera->reverse_z;
+}
+
 void draw() {
+    static int last_lods = 1;
+    struct frame frame = *(const struct frame*)window_frame_packet();
+
     window_clear();
 
     shader_activate(&Shader);
 
-    mat4 projection = camera_projection(DebugCamera, window_aspect_ratio());
-    mat4 view = camera_view(DebugCamera);
-    mat4 model = rotate_y(10 * window_time());
-    shader_set_transform(&Shader, &model, &view, &projection);
-
-    shader_set_point_light(&Shader, "light", &Light);
-    shader_set_vec3(&Shader, "viewPos", camera_pos(DebugCamera));
+    shader_set_mat4_at(Shader.view_location, &frame.view);
+    shader_set_mat4_at(Shader.projection_location, &frame.projection);
+
+    shader_set_point_light_at(&LightLocations, &Light);
+    shader_set_vec3_at(ViewPosLocation, frame.view_pos);
+
+    if (frame.lods != last_lods) {
+        gpu_timer_reset(&DrawTimer);
+        last_lods = frame.lods;
+    }
+
+    // one pixel of error is not noticeable
+    if (frame.lods)
+        model_set_lod_scale(&Model, frame.fov, frame.height, 1);
+    else
+        Model.lod_scale = 0;
+
+    uint32_t drawn = 0, culled = 0, draw_calls = 0, triangles = 0;
+
+    gpu_timer_begin(&DrawTimer);
+    for (int z = 0; z < GRID; z++) {
+        for (int x = 0; x < GRID; x++) {
+            mat4 model = rotate_y(10 * frame.time + (z * GRID + x) * 45);
+            mat4_comp(&model, translate((vec3){x * SPACING, 0, -z * SPACING}));
+            shader_set_model(&Shader, &model);
+
+            mat4 mvp = mat4_mul(frame.view_projection, model);
+            struct frustum frustum =
+                frame.reverse_z ? frustum_from_matrix_reverse_z(mvp) : frustum_from_matrix(mvp);
+            model_draw_culled(&Model, &Shader, &frustum);
+
+            drawn += Model.drawn;
+            culled += Model.culled;
+            draw_calls += Model.draw_calls;
+            triangles += Model.triangles;
+        }
+    }
+    gpu_timer_end(&DrawTimer);
+
+    if (gpu_timer_samples(&DrawTimer) >= 256) {
+        printf("model_draw (lods %s): %.3f ms gpu, %d drawn, %d culled, %d draw calls, %d "
+               "triangles\n",
+               frame.lods ? "on" : "off", gpu_timer_average_ms(&DrawTimer), drawn, culled,
+               draw_calls, triangles);
+        gpu_timer_reset(&DrawTimer);
+    }
+}
 
-    model_draw(&Model, &Shader);
+void toggle_lods() {
+    Lods = !Lods;
 }
 
 int main() {
     if (!window_init(800, 600))
         return 1;
 
-    shader_init(&Shader, "shaders/simple_vs.glsl", "shaders/model_fs.glsl");
+    shader_init(&Shader, "shaders/packed_vs.glsl", "shaders/model_array_fs.glsl");
+    shader_point_light_locations(&Shader, "light", &LightLocations);
+    ViewPosLocation = shader_location(&Shader, "viewPos");
 
-    model_load(&Model, "assets/backpack/backpack.obj");
+    // imports convert their meshes and textures decode on every core
+    jobs_init(0);
 
-    debug_camera_init((vec3){0, 0, 8});
-    camera_set_y_bounds(DebugCamera, -5, 5);
+    model_load_packed(&Model, "assets/backpack/backpack.obj", VERTEX_FORMAT_PACKED);
+    printf("model_load: %.2f ms (%s)\n", Model.load_ms, Model.from_cache ? "cache" : "import");
+    printf("textures: packed into %d arrays\n", Model.texture_arrays.size);
+    if (!Model.from_cache)
+        printf("vertex cache: acmr %.3f -> %.3f, atvr %.3f -> %.3f\n", Model.cache_before.acmr,
+               Model.cache_after.acmr, Model.cache_before.atvr, Model.cache_after.atvr);
+    gpu_timer_init(&DrawTimer);
+
+    debug_camera_init((vec3){GRID * SPACING / 2, 2, 8});
+    camera_set_y_bounds(DebugCamera, -5, 20);
     window_register_debug_camera();
+    window_set_key_handler(GLFW_KEY_L, toggle_lods, 300);
 
     window_set_render_callback(draw);
+    window_set_render_thread(prepare, sizeof(struct frame));
     window_enable_depth_testing();
+    camera_set_reverse_z(DebugCamera, window_enable_reverse_z());
+    printf("depth: %s\n", DebugCamera->reverse_z ? "reverse-z" : "standard");
     window_set_clear_color(0, 0, 0, 0);
 
     window_run();
+
+    printf("texture uploads: %d, %.1f MB, %.2f ms\n", TextureUploads.count,
+           TextureUploads.bytes / (1024.0 * 1024.0), TextureUploads.ms);
     window_uninit();
 
+    gpu_timer_uninit(&DrawTimer);
     model_uninit(&Model);
     shader_uninit(&Shader);
+    jobs_uninit();
 
     return 0;
 }
@@ -1,10 +1,19 @@
 #include "graphics.h"
 
+// Textures stream in on the job system while the first frames are drawn, the GL thread only
+// issues uploads from pixel buffers. Prints how long that took once both are in.
+
 static struct shader Shader;
 static struct texture Wall;
 static struct texture Face;
 static float blend = 0.6;
 static GLuint VAO;
+static GLint Texture0Location, Texture1Location, TransformLocation, BlendLocation;
+
+// streaming progress, see stream_textures
+static uint32_t StreamFrames = 0;
+static double StreamWorstMs = 0;
+static double StreamStart;
 
 void init_vertex_data() {
     float vertices[] = {
@@ -39,28 +48,57 @@ void init_vertex_data() {
 
 void init() {
     shader_init(&Shader, "shaders/texture_vs.glsl", "shaders/texture_fs.glsl");
+    Texture0Location = shader_location(&Shader, "texture0");
+    Texture1Location = shader_location(&Shader, "texture1");
+    TransformLocation = shader_location(&Shader, "transform");
+    BlendLocation = shader_location(&Shader, "blend");
 
-    texture_load_image(&Wall, "assets/wall.png");
-    texture_load_image(&Face, "assets/awesomeface.png");
+    jobs_init(0);
+    texture_stream_init();
+    StreamStart = time_now();
+    texture_load_async(&Wall, "assets/wall.png", 1);
+    texture_load_async(&Face, "assets/awesomeface.png", 0);
 
     init_vertex_data();
 }
 
+void stream_textures() {
+    if (StreamFrames == UINT32_MAX)
+        return;
+
+    double start = time_now();
+    uint32_t pending = texture_stream_update();
+    double ms = (time_now() - start) * 1000;
+
+    StreamFrames++;
+    if (ms > StreamWorstMs)
+        StreamWorstMs = ms;
+
+    if (pending == 0) {
+        printf("texture streaming: %u uploads, %.1f MB in %.1f ms over %u frames, %.3f ms on the "
+               "GL thread, worst frame %.3f ms\n",
+               TextureUploads.count, TextureUploads.bytes / (1024.0 * 1024.0),
+               (time_now() - StreamStart) * 1000, StreamFrames, TextureUploads.ms, StreamWorstMs);
+        StreamFrames = UINT32_MAX;
+    }
+}
+
 void draw() {
+    stream_textures();
     glClear(GL_COLOR_BUFFER_BIT);
 
     shader_activate(&Shader);
 
     texture_bind(&Wall, 0);
-    shader_set_int(&Shader, "texture0", 0);
+    shader_set_int_at(Texture0Location, 0);
 
     texture_bind(&Face, 1);
-    shader_set_int(&Shader, "texture1", 1);
+    shader_set_int_at(Texture1Location, 1);
 
     mat4 transform = rotate_y(45 * window_time());
-    shader_set_mat4(&Shader, "transform", &transform);
+    shader_set_mat4_at(TransformLocation, &transform);
 
-    shader_set_float(&Shader, "blend", blend);
+    shader_set_float_at(BlendLocation, blend);
 
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
@@ -90,7 +128,10 @@ int main() {
     window_set_key_handler(GLFW_KEY_UP, increase_blend, 10);
     window_set_key_handler(GLFW_KEY_DOWN, decrease_blend, 10);
     window_run();
+
+    texture_stream_uninit();
     window_uninit();
+    jobs_uninit();
 
     return 0;
 }
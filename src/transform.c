@@ -3,6 +3,7 @@
 static struct shader Shader;
 static struct texture Face;
 static GLuint VAO;
+static GLint Texture0Location;
 
 void init_vertex_data() {
     glGenVertexArrays(1, &VAO);
@@ -22,6 +23,7 @@ void init_vertex_data() {
 
 void init() {
     shader_init(&Shader, "shaders/transform_vs.glsl", "shaders/transform_fs.glsl");
+    Texture0Location = shader_location(&Shader, "texture0");
 
     texture_load_image(&Face, "assets/awesomeface.png");
 
@@ -36,21 +38,21 @@ void draw() {
     shader_activate(&Shader);
 
     texture_bind(&Face, 0);
-    shader_set_int(&Shader, "texture0", 0);
+    shader_set_int_at(Texture0Location, 0);
 
     mat4 projection = perspective(60, 8. / 6., 0.1, 100.);
-    shader_set_mat4(&Shader, "projection", &projection);
+    shader_set_mat4_at(Shader.projection_location, &projection);
 
     mat4 view = identity();
     mat4_comp(&view, translate((vec3){0., 0., -3.0}));
-    shader_set_mat4(&Shader, "view", &view);
+    shader_set_mat4_at(Shader.view_location, &view);
 
     mat4 model = identity();
     mat4_comp(&model, scale((vec3){1.2, 1.2, 1.2}));
     mat4_comp(&model, rotate_x(45 * window_time()));
     mat4_comp(&model, rotate_y(22.5 * window_time()));
     mat4_comp(&model, rotate_z(22.25 * window_time()));
-    shader_set_mat4(&Shader, "model", &model);
+    shader_set_mat4_at(Shader.model_location, &model);
 
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, cube_vertex_count);
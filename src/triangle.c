@@ -2,10 +2,15 @@
 #include "shader.h"
 
 static struct shader Shader;
+static GLint XOffsetLocation, YOffsetLocation;
 static GLuint TriangleVAO;
 
+// the triangle circles in fixed updates and is drawn in between the last two
+#define UPDATE_STEP (1.0 / 30)
+
 static float speed = 1.0;
-static float accumulator = 0.0;
+static double angle = 0.0;
+static double previous_angle = 0.0;
 
 void init_vertex_data() {
     float vertices[] = {
@@ -30,16 +35,22 @@ void init_vertex_data() {
     glEnableVertexAttribArray(1);
 }
 
+void update(double step) {
+    previous_angle = angle;
+    angle += step * speed;
+}
+
 void draw() {
     glClear(GL_COLOR_BUFFER_BIT);
 
-    accumulator += window_delta() * speed;
+    double alpha = window_alpha();
+    double current = previous_angle + (angle - previous_angle) * alpha;
 
     shader_activate(&Shader);
-    float xOffset = sin(accumulator) / 2.4;
-    float yOffset = cos(accumulator) / 2.4;
-    shader_set_float(&Shader, "xOffset", xOffset);
-    shader_set_float(&Shader, "yOffset", yOffset);
+    float xOffset = sin(current) / 2.4;
+    float yOffset = cos(current) / 2.4;
+    shader_set_float_at(XOffsetLocation, xOffset);
+    shader_set_float_at(YOffsetLocation, yOffset);
 
     glBindVertexArray(TriangleVAO);
     glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -62,8 +73,11 @@ int main() {
     window_set_clear_color(0.06, 0.08, 0.14, 1.);
 
     shader_init(&Shader, "shaders/triangle_vs.glsl", "shaders/triangle_fs.glsl");
+    XOffsetLocation = shader_location(&Shader, "xOffset");
+    YOffsetLocation = shader_location(&Shader, "yOffset");
     init_vertex_data();
 
+    window_set_update_callback(update, UPDATE_STEP);
     window_set_render_callback(draw);
     window_set_key_handler(GLFW_KEY_UP, increase_speed, 10);
     window_set_key_handler(GLFW_KEY_DOWN, decrease_speed, 10);
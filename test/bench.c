@@ -0,0 +1,151 @@
+#include "mmath.h"
+#include "util.h"
+#include "vector.h"
+
+struct bench {
+    char* name;
+    void (*f)(uint32_t iterations);
+    uint32_t iterations;
+};
+
+static volatile float sink;
+static volatile float seed = 1;
+
+static mat4 bench_matrix(uint32_t i) {
+    mat4 m = identity();
+    mat4_comp(&m, scale((vec3){seed + i % 3, 1, 2}));
+    mat4_comp(&m, rotate_y(i % 360));
+    mat4_comp(&m, translate((vec3){i % 7, 1, -2}));
+    return m;
+}
+
+void bench_mat4_mul_scalar(uint32_t iterations) {
+    mat4 a = bench_matrix(1), b = bench_matrix(2);
+    for (uint32_t i = 0; i < iterations; i++)
+        a = mat4_mul_scalar(b, a);
+    sink = a.x.x;
+}
+
+void bench_mat4_mul(uint32_t iterations) {
+    mat4 a = bench_matrix(1), b = bench_matrix(2);
+    for (uint32_t i = 0; i < iterations; i++)
+        a = mat4_mul(b, a);
+    sink = a.x.x;
+}
+
+void bench_mat4_apply_scalar(uint32_t iterations) {
+    mat4 m = bench_matrix(3);
+    vec4 v = {1, 2, 3, 1};
+    for (uint32_t i = 0; i < iterations; i++)
+        v = mat4_apply_scalar(m, v);
+    sink = v.x;
+}
+
+void bench_mat4_apply(uint32_t iterations) {
+    mat4 m = bench_matrix(3);
+    vec4 v = {1, 2, 3, 1};
+    for (uint32_t i = 0; i < iterations; i++)
+        v = mat4_apply(m, v);
+    sink = v.x;
+}
+
+#define BENCH_BATCH 1024
+
+void bench_mat4_mul_many_scalar(uint32_t iterations) {
+    static mat4 in[BENCH_BATCH];
+    for (uint32_t i = 0; i < BENCH_BATCH; i++)
+        in[i] = bench_matrix(i);
+
+    mat4 a = bench_matrix(5);
+    for (uint32_t n = 0; n < iterations / BENCH_BATCH; n++)
+        for (uint32_t i = 0; i < BENCH_BATCH; i++)
+            in[i] = mat4_mul_scalar(a, in[i]);
+    sink = in[BENCH_BATCH - 1].w.x;
+}
+
+void bench_mat4_mul_many(uint32_t iterations) {
+    static mat4 in[BENCH_BATCH];
+    for (uint32_t i = 0; i < BENCH_BATCH; i++)
+        in[i] = bench_matrix(i);
+
+    mat4 a = bench_matrix(5);
+    for (uint32_t n = 0; n < iterations / BENCH_BATCH; n++)
+        mat4_mul_many(a, in, in, BENCH_BATCH);
+    sink = in[BENCH_BATCH - 1].w.x;
+}
+
+void bench_transform_points_scalar(uint32_t iterations) {
+    static vec3 in[BENCH_BATCH];
+    for (uint32_t i = 0; i < BENCH_BATCH; i++)
+        in[i] = (vec3){i, i * 0.5f, -(float)i};
+
+    mat4 m = bench_matrix(7);
+    for (uint32_t n = 0; n < iterations / BENCH_BATCH; n++) {
+        for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+            vec4 r = mat4_apply_scalar(m, vec4_hom(in[i]));
+            in[i] = (vec3){r.x, r.y, r.z};
+        }
+    }
+    sink = in[BENCH_BATCH - 1].x;
+}
+
+void bench_transform_points(uint32_t iterations) {
+    static vec3 in[BENCH_BATCH];
+    for (uint32_t i = 0; i < BENCH_BATCH; i++)
+        in[i] = (vec3){i, i * 0.5f, -(float)i};
+
+    mat4 m = bench_matrix(7);
+    for (uint32_t n = 0; n < iterations / BENCH_BATCH; n++)
+        transform_points(m, in, in, BENCH_BATCH);
+    sink = in[BENCH_BATCH - 1].x;
+}
+
+void bench_mat4_inverse_affine(uint32_t iterations) {
+    mat4 m = bench_matrix(9);
+    for (uint32_t i = 0; i < iterations; i++)
+        m = mat4_inverse_affine(m);
+    sink = m.x.x;
+}
+
+void bench_mat4_normal_matrix(uint32_t iterations) {
+    mat4 m = bench_matrix(9);
+    float acc = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        m.w.x = i;
+        acc += mat4_normal_matrix(m).x.x;
+    }
+    sink = acc;
+}
+
+#define bench_func(fun, n)                          \
+    (struct bench) {                                \
+        .name = #fun, .f = fun, .iterations = n     \
+    }
+
+int main() {
+    struct vector benches;
+    vec_init(&benches, sizeof(struct bench));
+
+    vec_push(&benches, &bench_func(bench_mat4_mul_scalar, 10000000));
+    vec_push(&benches, &bench_func(bench_mat4_mul, 10000000));
+    vec_push(&benches, &bench_func(bench_mat4_apply_scalar, 10000000));
+    vec_push(&benches, &bench_func(bench_mat4_apply, 10000000));
+    vec_push(&benches, &bench_func(bench_mat4_mul_many_scalar, 10000000));
+    vec_push(&benches, &bench_func(bench_mat4_mul_many, 10000000));
+    vec_push(&benches, &bench_func(bench_transform_points_scalar, 10000000));
+    vec_push(&benches, &bench_func(bench_transform_points, 10000000));
+    vec_push(&benches, &bench_func(bench_mat4_inverse_affine, 10000000));
+    vec_push(&benches, &bench_func(bench_mat4_normal_matrix, 10000000));
+
+    for (uint32_t i = 0; i < benches.size; i++) {
+        struct bench* b = vec_item(&benches, i);
+
+        double start = time_now();
+        b->f(b->iterations);
+        double elapsed = time_now() - start;
+
+        printf("%-32s %8.2f ns/op\n", b->name, elapsed * 1e9 / b->iterations);
+    }
+
+    vec_uninit(&benches);
+}
@@ -1,11 +1,23 @@
+#include "camera.h"
+#include "frame_ring.h"
+#include "frustum.h"
 #include "image.h"
+#include "job.h"
 #include "list.h"
 #include "map.h"
+#include "mesh_optimize.h"
 #include "mmath.h"
+#include "model_cache.h"
 #include "mstring.h"
 #include "queue.h"
+#include "render_queue.h"
+#include "texture.h"
+#include "texture_compress.h"
+#include "texture_pack.h"
+#include "timestep.h"
 #include "util.h"
 #include "vector.h"
+#include "window.h"
 
 struct test {
     char* name;
@@ -394,6 +406,33 @@ void test_map_insert() {
     map_uninit(&m);
 }
 
+void test_map_ptr_hasher() {
+    struct map m;
+    map_init(&m, ptr_comparator, ptr_hasher);
+
+    char names[40][16];
+    const char* keys[40];
+    for (int i = 0; i < 40; i++) {
+        snprintf(names[i], sizeof(names[i]), "uniform%d", i);
+        keys[i] = string_intern(names[i]);
+        map_insert(&m, (void*)keys[i], (void*)(intptr_t)i);
+    }
+    map_realloc(&m, 64);
+
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < m.buckets.capacity; i++)
+        used += ((struct list*)vec_item(&m.buckets, i))->head != nullptr;
+    assert(used >= 20);
+
+    for (int i = 0; i < 40; i++) {
+        struct map_entry* e = map_find(&m, (void*)string_intern(names[i]));
+        assert(e && (intptr_t)e->item == i);
+    }
+
+    map_uninit(&m);
+    string_intern_clear();
+}
+
 void test_map_remove() {
     struct map m;
     map_init(&m, uint_comparator, uint_hasher);
@@ -479,6 +518,51 @@ void test_string_pop() {
     string_uninit(&s);
 }
 
+void test_string_inline() {
+    struct string s;
+    string_init(&s);
+
+    assert_eq(string_len(&s), 0);
+    assert(strcmp(string_ptr(&s), "") == 0);
+
+    string_append(&s, "material.specular", 17);
+    assert(string_is_inline(&s));
+
+    string_append(&s, ".shininess", 10);
+    assert(!string_is_inline(&s));
+    assert_eq(string_len(&s), 27);
+    assert(strcmp(string_ptr(&s), "material.specular.shininess") == 0);
+
+    string_pop_until(&s, '.');
+    assert_eq(string_len(&s), 18);
+    assert(strcmp(string_ptr(&s), "material.specular.") == 0);
+
+    struct string c;
+    string_clone(&s, &c);
+    assert(string_is_inline(&c));
+    assert(strcmp(string_ptr(&c), "material.specular.") == 0);
+
+    string_uninit(&c);
+    string_uninit(&s);
+}
+
+void test_string_intern() {
+    char name[] = "material.diffuse";
+
+    const char* a = string_intern("material.diffuse");
+    const char* b = string_intern(name);
+    const char* c = string_intern_n("material.diffuse.extra", 16);
+    const char* d = string_intern("material.specular");
+
+    assert(a != name);
+    assert(a == b);
+    assert(a == c);
+    assert(a != d);
+    assert(strcmp(d, "material.specular") == 0);
+
+    string_intern_clear();
+}
+
 static int feq(float a, float b) {
     return fabsf(a - b) < 1e-5f;
 }
@@ -526,6 +610,502 @@ void test_mat4_mul_chain() {
     assert(mat4_feq(A, expected));
 }
 
+void test_mat4_mul_scalar() {
+    mat4 A = identity();
+    mat4_comp(&A, scale((vec3){2, 3, 4}));
+    mat4_comp(&A, rotate_x(30));
+    mat4_comp(&A, translate((vec3){1, 2, 3}));
+
+    mat4 B = perspective(60, 1.5, 0.1, 100);
+
+    assert(mat4_feq(mat4_mul(A, B), mat4_mul_scalar(A, B)));
+    assert(mat4_feq(mat4_mul(B, A), mat4_mul_scalar(B, A)));
+
+    mat4 many[3] = {A, B, identity()};
+    mat4_mul_many(A, many, many, 3);
+    assert(mat4_feq(many[0], mat4_mul_scalar(A, A)));
+    assert(mat4_feq(many[1], mat4_mul_scalar(A, B)));
+    assert(mat4_feq(many[2], A));
+}
+
+void test_mat4_apply() {
+    mat4 M = identity();
+    mat4_comp(&M, scale((vec3){2, 2, 2}));
+    mat4_comp(&M, translate((vec3){1, 2, 3}));
+
+    vec4 p = mat4_apply(M, (vec4){1, 1, 1, 1});
+    assert(feq(p.x, 3) && feq(p.y, 4) && feq(p.z, 5) && feq(p.w, 1));
+
+    vec4 d = mat4_apply(M, (vec4){1, 1, 1, 0});
+    assert(feq(d.x, 2) && feq(d.y, 2) && feq(d.z, 2) && feq(d.w, 0));
+
+    vec3 in[2] = {{0, 0, 0}, {1, -1, 0.5}};
+    vec3 out[2];
+    transform_points(M, in, out, 2);
+    assert(feq(out[0].x, 1) && feq(out[0].y, 2) && feq(out[0].z, 3));
+    assert(feq(out[1].x, 3) && feq(out[1].y, 0) && feq(out[1].z, 4));
+}
+
+void test_mat4_inverse_affine() {
+    mat4 M = identity();
+    mat4_comp(&M, scale((vec3){2, 0.5, 4}));
+    mat4_comp(&M, rotate_y(37));
+    mat4_comp(&M, rotate_x(-12));
+    mat4_comp(&M, translate((vec3){-3, 2, 7}));
+
+    mat4 I = mat4_inverse_affine(M);
+    assert(mat4_feq(mat4_mul(M, I), identity()));
+    assert(mat4_feq(mat4_mul(I, M), identity()));
+}
+
+void test_mat4_normal_matrix() {
+    mat4 M = identity();
+    mat4_comp(&M, scale((vec3){1, 4, 1}));
+    mat4_comp(&M, rotate_z(45));
+    mat4_comp(&M, translate((vec3){5, 5, 5}));
+
+    // normal of the plane spanned by two tangents must stay perpendicular to them
+    vec3 t1 = {1, 0, 0}, t2 = {0, 0, 1}, n = {0, 1, 0};
+    vec4 mt1 = mat4_apply(M, (vec4){t1.x, t1.y, t1.z, 0});
+    vec4 mt2 = mat4_apply(M, (vec4){t2.x, t2.y, t2.z, 0});
+
+    mat3 N = mat4_normal_matrix(M);
+    vec3 mn = vec3_add(vec3_add(vec3_scale(N.x, n.x), vec3_scale(N.y, n.y)), vec3_scale(N.z, n.z));
+
+    assert(feq(vec3_dot(mn, (vec3){mt1.x, mt1.y, mt1.z}), 0));
+    assert(feq(vec3_dot(mn, (vec3){mt2.x, mt2.y, mt2.z}), 0));
+
+    mat3 R = mat4_normal_matrix(rotate_x(30));
+    mat4 r = rotate_x(30);
+    assert(feq(R.y.y, r.y.y) && feq(R.y.z, r.y.z) && feq(R.z.y, r.z.y));
+}
+
+static aabb box_at(vec3 c, float half) {
+    return (aabb){vec3_sub(c, vec3_new(half)), vec3_add(c, vec3_new(half))};
+}
+
+void test_half_float() {
+    assert_eq(float_to_half(0), 0);
+    assert_eq(float_to_half(-0.0f), 0x8000);
+    assert_eq(float_to_half(1), 0x3C00);
+    assert_eq(float_to_half(-2), 0xC000);
+    assert_eq(float_to_half(65504), 0x7BFF);
+    assert_eq(float_to_half(65520), 0x7C00);
+    assert_eq(float_to_half(INFINITY), 0x7C00);
+    assert_eq(float_to_half(ldexpf(1, -24)), 0x0001);
+    assert_eq(float_to_half(ldexpf(1, -26)), 0);
+    assert(isnan(half_to_float(float_to_half(NAN))));
+
+    // 1 + 2^-11 is halfway between two halves and rounds to the even one
+    assert_eq(float_to_half(1 + ldexpf(1, -11)), 0x3C00);
+    assert_eq(float_to_half(1 + 3 * ldexpf(1, -11)), 0x3C02);
+
+    // every finite half survives a round trip through float
+    uint32_t mismatched = 0;
+    for (uint32_t h = 0; h < 0x10000; h++) {
+        if ((h & 0x7C00) == 0x7C00)
+            continue;
+        mismatched += float_to_half(half_to_float(h)) != h;
+    }
+    assert_eq(mismatched, 0);
+}
+
+void test_snorm_octahedral() {
+    assert_eq(float_to_snorm16(1), 32767);
+    assert_eq(float_to_snorm16(-1), -32767);
+    assert_eq(float_to_snorm16(2), 32767);
+    assert_eq(float_to_snorm16(0), 0);
+    assert(snorm16_to_float(-32768) == -1);
+    assert(fabsf(snorm16_to_float(float_to_snorm16(0.3)) - 0.3f) < 1.0f / 32767);
+
+    // unit vectors through octahedral snorm16 and back stay within a tiny angle
+    uint32_t seed = 4242;
+    float worst = 1;
+    for (uint32_t i = 0; i < 1000; i++) {
+        float v[3];
+        for (int j = 0; j < 3; j++) {
+            seed = seed * 1664525 + 1013904223;
+            v[j] = (float)(seed >> 8) / (1 << 23) - 1;
+        }
+        vec3 n = vec3_norm((vec3){v[0], v[1], v[2] + 1e-3f});
+
+        vec2 e = oct_encode(n);
+        vec2 q = {snorm16_to_float(float_to_snorm16(e.x)),
+                  snorm16_to_float(float_to_snorm16(e.y))};
+        worst = fminf(worst, vec3_dot(n, oct_decode(q)));
+    }
+    assert(worst > 0.99999f);
+
+    vec3 down = oct_decode(oct_encode((vec3){0, 0, -1}));
+    assert(down.z < -0.9999f);
+}
+
+void test_frustum_planes() {
+    mat4 view = look_at((vec3){0, 0, 0}, (vec3){0, 0, -1}, (vec3){0, 1, 0});
+    mat4 projection = perspective(90, 1, 0.1, 100);
+    struct frustum f = frustum_from_matrix(mat4_mul(projection, view));
+
+    assert(frustum_test_aabb(&f, box_at((vec3){0, 0, -5}, 1)));
+    assert(!frustum_test_aabb(&f, box_at((vec3){0, 0, 5}, 1)));
+    assert(!frustum_test_aabb(&f, box_at((vec3){0, 0, -200}, 1)));
+    assert(!frustum_test_aabb(&f, box_at((vec3){20, 0, -5}, 1)));
+    assert(frustum_test_aabb(&f, box_at((vec3){5.5, 0, -5}, 1)));
+
+    assert(frustum_test_sphere(&f, (sphere){{0, 0, -50}, 1}));
+    assert(!frustum_test_sphere(&f, (sphere){{0, -20, -5}, 1}));
+
+    // local space frustum of an object moved behind the camera
+    mat4 model = translate((vec3){0, 0, 10});
+    struct frustum local = frustum_from_matrix(mat4_mul(mat4_mul(projection, view), model));
+    assert(!frustum_test_aabb(&local, box_at((vec3){0, 0, -5}, 1)));
+    assert(frustum_test_aabb(&local, box_at((vec3){0, 0, -15}, 1)));
+}
+
+void test_frustum_cull() {
+    mat4 view = look_at((vec3){0, 0, 0}, (vec3){1, 0, -1}, (vec3){0, 1, 0});
+    mat4 projection = perspective(60, 1.5, 0.1, 50);
+    struct frustum f = frustum_from_matrix(mat4_mul(projection, view));
+
+    aabb boxes[103];
+    uint8_t visible[103];
+    uint32_t seed = 12345;
+    for (int i = 0; i < 103; i++) {
+        float v[4];
+        for (int j = 0; j < 4; j++) {
+            seed = seed * 1664525 + 1013904223;
+            v[j] = (float)(seed >> 8) / (1 << 24);
+        }
+        boxes[i] = box_at((vec3){v[0] * 80 - 40, v[1] * 20 - 10, v[2] * 80 - 40}, v[3] * 3);
+    }
+
+    uint32_t drawn = frustum_cull_aabbs(&f, boxes, 103, visible);
+
+    uint32_t expected = 0, mismatched = 0;
+    for (int i = 0; i < 103; i++) {
+        int v = frustum_test_aabb(&f, boxes[i]);
+        expected += v;
+        mismatched += v != visible[i];
+    }
+
+    assert_eq(mismatched, 0);
+    assert_eq(drawn, expected);
+    assert(drawn > 0 && drawn < 103);
+}
+
+void test_draw_key_order() {
+    // program beats material beats vao beats depth
+    assert(draw_key(1, 0, 0, 0) > draw_key(0, 1000, 100, 1e6));
+    assert(draw_key(0, 2, 0, 0) > draw_key(0, 1, 100, 1e6));
+    assert(draw_key(0, 0, 2, 0) > draw_key(0, 0, 1, 1e6));
+    assert(draw_key(0, 0, 0, 2.5) > draw_key(0, 0, 0, 2.25));
+    assert(draw_key(0, 0, 0, 0.001) > draw_key(0, 0, 0, 0));
+    assert(draw_key(0, 0, 0, -5) == draw_key(0, 0, 0, 0));
+}
+
+void test_render_queue_sort() {
+    struct render_queue q;
+    render_queue_init(&q);
+
+    uint32_t seed = 777;
+    for (uint32_t i = 0; i < 1000; i++) {
+        seed = seed * 1664525 + 1013904223;
+        render_queue_push(&q, draw_key(seed % 3, (seed >> 8) % 17, 5, (seed >> 16) % 100), i);
+    }
+    render_queue_sort(&q);
+
+    assert_eq(render_queue_size(&q), 1000);
+
+    struct draw_item* items = render_queue_items(&q);
+    uint32_t ordered = 1, stable = 1;
+    uint8_t seen[1000] = {0};
+    for (uint32_t i = 0; i < 1000; i++) {
+        seen[items[i].index] = 1;
+        if (i > 0 && items[i - 1].key > items[i].key)
+            ordered = 0;
+        if (i > 0 && items[i - 1].key == items[i].key && items[i - 1].index > items[i].index)
+            stable = 0;
+    }
+    assert(ordered);
+    assert(stable);
+
+    uint32_t all = 1;
+    for (uint32_t i = 0; i < 1000; i++)
+        all &= seen[i];
+    assert(all);
+
+    render_queue_clear(&q);
+    assert_eq(render_queue_size(&q), 0);
+    render_queue_sort(&q);
+
+    render_queue_uninit(&q);
+}
+
+#define GRID 40
+#define GRID_VERTICES ((GRID + 1) * (GRID + 1))
+#define GRID_INDICES (GRID * GRID * 6)
+
+// a flat grid with its triangles shuffled, vertex i stores i in its last component
+static void grid_mesh(float (*vertices)[4], uint32_t* indices) {
+    for (uint32_t y = 0; y <= GRID; y++)
+        for (uint32_t x = 0; x <= GRID; x++) {
+            uint32_t i = y * (GRID + 1) + x;
+            vertices[i][0] = x;
+            vertices[i][1] = 0;
+            vertices[i][2] = y;
+            vertices[i][3] = i;
+        }
+
+    uint32_t k = 0;
+    for (uint32_t y = 0; y < GRID; y++)
+        for (uint32_t x = 0; x < GRID; x++) {
+            uint32_t i = y * (GRID + 1) + x;
+            uint32_t quad[6] = {i, i + GRID + 1, i + 1, i + 1, i + GRID + 1, i + GRID + 2};
+            memcpy(&indices[k], quad, sizeof(quad));
+            k += 6;
+        }
+
+    uint32_t seed = 99;
+    for (uint32_t t = GRID_INDICES / 3 - 1; t > 0; t--) {
+        seed = seed * 1664525 + 1013904223;
+        uint32_t o = (seed >> 8) % (t + 1);
+        for (uint32_t j = 0; j < 3; j++) {
+            uint32_t tmp = indices[t * 3 + j];
+            indices[t * 3 + j] = indices[o * 3 + j];
+            indices[o * 3 + j] = tmp;
+        }
+    }
+}
+
+static int _u64_comparator(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// sorted list of triangles keyed independent of their winding rotation
+static void triangle_keys(const uint32_t* indices, uint32_t count, uint64_t* keys) {
+    for (uint32_t t = 0; t < count / 3; t++) {
+        uint32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+        // rotate the smallest index first, keeps the winding
+        while (a > b || a > c) {
+            uint32_t tmp = a;
+            a = b;
+            b = c;
+            c = tmp;
+        }
+        keys[t] = (uint64_t)a << 42 | (uint64_t)b << 21 | c;
+    }
+    qsort(keys, count / 3, sizeof(uint64_t), _u64_comparator);
+}
+
+void test_mesh_optimize_vertex_cache() {
+    static float vertices[GRID_VERTICES][4];
+    static uint32_t indices[GRID_INDICES];
+    static uint64_t before[GRID_INDICES / 3], after[GRID_INDICES / 3];
+    grid_mesh(vertices, indices);
+
+    struct mesh_cache_stats stats = mesh_cache_analyze(indices, GRID_INDICES, GRID_VERTICES, 16);
+    triangle_keys(indices, GRID_INDICES, before);
+
+    mesh_optimize_vertex_cache(indices, GRID_INDICES, GRID_VERTICES);
+
+    struct mesh_cache_stats optimized =
+        mesh_cache_analyze(indices, GRID_INDICES, GRID_VERTICES, 16);
+    triangle_keys(indices, GRID_INDICES, after);
+
+    assert_eq(optimized.triangles, GRID_INDICES / 3);
+    assert(memcmp(before, after, sizeof(before)) == 0);
+    assert(stats.acmr > 2.5);
+    assert(optimized.acmr < 0.8);
+    assert(optimized.atvr < 1.6);
+
+    // overdraw ordering keeps the triangles and most of the cache efficiency, and on a flat grid
+    // where every cluster ties it keeps the cache order as is
+    static uint32_t cache_order[GRID_INDICES];
+    memcpy(cache_order, indices, sizeof(indices));
+    mesh_optimize_overdraw(indices, GRID_INDICES, vertices[0], sizeof(vertices[0]), GRID_VERTICES);
+    assert(memcmp(cache_order, indices, sizeof(indices)) == 0);
+
+    struct mesh_cache_stats reordered =
+        mesh_cache_analyze(indices, GRID_INDICES, GRID_VERTICES, 16);
+    triangle_keys(indices, GRID_INDICES, after);
+
+    assert(memcmp(before, after, sizeof(before)) == 0);
+    assert(reordered.acmr < optimized.acmr * 1.05);
+}
+
+void test_mesh_optimize_vertex_fetch() {
+    static float vertices[GRID_VERTICES][4];
+    static uint32_t indices[GRID_INDICES], original[GRID_INDICES];
+    grid_mesh(vertices, indices);
+
+    // leave the last row unreferenced
+    uint32_t index_count = 0;
+    for (uint32_t i = 0; i < GRID_INDICES; i += 3)
+        if (indices[i] < GRID_VERTICES - GRID - 1 && indices[i + 1] < GRID_VERTICES - GRID - 1 &&
+            indices[i + 2] < GRID_VERTICES - GRID - 1) {
+            memmove(&indices[index_count], &indices[i], 3 * sizeof(uint32_t));
+            index_count += 3;
+        }
+    memcpy(original, indices, index_count * sizeof(uint32_t));
+
+    uint32_t vertex_count =
+        mesh_optimize_vertex_fetch(vertices, sizeof(vertices[0]), GRID_VERTICES, indices, index_count);
+
+    assert_eq(vertex_count, GRID_VERTICES - (GRID + 1));
+
+    uint32_t same = 1, first_use = 1, highest = 0;
+    for (uint32_t i = 0; i < index_count; i++) {
+        same &= vertices[indices[i]][3] == original[i];
+        if (indices[i] > highest + (i > 0))
+            first_use = 0;
+        if (indices[i] > highest)
+            highest = indices[i];
+    }
+    assert(same);
+    assert(first_use);
+}
+
+void test_mesh_simplify() {
+    static float vertices[GRID_VERTICES][4];
+    static uint32_t indices[GRID_INDICES], lod[GRID_INDICES];
+    grid_mesh(vertices, indices);
+
+    // a flat grid collapses down to its locked border without any error
+    float error = -1;
+    uint32_t count = mesh_simplify(lod, indices, GRID_INDICES, vertices[0], sizeof(vertices[0]),
+                                   GRID_VERTICES, GRID_INDICES / 4, 1e-3f, &error);
+    assert(count <= GRID_INDICES / 4);
+    assert(count > 0 && count % 3 == 0);
+    assert(error >= 0 && error < 1e-3f);
+
+    uint32_t valid = 1;
+    for (uint32_t t = 0; t < count / 3; t++) {
+        uint32_t a = lod[t * 3], b = lod[t * 3 + 1], c = lod[t * 3 + 2];
+        valid &= a < GRID_VERTICES && b < GRID_VERTICES && c < GRID_VERTICES;
+        valid &= a != b && b != c && a != c;
+
+        // still facing up like the grid
+        float ux = vertices[b][0] - vertices[a][0], uz = vertices[b][2] - vertices[a][2];
+        float vx = vertices[c][0] - vertices[a][0], vz = vertices[c][2] - vertices[a][2];
+        valid &= uz * vx - ux * vz > 0;
+    }
+    assert(valid);
+
+    // once the surface is curved the error bound stops the simplifier early
+    for (uint32_t i = 0; i < GRID_VERTICES; i++)
+        vertices[i][1] = sinf(vertices[i][0] * 0.5f) * sinf(vertices[i][2] * 0.5f) * 4;
+
+    count = mesh_simplify(lod, indices, GRID_INDICES, vertices[0], sizeof(vertices[0]),
+                          GRID_VERTICES, 0, 0.2f, &error);
+    assert(count > GRID_INDICES / 8);
+    assert(count < GRID_INDICES);
+    assert(error <= 0.2f);
+
+    uint32_t coarse = mesh_simplify(lod, indices, GRID_INDICES, vertices[0], sizeof(vertices[0]),
+                                    GRID_VERTICES, 0, 1.0f, &error);
+    assert(coarse < count);
+    assert(error > 0.2f);
+}
+
+void test_mesh_generate_lod_indices() {
+    static float vertices[GRID_VERTICES][4];
+    static uint32_t indices[GRID_INDICES * MESH_MAX_LODS];
+    grid_mesh(vertices, indices);
+    for (uint32_t i = 0; i < GRID_VERTICES; i++)
+        vertices[i][1] = sinf(vertices[i][0] * 0.3f) * sinf(vertices[i][2] * 0.3f);
+
+    struct mesh_lod lods[MESH_MAX_LODS];
+    uint32_t count = mesh_generate_lod_indices(lods, MESH_MAX_LODS, indices, GRID_INDICES,
+                                               vertices[0], sizeof(vertices[0]), GRID_VERTICES,
+                                               0.5f);
+    assert(count > 1 && count <= MESH_MAX_LODS);
+    assert(lods[0].first_index == 0 && lods[0].index_count == GRID_INDICES && lods[0].error == 0);
+
+    uint32_t valid = 1;
+    for (uint32_t l = 1; l < count; l++) {
+        struct mesh_lod prev = lods[l - 1], lod = lods[l];
+        assert_eq(lod.first_index, prev.first_index + prev.index_count);
+        assert(lod.first_index + lod.index_count <= GRID_INDICES * MESH_MAX_LODS);
+        assert(lod.index_count > 0 && lod.index_count % 3 == 0);
+        assert(lod.index_count < prev.index_count);
+        assert(lod.error >= prev.error);
+
+        for (uint32_t i = 0; i < lod.index_count; i++)
+            valid &= indices[lod.first_index + i] < GRID_VERTICES;
+    }
+    assert(valid);
+
+    // close meshes get the full level, coarser ones as they move away
+    assert_eq(mesh_lod_select(lods, count, 0, 100), 0);
+    assert_eq(mesh_lod_select(lods, count, 1e9f, 100), count - 1);
+    uint32_t last = 0;
+    for (float depth = 1; depth < 1e6f; depth *= 2) {
+        uint32_t lod = mesh_lod_select(lods, count, depth, 100);
+        assert(lod >= last);
+        last = lod;
+    }
+
+    // too few triangles to simplify keep only the full level
+    assert_eq(mesh_generate_lod_indices(lods, MESH_MAX_LODS, indices, 3, vertices[0],
+                                        sizeof(vertices[0]), GRID_VERTICES, 0.5f),
+              1);
+}
+
+// checks the parts of a split against the source triangles, returns the part count
+static uint32_t _test_split(const uint32_t* indices, uint32_t index_count, uint32_t vertex_count,
+                            uint32_t max_vertices) {
+    uint32_t* part_indices = malloc(index_count * sizeof(uint32_t));
+    uint32_t* vertex_map = malloc(index_count * sizeof(uint32_t));
+    struct vector parts;
+    vec_init(&parts, sizeof(struct mesh_part));
+
+    uint32_t count = mesh_split_indices(part_indices, vertex_map, indices, index_count,
+                                        vertex_count, max_vertices, &parts);
+    assert_eq(count, parts.size);
+
+    uint32_t valid = 1, triangles = 0, next_index = 0, next_vertex = 0;
+    for (uint32_t p = 0; p < count; p++) {
+        struct mesh_part* part = vec_item(&parts, p);
+        valid &= part->first_index == next_index && part->first_vertex == next_vertex;
+        valid &= part->vertex_count <= max_vertices && part->index_count % 3 == 0;
+
+        for (uint32_t i = 0; i < part->index_count; i++) {
+            uint32_t local = part_indices[part->first_index + i];
+            valid &= local < part->vertex_count && local <= UINT16_MAX;
+            valid &= vertex_map[part->first_vertex + local] == indices[part->first_index + i];
+        }
+
+        triangles += part->index_count / 3;
+        next_index += part->index_count;
+        next_vertex += part->vertex_count;
+    }
+    assert(valid);
+    assert_eq(triangles, index_count / 3);
+
+    vec_uninit(&parts);
+    free(vertex_map);
+    free(part_indices);
+
+    return count;
+}
+
+void test_mesh_split_indices() {
+    static float vertices[GRID_VERTICES][4];
+    static uint32_t indices[GRID_INDICES];
+    grid_mesh(vertices, indices);
+
+    assert(_test_split(indices, GRID_INDICES, GRID_VERTICES, 200) > GRID_VERTICES / 200);
+    assert_eq(_test_split(indices, GRID_INDICES, GRID_VERTICES, GRID_VERTICES), 1);
+
+    // more vertices than 16 bit indices reach, every triangle with vertices of its own
+    uint32_t large_count = 3 * 40000;
+    uint32_t* large = malloc(large_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < large_count; i++)
+        large[i] = i;
+    assert_eq(_test_split(large, large_count, large_count, UINT16_MAX), 2);
+    free(large);
+}
+
 void test_image_png() {
     struct image img;
     assert(image_load("assets/blue.png", &img));
@@ -544,11 +1124,709 @@ void test_image_png() {
     image_uninit(&img);
 }
 
+// largest per channel difference between the pixels and the decoded block
+static int bc_block_error(const uint8_t* pixels, const uint8_t* decoded, uint32_t channels) {
+    int worst = 0;
+    for (uint32_t i = 0; i < 16; i++)
+        for (uint32_t c = 0; c < channels; c++) {
+            int d = abs(pixels[i * 4 + c] - decoded[i * 4 + c]);
+            worst = d > worst ? d : worst;
+        }
+    return worst;
+}
+
+void test_bc1_block() {
+    uint8_t pixels[64], block[8], decoded[64];
+
+    // a gradient along one axis is exactly what the endpoints and palette can express
+    for (uint32_t i = 0; i < 16; i++) {
+        uint8_t v = i * 16;
+        pixels[i * 4 + 0] = v;
+        pixels[i * 4 + 1] = v / 2;
+        pixels[i * 4 + 2] = 255 - v;
+        pixels[i * 4 + 3] = 255;
+    }
+    bc1_encode_block(pixels, block);
+    bc1_decode_block(block, decoded);
+    assert(bc_block_error(pixels, decoded, 3) <= 48);
+    assert(bc_block_error(pixels, decoded, 4) <= 48);
+
+    // a solid block only loses the 565 rounding
+    for (uint32_t i = 0; i < 16; i++)
+        memcpy(&pixels[i * 4], (uint8_t[]){200, 100, 50, 255}, 4);
+    bc1_encode_block(pixels, block);
+    bc1_decode_block(block, decoded);
+    assert(bc_block_error(pixels, decoded, 4) <= 4);
+}
+
+void test_bc3_block() {
+    uint8_t pixels[64], block[16], decoded[64];
+    for (uint32_t i = 0; i < 16; i++) {
+        pixels[i * 4 + 0] = 30;
+        pixels[i * 4 + 1] = 60;
+        pixels[i * 4 + 2] = 90;
+        pixels[i * 4 + 3] = i < 8 ? 0 : 255;
+    }
+
+    bc3_encode_block(pixels, block);
+    bc3_decode_block(block, decoded);
+    assert(bc_block_error(pixels, decoded, 3) <= 4);
+
+    // two alpha levels land exactly on the endpoints
+    uint32_t alpha_exact = 1;
+    for (uint32_t i = 0; i < 16; i++)
+        alpha_exact &= decoded[i * 4 + 3] == pixels[i * 4 + 3];
+    assert(alpha_exact);
+}
+
+// rewrites 4 bytes of a file in place
+static void _test_patch_u32(const char* path, long offset, uint32_t value) {
+    FILE* f = fopen(path, "r+b");
+    assert(f != nullptr);
+    if (!f)
+        return;
+    fseek(f, offset, SEEK_SET);
+    fwrite(&value, sizeof(value), 1, f);
+    fclose(f);
+}
+
+// keeps the first size bytes of a file
+static void _test_truncate(const char* path, size_t size) {
+    char* data = malloc(size);
+    FILE* f = fopen(path, "rb");
+    assert(f && data && fread(data, 1, size, f) == size);
+    if (f)
+        fclose(f);
+
+    f = fopen(path, "wb");
+    assert(f != nullptr);
+    if (f) {
+        fwrite(data, 1, size, f);
+        fclose(f);
+    }
+    free(data);
+}
+
+void test_texture_compress_image() {
+    static uint8_t data[20 * 12 * 4];
+    for (uint32_t i = 0; i < 20 * 12; i++) {
+        data[i * 4 + 0] = i;
+        data[i * 4 + 1] = i * 3;
+        data[i * 4 + 2] = 128;
+        data[i * 4 + 3] = 255;
+    }
+    struct image img = {data, 20, 12, 4};
+
+    assert_eq(texture_compression_for(&img), TEXTURE_COMPRESSION_BC1);
+    data[3] = 10;
+    assert_eq(texture_compression_for(&img), TEXTURE_COMPRESSION_BC3);
+
+    struct compressed_image out;
+    assert(texture_compress_image(&img, TEXTURE_COMPRESSION_BC3, &out));
+
+    // 20x12, 10x6, 5x3, 2x1, 1x1
+    assert_eq(out.levels, 5);
+    assert_eq(out.offsets[1], 5 * 3 * 16);
+    assert_eq(out.offsets[2] - out.offsets[1], 3 * 2 * 16);
+    assert_eq(out.offsets[5] - out.offsets[4], 16);
+
+    const char* source = "/tmp/test_texture_compress.png";
+    const char* path = "/tmp/test_texture_compress.png" TEXTURE_COMPRESS_EXTENSION;
+    FILE* f = fopen(source, "w");
+    assert(f != nullptr);
+    if (!f)
+        return;
+    fputs("png", f);
+    fclose(f);
+
+    struct compressed_image read;
+    assert(compressed_image_write(&out, path, source));
+    assert(compressed_image_read(&read, path, source));
+    assert_eq(read.levels, out.levels);
+    assert_eq(read.compression, TEXTURE_COMPRESSION_BC3);
+    assert(read.data && memcmp(read.data, out.data, out.offsets[out.levels]) == 0);
+    compressed_image_uninit(&read);
+
+    // a level size that doesn't match its dimensions, a larger image than the levels hold, and
+    // levels ending past a truncated file
+    long offsets = offsetof(struct compressed_image_header, offsets);
+    long width = offsetof(struct compressed_image_header, width);
+    for (int corruption = 0; corruption < 3; corruption++) {
+        assert(compressed_image_write(&out, path, source));
+        if (corruption == 0)
+            _test_patch_u32(path, offsets + 2 * sizeof(uint32_t), out.offsets[2] + 16);
+        else if (corruption == 1)
+            _test_patch_u32(path, width, 40);
+        else
+            _test_truncate(path, sizeof(struct compressed_image_header) + out.offsets[1]);
+
+        assert(!compressed_image_read(&read, path, source));
+        assert(read.data == nullptr);
+    }
+
+    // a changed source invalidates the cache
+    f = fopen(source, "a");
+    fputs("more", f);
+    fclose(f);
+    assert(!compressed_image_read(&read, path, source));
+
+    compressed_image_uninit(&out);
+    remove(path);
+    remove(source);
+}
+
+void test_model_cache() {
+    const char* source = "/tmp/test_model_cache.obj";
+    const char* path = "/tmp/test_model_cache.obj" MODEL_CACHE_EXTENSION;
+    const char* library = "/tmp/test_model_cache.mtl";
+
+    FILE* f = fopen(source, "w");
+    assert(f != nullptr);
+    if (!f)
+        return;
+    fputs("# test\nmtllib  test_model_cache.mtl\r\nv 0 0 0\n", f);
+    fclose(f);
+
+    f = fopen(library, "w");
+    fputs("newmtl body\n", f);
+    fclose(f);
+
+    float vertices[3][5] = {{0, 0, 0, 0, 0}, {1, 0, 0, 1, 0}, {0, 1, 0, 0, 1}};
+    uint32_t indices[3] = {0, 1, 2};
+    aabb box = {{0, 0, 0}, {1, 1, 0}};
+    sphere s = {{0.5, 0.5, 0}, 0.75};
+    struct model_cache_lod lods[2] = {{0, 3, 0}, {0, 3, 0.25f}};
+
+    struct model_cache_writer w;
+    model_cache_writer_init(&w);
+    model_cache_add_mesh(&w, vertices, sizeof(vertices[0]), 3, indices, 3, lods, 2, 1, box, s);
+    model_cache_add_mesh(&w, vertices, sizeof(vertices[0]), 2, indices, 0, nullptr, 0, 0, box, s);
+    model_cache_add_material(&w, "body", "diffuse.png", nullptr, 32);
+    model_cache_add_material(&w, nullptr, nullptr, "specular.png", 16);
+    assert(model_cache_write(&w, path, source, sizeof(vertices[0]), 2));
+    model_cache_writer_uninit(&w);
+
+    struct model_cache cache;
+    assert(!model_cache_open(&cache, path, source, sizeof(vertices[0]) + 4, 2));
+    assert(!model_cache_open(&cache, path, source, sizeof(vertices[0]), 0));
+    assert(model_cache_open(&cache, path, source, sizeof(vertices[0]), 2));
+    if (!cache.map)
+        return;
+
+    assert_eq(cache.header->mesh_count, 2);
+    assert_eq(cache.header->material_count, 2);
+    assert_eq(cache.header->materials_size, 12);
+
+    struct model_cache_mesh* m = &cache.meshes[0];
+    assert_eq(m->vertex_count, 3);
+    assert_eq(m->index_count, 3);
+    assert_eq(m->material_id, 1);
+    assert_eq((uintptr_t)model_cache_vertices(&cache, m) % MODEL_CACHE_ALIGN, 0);
+    assert(memcmp(model_cache_vertices(&cache, m), vertices, sizeof(vertices)) == 0);
+    assert(memcmp(model_cache_indices(&cache, m), indices, sizeof(indices)) == 0);
+    assert(m->bounds.max.y == 1 && m->bounding_sphere.radius == 0.75f);
+    assert_eq(m->lod_count, 2);
+    assert(m->lods[1].index_count == 3 && m->lods[1].error == 0.25f);
+    assert_eq(cache.meshes[1].lod_count, 0);
+    assert_eq(cache.meshes[1].vertex_count, 2);
+
+    struct model_cache_material* mat = &cache.materials[0];
+    assert(mat->shininess == 32);
+    assert(strcmp(model_cache_string(&cache, mat->name), "body") == 0);
+    assert(strcmp(model_cache_string(&cache, mat->diffuse), "diffuse.png") == 0);
+    assert(model_cache_string(&cache, mat->specular) == nullptr);
+    assert(model_cache_string(&cache, cache.materials[1].name) == nullptr);
+    assert(strcmp(model_cache_string(&cache, cache.materials[1].specular), "specular.png") == 0);
+
+    model_cache_close(&cache);
+
+    // a changed material library or source invalidates the cache
+    f = fopen(library, "a");
+    fputs("Ns 16\n", f);
+    fclose(f);
+    assert(!model_cache_open(&cache, path, source, sizeof(vertices[0]), 2));
+
+    f = fopen(source, "a");
+    fputs("v 1 0 0\n", f);
+    fclose(f);
+    assert(!model_cache_open(&cache, path, source, sizeof(vertices[0]), 2));
+
+    remove(path);
+    remove(source);
+    remove(library);
+}
+
+void test_model_cache_corrupt() {
+    const char* source = "/tmp/test_model_cache_corrupt.obj";
+    const char* path = "/tmp/test_model_cache_corrupt.obj" MODEL_CACHE_EXTENSION;
+
+    FILE* f = fopen(source, "w");
+    assert(f != nullptr);
+    if (!f)
+        return;
+    fputs("v 0 0 0\n", f);
+    fclose(f);
+
+    float vertices[3][3] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}};
+    uint32_t indices[3] = {0, 1, 2};
+    aabb box = {{0, 0, 0}, {1, 1, 0}};
+    sphere s = {{0.5, 0.5, 0}, 0.75};
+
+    long meshes = sizeof(struct model_cache_header);
+    long materials = meshes + sizeof(struct model_cache_mesh);
+    long strings = materials + sizeof(struct model_cache_material);
+    struct model_cache cache;
+
+    // 0: intact, 1: material id past the materials, 2: string offset past the table,
+    // 3: unterminated table
+    for (int corruption = 0; corruption < 4; corruption++) {
+        struct model_cache_writer w;
+        model_cache_writer_init(&w);
+        model_cache_add_mesh(&w, vertices, sizeof(vertices[0]), 3, indices, 3, nullptr, 0, 0,
+                             box, s);
+        model_cache_add_material(&w, "body", nullptr, nullptr, 32);
+        assert(model_cache_write(&w, path, source, sizeof(vertices[0]), 0));
+        model_cache_writer_uninit(&w);
+
+        if (corruption == 1)
+            _test_patch_u32(path, meshes + offsetof(struct model_cache_mesh, material_id), 1);
+        else if (corruption == 2)
+            _test_patch_u32(path, materials + offsetof(struct model_cache_material, diffuse), 5);
+        else if (corruption == 3)
+            _test_patch_u32(path, strings + 1, 0x41414141);
+
+        int opened = model_cache_open(&cache, path, source, sizeof(vertices[0]), 0);
+        assert_eq(opened, corruption == 0);
+        model_cache_close(&cache);
+    }
+
+    remove(path);
+    remove(source);
+}
+
+static void _test_jobs_square(uint32_t start, uint32_t end, void* arg) {
+    uint64_t* items = arg;
+    for (uint32_t i = start; i < end; i++)
+        items[i] = (uint64_t)i * i;
+}
+
+static void _test_jobs_count(void* arg) {
+    atomic_fetch_add((atomic_uint*)arg, 1);
+}
+
+void test_jobs_inline() {
+    uint64_t items[100] = {0};
+    job_parallel_for(100, 8, _test_jobs_square, items);
+
+    for (uint32_t i = 0; i < 100; i++)
+        assert_eq(items[i], (uint64_t)i * i);
+
+    atomic_uint counter = 0;
+    struct job* root = job_create(nullptr, nullptr);
+    for (int i = 0; i < 10; i++)
+        job_run(job_create_child(root, _test_jobs_count, &counter));
+    job_run(root);
+    job_wait(root);
+
+    assert_eq(atomic_load(&counter), 10);
+}
+
+void test_jobs_parallel_for() {
+    jobs_init(4);
+    assert_eq(jobs_thread_count(), 4);
+
+    uint32_t count = 100000;
+    uint64_t* items = calloc(count, sizeof(uint64_t));
+    job_parallel_for(count, 64, _test_jobs_square, items);
+
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < count; i++)
+        wrong += items[i] != (uint64_t)i * i;
+    assert_eq(wrong, 0);
+
+    free(items);
+    jobs_uninit();
+}
+
+void test_jobs_children() {
+    jobs_init(4);
+
+    atomic_uint counter = 0;
+    for (int round = 0; round < 10; round++) {
+        struct job* root = job_create(nullptr, nullptr);
+        for (int i = 0; i < 1000; i++)
+            job_run(job_create_child(root, _test_jobs_count, &counter));
+        job_run(root);
+        job_wait(root);
+
+        assert_eq(atomic_load(&counter), (round + 1) * 1000);
+    }
+
+    jobs_uninit();
+}
+
+static void _test_jobs_visit(uint32_t start, uint32_t end, void* arg) {
+    atomic_uint* visits = arg;
+    for (uint32_t i = start; i < end; i++)
+        atomic_fetch_add_explicit(&visits[i], 1, memory_order_relaxed);
+}
+
+// every item exactly once, with more single item chunks than a thread has job slots
+static void _test_jobs_many(uint32_t count) {
+    atomic_uint* visits = calloc(count, sizeof(atomic_uint));
+    job_parallel_for(count, 1, _test_jobs_visit, visits);
+
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < count; i++)
+        wrong += atomic_load(&visits[i]) != 1;
+    assert_eq(wrong, 0);
+
+    free(visits);
+}
+
+void test_jobs_pool_reuse() {
+    // inline, before jobs_init
+    _test_jobs_many(JOB_POOL_SIZE + 904);
+    _test_jobs_many(50000);
+
+    uint32_t threads[] = {1, 4};
+    for (uint32_t t = 0; t < 2; t++) {
+        jobs_init(threads[t]);
+        _test_jobs_many(JOB_POOL_SIZE + 904);
+        _test_jobs_many(50000);
+        jobs_uninit();
+    }
+}
+
+// Needs a GL context, passes without checking anything when no display is available
+void test_texture_stream() {
+    if (!glfwInit())
+        return;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    GLFWwindow* window = glfwCreateWindow(1, 1, "tests", nullptr, nullptr);
+    if (!window) {
+        glfwTerminate();
+        return;
+    }
+
+    glfwMakeContextCurrent(window);
+    assert(load_gl_procs((ProcLoader)glfwGetProcAddress));
+
+    jobs_init(2);
+    texture_stream_init();
+
+    struct texture tex;
+    texture_load_async(&tex, "assets/blue.png", 0);
+    assert(tex.id != 0);
+    assert_eq(tex.width, 0);
+
+    // decode on a job, map a pixel buffer, copy on a job, upload from the buffer
+    int copied = 0;
+    for (int i = 0; i < 100000 && texture_stream_update(); i++) {
+        struct texture_stream_request** requests = TextureStreamer.requests.data;
+        copied |= requests[0]->state == TEXTURE_STREAM_COPYING;
+        sched_yield();
+    }
+
+    assert(copied);
+    assert_eq(TextureStreamer.requests.size, 0);
+    assert_eq(TextureStreamer.uploaded, 1);
+    assert_eq(tex.width, 32);
+    assert_eq(tex.height, 32);
+
+    // the slot is reused only once the GPU signals the fence behind the upload
+    struct texture_stream_slot* slot = &TextureStreamer.slots[0];
+    assert(slot->fence != nullptr);
+    glFinish();
+    assert(_texture_stream_slot_free(slot));
+    assert(slot->fence == nullptr);
+
+    uint8_t pixels[32 * 32 * 4];
+    glBindTexture(GL_TEXTURE_2D, tex.id);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    assert_eq(pixels[30 * 4 + 0], 18);
+    assert_eq(pixels[30 * 4 + 1], 66);
+    assert_eq(pixels[30 * 4 + 2], 216);
+    assert_eq(pixels[30 * 4 + 3], 255);
+
+    texture_uninit(&tex);
+    texture_stream_uninit();
+    jobs_uninit();
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
 #define test_func(fun)         \
     (struct test) {            \
         .name = #fun, .f = fun \
     }
 
+void test_texture_pack_atlas() {
+    struct texture_pack_rect rects[40];
+    for (uint32_t i = 0; i < 40; i++)
+        rects[i] = (struct texture_pack_rect){.width = 16 + i % 7 * 9, .height = 8 + i % 5 * 13};
+
+    uint32_t pages = texture_pack_atlas(rects, 40, 128, 2);
+    assert(pages >= 2);
+
+    // inside their page with the padding, and apart from each other
+    for (uint32_t i = 0; i < 40; i++) {
+        struct texture_pack_rect* a = &rects[i];
+        assert(a->page < pages);
+        assert(a->x >= 2 && a->x + a->width + 2 <= 128);
+        assert(a->y >= 2 && a->y + a->height + 2 <= 128);
+
+        for (uint32_t j = 0; j < i; j++) {
+            struct texture_pack_rect* b = &rects[j];
+            int apart = a->page != b->page || a->x + a->width + 4 <= b->x ||
+                        b->x + b->width + 4 <= a->x || a->y + a->height + 4 <= b->y ||
+                        b->y + b->height + 4 <= a->y;
+            assert(apart);
+        }
+    }
+
+    struct texture_pack_rect big = {.width = 126, .height = 10};
+    assert_eq(texture_pack_atlas(&big, 1, 128, 2), 0);
+    assert_eq(texture_pack_atlas(&big, 1, 128, 1), 1);
+
+    vec4 uv = texture_pack_uv_rect(&rects[0], 128);
+    assert(fabsf(uv.x - rects[0].width / 128.0f) < 1e-6f);
+    assert(fabsf(uv.w - rects[0].y / 128.0f) < 1e-6f);
+}
+
+void test_texture_pack_blit() {
+    static uint8_t page[8 * 8 * 4];
+    uint8_t pixels[2 * 2 * 4];
+    for (uint32_t i = 0; i < sizeof(pixels); i++)
+        pixels[i] = i + 1;
+
+    struct texture_pack_rect r = {2, 2, 3, 2, 0};
+    texture_pack_blit(page, 8, &r, 1, pixels);
+
+    // the pixels land at the rect, the edges repeat into the padding around it
+    assert_eq(page[(2 * 8 + 3) * 4], pixels[0]);
+    assert_eq(page[(3 * 8 + 4) * 4 + 3], pixels[15]);
+    assert_eq(page[(1 * 8 + 2) * 4], pixels[0]);
+    assert_eq(page[(4 * 8 + 5) * 4 + 3], pixels[15]);
+    assert_eq(page[(1 * 8 + 5) * 4], pixels[4]);
+    assert_eq(page[(0 * 8 + 0) * 4], 0);
+    assert_eq(page[(2 * 8 + 6) * 4], 0);
+}
+
+void test_timestep() {
+    struct timestep ts;
+    timestep_init(&ts, 0.25, 4);
+
+    assert_eq(timestep_advance(&ts, 0.1), 0);
+    assert(fabs(timestep_alpha(&ts) - 0.4) < 1e-9);
+    assert_eq(timestep_advance(&ts, 0.2), 1);
+    assert(fabs(timestep_alpha(&ts) - 0.2) < 1e-9);
+
+    // long uptimes don't lose the remainder
+    for (uint32_t i = 0; i < 100000; i++)
+        timestep_advance(&ts, 1.0 / 60);
+    assert(fabs(ts.updates * 0.25 + ts.accumulator - (0.3 + 100000.0 / 60)) < 1e-6);
+
+    // a stall runs max_updates and drops the rest, keeping the fraction
+    uint64_t updates = ts.updates;
+    double alpha = timestep_alpha(&ts);
+    assert_eq(timestep_advance(&ts, 10.0), 4);
+    assert_eq(ts.updates, updates + 4);
+    assert(ts.dropped > 8.9 && ts.dropped < 9.1);
+    assert(timestep_alpha(&ts) >= 0 && timestep_alpha(&ts) < 1);
+    assert(fabs(timestep_alpha(&ts) - alpha) < 1e-6);
+
+    assert_eq(timestep_advance(&ts, -1), 0);
+}
+
+struct test_ring_args {
+    struct frame_ring* ring;
+    uint32_t count;
+    uint32_t sum;
+    int ordered;
+    int wait;
+};
+
+static void* test_ring_consumer(void* arg) {
+    struct test_ring_args* args = arg;
+    args->ordered = 1;
+
+    while (!frame_ring_done(args->ring)) {
+        uint32_t* packet =
+            args->wait ? frame_ring_peek_wait(args->ring) : frame_ring_peek(args->ring);
+        if (!packet) {
+            sched_yield();
+            continue;
+        }
+
+        if (packet[0] != args->count || packet[1] != packet[0] * 3)
+            args->ordered = 0;
+        args->sum += packet[0];
+        args->count++;
+        frame_ring_release(args->ring);
+    }
+
+    return nullptr;
+}
+
+void test_frame_ring() {
+    struct frame_ring ring;
+    frame_ring_init(&ring, 2 * sizeof(uint32_t), 2);
+    assert_eq(ring.stride, FRAME_RING_ALIGN);
+
+    // two packets in flight at most
+    assert(frame_ring_peek(&ring) == nullptr);
+    uint32_t* a = frame_ring_acquire(&ring);
+    frame_ring_publish(&ring);
+    uint32_t* b = frame_ring_acquire(&ring);
+    assert(a != nullptr && b != nullptr && a != b);
+    frame_ring_publish(&ring);
+    assert(frame_ring_acquire(&ring) == nullptr);
+
+    assert(frame_ring_peek(&ring) == a);
+    frame_ring_release(&ring);
+    assert(frame_ring_acquire(&ring) == a);
+    assert(frame_ring_peek(&ring) == b);
+    frame_ring_release(&ring);
+    assert(frame_ring_peek(&ring) == nullptr);
+    frame_ring_uninit(&ring);
+
+    // every packet arrives once and in order across threads, spinning and blocking
+    for (int wait = 0; wait < 2; wait++) {
+        frame_ring_init(&ring, 2 * sizeof(uint32_t), 2);
+        struct test_ring_args args = {.ring = &ring, .wait = wait};
+        pthread_t consumer;
+        pthread_create(&consumer, nullptr, test_ring_consumer, &args);
+
+        uint32_t expected = 0;
+        for (uint32_t i = 0; i < 100000; i++) {
+            uint32_t* packet;
+            if (wait)
+                packet = frame_ring_acquire_wait(&ring);
+            else
+                while (!(packet = frame_ring_acquire(&ring)))
+                    sched_yield();
+
+            packet[0] = i;
+            packet[1] = i * 3;
+            expected += i;
+            frame_ring_publish(&ring);
+        }
+
+        frame_ring_close(&ring);
+        pthread_join(consumer, nullptr);
+
+        assert_eq(args.count, 100000);
+        assert_eq(args.sum, expected);
+        assert(args.ordered);
+        assert_eq(ring.waiting, 0);
+        frame_ring_uninit(&ring);
+    }
+}
+
+static int test_mat4_near(mat4 a, mat4 b) {
+    float* x = (float*)&a;
+    float* y = (float*)&b;
+    for (uint32_t i = 0; i < 16; i++)
+        if (fabsf(x[i] - y[i]) > 1e-5f)
+            return 0;
+
+    return 1;
+}
+
+void test_camera_cache() {
+    struct camera cam;
+    camera_init(&cam, (vec3){1, 2, 3}, (vec3){0, 0, -1}, (vec3){0, 1, 0});
+    camera_set_y_bounds(&cam, -100, 100);
+
+    mat4 view = look_at(cam.pos, vec3_add(cam.pos, cam.front), cam.up);
+    mat4 projection = perspective(cam.fov, 1.5, 0.1, 1000);
+    assert(test_mat4_near(camera_view(&cam), view));
+    assert(test_mat4_near(camera_projection(&cam, 1.5), projection));
+    assert(test_mat4_near(camera_view_projection(&cam, 1.5), mat4_mul(projection, view)));
+    camera_right(&cam);
+    assert_eq(cam.dirty, 0);
+
+    // asking again is a flag check
+    camera_view_projection(&cam, 1.5);
+    assert_eq(cam.dirty, 0);
+
+    // moving only rebuilds the view
+    camera_move_right(&cam, 2);
+    assert_eq(cam.dirty, CAMERA_DIRTY_VIEW | CAMERA_DIRTY_VIEW_PROJECTION);
+    assert(fabsf(cam.pos.x - 3) < 1e-6f);
+    view = look_at(cam.pos, vec3_add(cam.pos, cam.front), cam.up);
+    assert(test_mat4_near(camera_view(&cam), view));
+
+    camera_set_front(&cam, 0, 0);
+    assert(cam.dirty & CAMERA_DIRTY_RIGHT);
+    vec3 right = camera_right(&cam);
+    assert(fabsf(right.z - 1) < 1e-6f);
+
+    camera_set_fov(&cam, 45);
+    view = look_at(cam.pos, vec3_add(cam.pos, cam.front), cam.up);
+    projection = perspective(45, 2, 0.1, 1000);
+    assert(test_mat4_near(camera_view_projection(&cam, 2), mat4_mul(projection, view)));
+
+    struct frustum expected = frustum_from_matrix(mat4_mul(projection, view));
+    struct frustum frustum = camera_frustum(&cam, 2);
+    assert(memcmp(&frustum, &expected, sizeof(frustum)) == 0);
+}
+
+// window depth of a view space distance, 24 bit unorm for the standard projection and float for
+// reverse-z
+static uint32_t test_depth_unorm24(mat4 projection, float distance) {
+    vec4 clip = mat4_apply(projection, (vec4){0, 0, -distance, 1});
+    return (uint32_t)lround((clip.z / clip.w * 0.5 + 0.5) * ((1 << 24) - 1));
+}
+
+static float test_depth_reverse_z(mat4 projection, float distance) {
+    vec4 clip = mat4_apply(projection, (vec4){0, 0, -distance, 1});
+    return clip.z / clip.w;
+}
+
+void test_reverse_z_depth_precision() {
+    mat4 standard = perspective(60, 1.5, 0.1, 100000);
+    mat4 reverse = perspective_reverse_z(60, 1.5, 0.1);
+
+    assert(fabsf(test_depth_reverse_z(reverse, 0.1) - 1) < 1e-6f);
+
+    // surfaces a tenth of a percent apart, standard 24 bit depth merges the distant ones
+    float distances[] = {1, 10, 100, 1000, 5000, 20000, 90000};
+    int merged = 0;
+    float last = 2;
+    for (uint32_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+        float d = distances[i];
+        merged += test_depth_unorm24(standard, d) == test_depth_unorm24(standard, d * 1.001f);
+
+        float depth = test_depth_reverse_z(reverse, d);
+        assert(depth < last && depth > 0);
+        assert(test_depth_reverse_z(reverse, d * 1.001f) < depth);
+        last = depth;
+    }
+    assert(merged >= 2);
+
+    // the far plane is at infinity, the near plane still clips
+    struct camera cam;
+    camera_init(&cam, (vec3){0, 0, 0}, (vec3){0, 0, -1}, (vec3){0, 1, 0});
+    camera_set_clip(&cam, 0.5, 100);
+    camera_set_reverse_z(&cam, 1);
+    assert(test_mat4_near(camera_projection(&cam, 1.5), perspective_reverse_z(60, 1.5, 0.5)));
+
+    struct frustum f = camera_frustum(&cam, 1.5);
+    assert(frustum_test_aabb(&f, box_at((vec3){0, 0, -1e6}, 1)));
+    assert(frustum_test_aabb(&f, box_at((vec3){0, 0, -5}, 1)));
+    assert(!frustum_test_aabb(&f, box_at((vec3){0, 0, 3}, 1)));
+    assert(!frustum_test_sphere(&f, (sphere){{0, 0, -0.2}, 0.1}));
+    assert(!frustum_test_aabb(&f, box_at((vec3){1000, 0, -5}, 1)));
+}
+
 int main() {
     struct vector tests;
     vec_init(&tests, sizeof(struct test));
@@ -569,17 +1847,58 @@ int main() {
     vec_push(&tests, &test_func(test_map_alloc));
     vec_push(&tests, &test_func(test_map_insert));
     vec_push(&tests, &test_func(test_map_remove));
+    vec_push(&tests, &test_func(test_map_ptr_hasher));
     vec_push(&tests, &test_func(test_map_str));
 
     vec_push(&tests, &test_func(test_string_append));
     vec_push(&tests, &test_func(test_string_pop));
+    vec_push(&tests, &test_func(test_string_inline));
+    vec_push(&tests, &test_func(test_string_intern));
 
     vec_push(&tests, &test_func(test_mat4_mul_identity));
     vec_push(&tests, &test_func(test_mat4_mul_associativity));
     vec_push(&tests, &test_func(test_mat4_mul_chain));
+    vec_push(&tests, &test_func(test_mat4_mul_scalar));
+    vec_push(&tests, &test_func(test_mat4_apply));
+    vec_push(&tests, &test_func(test_mat4_inverse_affine));
+    vec_push(&tests, &test_func(test_mat4_normal_matrix));
+
+    vec_push(&tests, &test_func(test_half_float));
+    vec_push(&tests, &test_func(test_snorm_octahedral));
+
+    vec_push(&tests, &test_func(test_frustum_planes));
+    vec_push(&tests, &test_func(test_frustum_cull));
+    vec_push(&tests, &test_func(test_camera_cache));
+    vec_push(&tests, &test_func(test_reverse_z_depth_precision));
+
+    vec_push(&tests, &test_func(test_mesh_optimize_vertex_cache));
+    vec_push(&tests, &test_func(test_mesh_optimize_vertex_fetch));
+    vec_push(&tests, &test_func(test_mesh_simplify));
+    vec_push(&tests, &test_func(test_mesh_generate_lod_indices));
+    vec_push(&tests, &test_func(test_mesh_split_indices));
+
+    vec_push(&tests, &test_func(test_draw_key_order));
+    vec_push(&tests, &test_func(test_render_queue_sort));
 
     vec_push(&tests, &test_func(test_image_png));
 
+    vec_push(&tests, &test_func(test_model_cache));
+    vec_push(&tests, &test_func(test_model_cache_corrupt));
+    vec_push(&tests, &test_func(test_bc1_block));
+    vec_push(&tests, &test_func(test_bc3_block));
+    vec_push(&tests, &test_func(test_texture_compress_image));
+    vec_push(&tests, &test_func(test_texture_pack_atlas));
+    vec_push(&tests, &test_func(test_texture_pack_blit));
+
+    vec_push(&tests, &test_func(test_timestep));
+    vec_push(&tests, &test_func(test_frame_ring));
+
+    vec_push(&tests, &test_func(test_jobs_inline));
+    vec_push(&tests, &test_func(test_jobs_parallel_for));
+    vec_push(&tests, &test_func(test_jobs_children));
+    vec_push(&tests, &test_func(test_jobs_pool_reuse));
+    vec_push(&tests, &test_func(test_texture_stream));
+
     for (int i = 0; i < (int)tests.size; i++) {
         vec_get(&tests, i, &current_test);
         assert_failed = 0;